@@ -0,0 +1,681 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_CompressedField.h"
+#include "Async/ParallelFor.h"
+#include "Misc/ScopeLock.h"
+
+#include <cmath>
+
+namespace
+{
+	constexpr int s_SubBlockSize{ 4 };
+	constexpr int s_SubBlockCells{ s_SubBlockSize * s_SubBlockSize * s_SubBlockSize };
+	constexpr int s_IntPrecision{ 32 };
+	constexpr int s_ExponentBits{ 8 };
+	constexpr int s_ExponentBias{ 127 };
+	constexpr uint32 s_NegabinaryMask{ 0xaaaaaaaau };
+
+	//Bit streams are packed into 64-bit words, least significant bit first
+	class FBlockBitWriter final
+	{
+	public:
+		explicit FBlockBitWriter(TArray<uint64>& words) : m_Words{ words } {}
+
+		void WriteBit(bool bit)
+		{
+			WriteBits(bit ? 1 : 0, 1);
+		}
+
+		//Writes the low numBits of value and returns the bits that didn't go out
+		uint64 WriteBits(uint64 value, int numBits)
+		{
+			while (numBits > 0)
+			{
+				const int numTaken = FMath::Min(numBits, 64 - m_NumBuffered);
+				const uint64 mask = numTaken == 64 ? ~0ull : (1ull << numTaken) - 1;
+				m_Buffer |= (value & mask) << m_NumBuffered;
+				value = numTaken == 64 ? 0 : value >> numTaken;
+				m_NumBuffered += numTaken;
+				numBits -= numTaken;
+
+				if (m_NumBuffered == 64)
+				{
+					m_Words.Add(m_Buffer);
+					m_Buffer = 0;
+					m_NumBuffered = 0;
+				}
+			}
+			return value;
+		}
+
+		void Flush()
+		{
+			if (m_NumBuffered > 0)
+			{
+				m_Words.Add(m_Buffer);
+				m_Buffer = 0;
+				m_NumBuffered = 0;
+			}
+		}
+
+	private:
+		TArray<uint64>& m_Words;
+		uint64 m_Buffer{};
+		int m_NumBuffered{};
+	};
+
+	//Reads zeroes past the end, the encoder stops at the same bit budget so they're never used
+	class FBlockBitReader final
+	{
+	public:
+		explicit FBlockBitReader(const TArray<uint64>& words) : m_Words{ words } {}
+
+		bool ReadBit()
+		{
+			return ReadBits(1) != 0;
+		}
+
+		uint64 ReadBits(int numBits)
+		{
+			uint64 value{};
+			int shift{};
+			while (numBits > 0)
+			{
+				if (m_NumBuffered == 0)
+				{
+					m_Buffer = m_WordIdx < m_Words.Num() ? m_Words[m_WordIdx++] : 0;
+					m_NumBuffered = 64;
+				}
+
+				const int numTaken = FMath::Min(numBits, m_NumBuffered);
+				const uint64 mask = numTaken == 64 ? ~0ull : (1ull << numTaken) - 1;
+				value |= (m_Buffer & mask) << shift;
+				m_Buffer = numTaken == 64 ? 0 : m_Buffer >> numTaken;
+				m_NumBuffered -= numTaken;
+				shift += numTaken;
+				numBits -= numTaken;
+			}
+			return value;
+		}
+
+	private:
+		const TArray<uint64>& m_Words;
+		int m_WordIdx{};
+		uint64 m_Buffer{};
+		int m_NumBuffered{};
+	};
+
+	//Coefficients ordered by sequency, low frequencies first, so the bit planes of smooth blocks end in long zero runs
+	const TArray<int>& GetCoefficientOrder()
+	{
+		static const TArray<int> s_Order = []()
+		{
+			TArray<int> order{};
+			for (int idx{}; idx < s_SubBlockCells; ++idx)
+			{
+				order.Add(idx);
+			}
+
+			const auto getKey = [](int idx)
+			{
+				const int i = idx % 4;
+				const int j = (idx / 4) % 4;
+				const int k = idx / 16;
+				return ((i + j + k) * 64 + i * i + j * j + k * k) * 64 + idx;
+			};
+			order.Sort([&getKey](int a, int b) { return getKey(a) < getKey(b); });
+			return order;
+		}();
+		return s_Order;
+	}
+
+	//Integer lifting steps of the zfp decorrelating transform, on 4 values stride apart
+	void ForwardLift(int32* pValues, int stride)
+	{
+		int32 x = pValues[0 * stride];
+		int32 y = pValues[1 * stride];
+		int32 z = pValues[2 * stride];
+		int32 w = pValues[3 * stride];
+
+		x += w; x >>= 1; w -= x;
+		z += y; z >>= 1; y -= z;
+		x += z; x >>= 1; z -= x;
+		w += y; w >>= 1; y -= w;
+		w += y >> 1; y -= w >> 1;
+
+		pValues[0 * stride] = x;
+		pValues[1 * stride] = y;
+		pValues[2 * stride] = z;
+		pValues[3 * stride] = w;
+	}
+
+	void InverseLift(int32* pValues, int stride)
+	{
+		int32 x = pValues[0 * stride];
+		int32 y = pValues[1 * stride];
+		int32 z = pValues[2 * stride];
+		int32 w = pValues[3 * stride];
+
+		y += w >> 1; w -= y >> 1;
+		y += w; w <<= 1; w -= y;
+		z += x; x <<= 1; x -= z;
+		y += z; z <<= 1; z -= y;
+		w += x; x <<= 1; x -= w;
+
+		pValues[0 * stride] = x;
+		pValues[1 * stride] = y;
+		pValues[2 * stride] = z;
+		pValues[3 * stride] = w;
+	}
+
+	void ForwardTransform(int32* pValues)
+	{
+		for (int a{}; a < 4; ++a)
+		{
+			for (int b{}; b < 4; ++b)
+			{
+				ForwardLift(pValues + 4 * a + 16 * b, 1);
+			}
+		}
+		for (int a{}; a < 4; ++a)
+		{
+			for (int b{}; b < 4; ++b)
+			{
+				ForwardLift(pValues + a + 16 * b, 4);
+			}
+		}
+		for (int a{}; a < 4; ++a)
+		{
+			for (int b{}; b < 4; ++b)
+			{
+				ForwardLift(pValues + a + 4 * b, 16);
+			}
+		}
+	}
+
+	void InverseTransform(int32* pValues)
+	{
+		for (int a{}; a < 4; ++a)
+		{
+			for (int b{}; b < 4; ++b)
+			{
+				InverseLift(pValues + a + 4 * b, 16);
+			}
+		}
+		for (int a{}; a < 4; ++a)
+		{
+			for (int b{}; b < 4; ++b)
+			{
+				InverseLift(pValues + a + 16 * b, 4);
+			}
+		}
+		for (int a{}; a < 4; ++a)
+		{
+			for (int b{}; b < 4; ++b)
+			{
+				InverseLift(pValues + 4 * a + 16 * b, 1);
+			}
+		}
+	}
+
+	//Bit planes kept for a block with exponent maxExponent, everything under the tolerance is dropped
+	int GetMaxPrecision(int maxExponent, const FC_CompressionSettings& settings)
+	{
+		if (settings.m_Tolerance <= 0.f)
+		{
+			return s_IntPrecision;
+		}
+
+		const int minExponent = static_cast<int>(std::floor(std::log2(settings.m_Tolerance)));
+		return FMath::Clamp(maxExponent - minExponent + 8, 0, s_IntPrecision);
+	}
+
+	int GetMaxBits(const FC_CompressionSettings& settings)
+	{
+		return settings.m_BitsPerValue > 0.f ? FMath::Max(static_cast<int>(settings.m_BitsPerValue * s_SubBlockCells), 1 + s_ExponentBits) : MAX_int32;
+	}
+
+	//Group-tested bit planes, the first n bits of a plane go out verbatim, where n is how many coefficients were already significant,
+	//the rest is a run-length code of the next significant one
+	void EncodeSubBlock(const float* pValues, const FC_CompressionSettings& settings, FBlockBitWriter& writer)
+	{
+		float maxAbs{};
+		for (int idx{}; idx < s_SubBlockCells; ++idx)
+		{
+			maxAbs = FMath::Max(maxAbs, FMath::Abs(pValues[idx]));
+		}
+
+		int maxExponent{};
+		std::frexp(maxAbs, &maxExponent);
+		maxExponent = FMath::Max(maxExponent, 1 - s_ExponentBias);
+
+		const int maxPrecision = maxAbs > 0.f ? GetMaxPrecision(maxExponent, settings) : 0;
+		int bitsLeft = GetMaxBits(settings);
+		if (maxPrecision == 0)
+		{
+			writer.WriteBit(false);
+			return;
+		}
+
+		writer.WriteBit(true);
+		writer.WriteBits(maxExponent + s_ExponentBias, s_ExponentBits);
+		bitsLeft -= 1 + s_ExponentBits;
+
+		//Block floating point, two bits of headroom for the transform
+		int32 ints[s_SubBlockCells];
+		for (int idx{}; idx < s_SubBlockCells; ++idx)
+		{
+			ints[idx] = static_cast<int32>(std::ldexp(pValues[idx], s_IntPrecision - 2 - maxExponent));
+		}
+		ForwardTransform(ints);
+
+		const TArray<int>& order = GetCoefficientOrder();
+		uint32 coefficients[s_SubBlockCells];
+		for (int idx{}; idx < s_SubBlockCells; ++idx)
+		{
+			coefficients[idx] = (static_cast<uint32>(ints[order[idx]]) + s_NegabinaryMask) ^ s_NegabinaryMask;
+		}
+
+		const int minPlane = s_IntPrecision - maxPrecision;
+		int numSignificant{};
+		for (int plane{ s_IntPrecision - 1 }; bitsLeft > 0 && plane >= minPlane; --plane)
+		{
+			uint64 planeBits{};
+			for (int idx{}; idx < s_SubBlockCells; ++idx)
+			{
+				planeBits |= static_cast<uint64>((coefficients[idx] >> plane) & 1u) << idx;
+			}
+
+			const int numVerbatim = FMath::Min(numSignificant, bitsLeft);
+			bitsLeft -= numVerbatim;
+			planeBits = writer.WriteBits(planeBits, numVerbatim);
+
+			while (numSignificant < s_SubBlockCells && bitsLeft > 0)
+			{
+				--bitsLeft;
+				writer.WriteBit(planeBits != 0);
+				if (planeBits == 0)
+				{
+					break;
+				}
+
+				while (numSignificant < s_SubBlockCells - 1 && bitsLeft > 0)
+				{
+					--bitsLeft;
+					const bool bit = (planeBits & 1u) != 0;
+					writer.WriteBit(bit);
+					if (bit)
+					{
+						break;
+					}
+					planeBits >>= 1;
+					++numSignificant;
+				}
+				planeBits >>= 1;
+				++numSignificant;
+			}
+		}
+	}
+
+	void DecodeSubBlock(FBlockBitReader& reader, const FC_CompressionSettings& settings, float* pOutValues)
+	{
+		int bitsLeft = GetMaxBits(settings);
+		if (!reader.ReadBit())
+		{
+			FMemory::Memzero(pOutValues, s_SubBlockCells * sizeof(float));
+			return;
+		}
+
+		const int maxExponent = static_cast<int>(reader.ReadBits(s_ExponentBits)) - s_ExponentBias;
+		const int maxPrecision = GetMaxPrecision(maxExponent, settings);
+		bitsLeft -= 1 + s_ExponentBits;
+
+		uint32 coefficients[s_SubBlockCells]{};
+		const int minPlane = s_IntPrecision - maxPrecision;
+		int numSignificant{};
+		for (int plane{ s_IntPrecision - 1 }; bitsLeft > 0 && plane >= minPlane; --plane)
+		{
+			const int numVerbatim = FMath::Min(numSignificant, bitsLeft);
+			bitsLeft -= numVerbatim;
+			uint64 planeBits = reader.ReadBits(numVerbatim);
+
+			while (numSignificant < s_SubBlockCells && bitsLeft > 0)
+			{
+				--bitsLeft;
+				if (!reader.ReadBit())
+				{
+					break;
+				}
+
+				while (numSignificant < s_SubBlockCells - 1 && bitsLeft > 0)
+				{
+					--bitsLeft;
+					if (reader.ReadBit())
+					{
+						break;
+					}
+					++numSignificant;
+				}
+				planeBits += 1ull << numSignificant;
+				++numSignificant;
+			}
+
+			for (int idx{}; planeBits; ++idx, planeBits >>= 1)
+			{
+				coefficients[idx] += static_cast<uint32>(planeBits & 1u) << plane;
+			}
+		}
+
+		const TArray<int>& order = GetCoefficientOrder();
+		int32 ints[s_SubBlockCells];
+		for (int idx{}; idx < s_SubBlockCells; ++idx)
+		{
+			ints[order[idx]] = static_cast<int32>((coefficients[idx] ^ s_NegabinaryMask) - s_NegabinaryMask);
+		}
+		InverseTransform(ints);
+
+		for (int idx{}; idx < s_SubBlockCells; ++idx)
+		{
+			pOutValues[idx] = std::ldexp(static_cast<float>(ints[idx]), maxExponent - (s_IntPrecision - 2));
+		}
+	}
+
+	//Block cell (x, y, z) lands in sub-block cell z + 4y + 16x of sub-block (x / 4, y / 4, z / 4)
+	void SplitBlock(const float* pBlockValues, float (*pSubBlocks)[s_SubBlockCells])
+	{
+		constexpr int size{ FC_CompressedField::BlockSize };
+		for (int x{}; x < size; ++x)
+		{
+			for (int y{}; y < size; ++y)
+			{
+				for (int z{}; z < size; ++z)
+				{
+					const int subBlockIdx = ((x / 4) * 2 + y / 4) * 2 + z / 4;
+					pSubBlocks[subBlockIdx][z % 4 + 4 * (y % 4) + 16 * (x % 4)] = pBlockValues[(x * size + y) * size + z];
+				}
+			}
+		}
+	}
+
+	void JoinBlock(const float (*pSubBlocks)[s_SubBlockCells], float* pOutBlockValues)
+	{
+		constexpr int size{ FC_CompressedField::BlockSize };
+		for (int x{}; x < size; ++x)
+		{
+			for (int y{}; y < size; ++y)
+			{
+				for (int z{}; z < size; ++z)
+				{
+					const int subBlockIdx = ((x / 4) * 2 + y / 4) * 2 + z / 4;
+					pOutBlockValues[(x * size + y) * size + z] = pSubBlocks[subBlockIdx][z % 4 + 4 * (y % 4) + 16 * (x % 4)];
+				}
+			}
+		}
+	}
+}
+
+void FC_CompressedField::Init(int sizeX, int sizeY, int sizeZ, const FC_CompressionSettings& settings, int numCachedBlocks, int numSlabs)
+{
+	Reset();
+
+	m_SizeX = FMath::Max(sizeX, 1);
+	m_SizeY = FMath::Max(sizeY, 1);
+	m_SizeZ = FMath::Max(sizeZ, 1);
+	m_NumBlocksX = FMath::DivideAndRoundUp(m_SizeX, BlockSize);
+	m_NumBlocksY = FMath::DivideAndRoundUp(m_SizeY, BlockSize);
+	m_NumBlocksZ = FMath::DivideAndRoundUp(m_SizeZ, BlockSize);
+	m_Settings = settings;
+
+	//Every block starts as a zero block, one header bit per sub-block
+	const int numBlocks = m_NumBlocksX * m_NumBlocksY * m_NumBlocksZ;
+	m_Blocks.SetNum(numBlocks);
+	for (TArray<uint64>& block : m_Blocks)
+	{
+		block.Add(0);
+	}
+
+	const int numSlabsUsed = FMath::Clamp(numSlabs, 1, m_NumBlocksX);
+	for (int slabIdx{}; slabIdx < numSlabsUsed; ++slabIdx)
+	{
+		TUniquePtr<FSlabCache>& pSlabCache = m_pSlabCaches.Add_GetRef(MakeUnique<FSlabCache>());
+		pSlabCache->m_Blocks.SetNum(FMath::Clamp(numCachedBlocks, 1, numBlocks));
+	}
+	m_CacheSlots.Init(INDEX_NONE, numBlocks);
+}
+
+void FC_CompressedField::Reset()
+{
+	m_Blocks.Empty();
+	m_pSlabCaches.Empty();
+	m_CacheSlots.Empty();
+	m_SizeX = m_SizeY = m_SizeZ = 0;
+	m_NumBlocksX = m_NumBlocksY = m_NumBlocksZ = 0;
+}
+
+void FC_CompressedField::Compress(TArrayView64<const float> field)
+{
+	check(field.Num() == GetNumCells());
+
+	//Whatever was cached is stale now
+	for (const TUniquePtr<FSlabCache>& pSlabCache : m_pSlabCaches)
+	{
+		for (FCachedBlock& cachedBlock : pSlabCache->m_Blocks)
+		{
+			if (cachedBlock.m_BlockIdx != INDEX_NONE)
+			{
+				m_CacheSlots[cachedBlock.m_BlockIdx] = INDEX_NONE;
+			}
+			cachedBlock = FCachedBlock{};
+		}
+	}
+
+	ParallelFor(m_Blocks.Num(), [this, field](int blockIdx)
+	{
+		float values[BlockCells];
+		GatherBlock(field, blockIdx, values);
+		EncodeBlock(values, blockIdx);
+	});
+}
+
+void FC_CompressedField::Decompress(TArrayView64<float> outField) const
+{
+	DecompressSlices(0, m_SizeX, outField);
+}
+
+void FC_CompressedField::DecompressSlices(int firstX, int endX, TArrayView64<float> outSlices) const
+{
+	check(firstX >= 0 && firstX <= endX && endX <= m_SizeX);
+	check(outSlices.Num() == static_cast<int64>(endX - firstX) * m_SizeY * m_SizeZ);
+	if (firstX == endX)
+	{
+		return;
+	}
+
+	//Only the blocks along x that overlap the slices get decoded
+	const int firstBlockX = firstX / BlockSize;
+	const int numBlocksX = (endX - 1) / BlockSize + 1 - firstBlockX;
+	const int blocksPerX = m_NumBlocksY * m_NumBlocksZ;
+
+	ParallelFor(numBlocksX * blocksPerX, [this, firstX, endX, outSlices, firstBlockX, blocksPerX](int idx)
+	{
+		const int blockIdx = firstBlockX * blocksPerX + idx;
+		float values[BlockCells];
+		DecodeBlock(blockIdx, values);
+		ScatterBlock(values, blockIdx, outSlices, firstX, endX);
+	});
+}
+
+float FC_CompressedField::GetValue(int x, int y, int z)
+{
+	FSlabCache& slabCache = GetSlabCache(x);
+	FScopeLock lock{ &slabCache.m_Lock };
+
+	int localIdx{};
+	return GetCachedBlock(slabCache, x, y, z, localIdx).m_Values[localIdx];
+}
+
+void FC_CompressedField::SetValue(int x, int y, int z, float value)
+{
+	FSlabCache& slabCache = GetSlabCache(x);
+	FScopeLock lock{ &slabCache.m_Lock };
+
+	int localIdx{};
+	FCachedBlock& cachedBlock = GetCachedBlock(slabCache, x, y, z, localIdx);
+	cachedBlock.m_Values[localIdx] = value;
+	cachedBlock.m_bIsDirty = true;
+}
+
+void FC_CompressedField::AddValue(int x, int y, int z, float amount)
+{
+	FSlabCache& slabCache = GetSlabCache(x);
+	FScopeLock lock{ &slabCache.m_Lock };
+
+	int localIdx{};
+	FCachedBlock& cachedBlock = GetCachedBlock(slabCache, x, y, z, localIdx);
+	cachedBlock.m_Values[localIdx] += amount;
+	cachedBlock.m_bIsDirty = true;
+}
+
+void FC_CompressedField::Flush()
+{
+	for (const TUniquePtr<FSlabCache>& pSlabCache : m_pSlabCaches)
+	{
+		FScopeLock lock{ &pSlabCache->m_Lock };
+		for (FCachedBlock& cachedBlock : pSlabCache->m_Blocks)
+		{
+			if (cachedBlock.m_bIsDirty)
+			{
+				EncodeBlock(cachedBlock.m_Values, cachedBlock.m_BlockIdx);
+				cachedBlock.m_bIsDirty = false;
+			}
+		}
+	}
+}
+
+SIZE_T FC_CompressedField::GetCompressedBytes() const
+{
+	SIZE_T numBytes{};
+	for (const TArray<uint64>& block : m_Blocks)
+	{
+		numBytes += block.Num() * sizeof(uint64);
+	}
+	return numBytes;
+}
+
+FC_CompressedField::FCachedBlock& FC_CompressedField::GetCachedBlock(FSlabCache& slabCache, int x, int y, int z, int& outLocalIdx)
+{
+	check(x >= 0 && x < m_SizeX && y >= 0 && y < m_SizeY && z >= 0 && z < m_SizeZ);
+
+	outLocalIdx = ((x % BlockSize) * BlockSize + y % BlockSize) * BlockSize + z % BlockSize;
+	const int blockIdx = GetBlockIdx(x / BlockSize, y / BlockSize, z / BlockSize);
+
+	//Only blocks of this slab ever land in its cache, so their slots are only touched under its lock
+	TArray<FCachedBlock>& cache = slabCache.m_Blocks;
+	int slot = m_CacheSlots[blockIdx];
+	if (slot == INDEX_NONE)
+	{
+		//Least recently used slot, the cache is small enough for a linear scan
+		slot = 0;
+		for (int slotIdx{ 1 }; slotIdx < cache.Num(); ++slotIdx)
+		{
+			if (cache[slotIdx].m_LastUse < cache[slot].m_LastUse)
+			{
+				slot = slotIdx;
+			}
+		}
+
+		FCachedBlock& evicted = cache[slot];
+		if (evicted.m_BlockIdx != INDEX_NONE)
+		{
+			if (evicted.m_bIsDirty)
+			{
+				EncodeBlock(evicted.m_Values, evicted.m_BlockIdx);
+			}
+			m_CacheSlots[evicted.m_BlockIdx] = INDEX_NONE;
+		}
+
+		evicted.m_BlockIdx = blockIdx;
+		evicted.m_bIsDirty = false;
+		DecodeBlock(blockIdx, evicted.m_Values);
+		m_CacheSlots[blockIdx] = slot;
+	}
+
+	FCachedBlock& cachedBlock = cache[slot];
+	cachedBlock.m_LastUse = ++slabCache.m_UseCounter;
+	return cachedBlock;
+}
+
+void FC_CompressedField::GatherBlock(TArrayView64<const float> field, int blockIdx, float* pOutValues) const
+{
+	const int firstX = (blockIdx / (m_NumBlocksY * m_NumBlocksZ)) * BlockSize;
+	const int firstY = ((blockIdx / m_NumBlocksZ) % m_NumBlocksY) * BlockSize;
+	const int firstZ = (blockIdx % m_NumBlocksZ) * BlockSize;
+
+	//Cells past the field edge repeat the last one, which keeps partial blocks smooth
+	for (int x{}; x < BlockSize; ++x)
+	{
+		const int fieldX = FMath::Min(firstX + x, m_SizeX - 1);
+		for (int y{}; y < BlockSize; ++y)
+		{
+			const int fieldY = FMath::Min(firstY + y, m_SizeY - 1);
+			for (int z{}; z < BlockSize; ++z)
+			{
+				const int fieldZ = FMath::Min(firstZ + z, m_SizeZ - 1);
+				pOutValues[(x * BlockSize + y) * BlockSize + z] = field[(static_cast<int64>(fieldX) * m_SizeY + fieldY) * m_SizeZ + fieldZ];
+			}
+		}
+	}
+}
+
+void FC_CompressedField::ScatterBlock(const float* pValues, int blockIdx, TArrayView64<float> outField, int firstX, int endX) const
+{
+	const int blockX = (blockIdx / (m_NumBlocksY * m_NumBlocksZ)) * BlockSize;
+	const int firstY = ((blockIdx / m_NumBlocksZ) % m_NumBlocksY) * BlockSize;
+	const int firstZ = (blockIdx % m_NumBlocksZ) * BlockSize;
+
+	const int scatterFirstX = FMath::Max(blockX, firstX);
+	const int scatterEndX = FMath::Min(blockX + BlockSize, endX);
+	const int endY = FMath::Min(firstY + BlockSize, m_SizeY);
+	const int endZ = FMath::Min(firstZ + BlockSize, m_SizeZ);
+
+	for (int x{ scatterFirstX }; x < scatterEndX; ++x)
+	{
+		for (int y{ firstY }; y < endY; ++y)
+		{
+			for (int z{ firstZ }; z < endZ; ++z)
+			{
+				outField[(static_cast<int64>(x - firstX) * m_SizeY + y) * m_SizeZ + z] = pValues[((x - blockX) * BlockSize + y - firstY) * BlockSize + z - firstZ];
+			}
+		}
+	}
+}
+
+void FC_CompressedField::EncodeBlock(const float* pValues, int blockIdx)
+{
+	float subBlocks[8][s_SubBlockCells];
+	SplitBlock(pValues, subBlocks);
+
+	TArray<uint64>& words = m_Blocks[blockIdx];
+	words.Reset();
+
+	FBlockBitWriter writer{ words };
+	for (const float* pSubBlock : subBlocks)
+	{
+		EncodeSubBlock(pSubBlock, m_Settings, writer);
+	}
+	writer.Flush();
+}
+
+void FC_CompressedField::DecodeBlock(int blockIdx, float* pOutValues) const
+{
+	float subBlocks[8][s_SubBlockCells];
+
+	FBlockBitReader reader{ m_Blocks[blockIdx] };
+	for (float* pSubBlock : subBlocks)
+	{
+		DecodeSubBlock(reader, m_Settings, pSubBlock);
+	}
+
+	JoinBlock(subBlocks, pOutValues);
+}
@@ -0,0 +1,254 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_FieldArena.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+
+#if PLATFORM_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr SIZE_T s_HugePageSize{ 2 * 1024 * 1024 };
+}
+
+FC_FieldArena::~FC_FieldArena()
+{
+	Free();
+}
+
+int FC_FieldArena::AddField(int64 numElements, int elementBytes)
+{
+	check(!IsAllocated());
+
+	//Every field starts on its own cache line
+	m_Size = Align(m_Size, Alignment);
+	m_Offsets.Add(m_Size);
+	m_Sizes.Add(numElements);
+	m_ElementBytes.Add(elementBytes);
+	m_Size += static_cast<SIZE_T>(numElements) * elementBytes;
+
+	return m_Offsets.Num() - 1;
+}
+
+bool FC_FieldArena::Allocate(bool bUseHugePages, const FString& backingDirectory)
+{
+	check(!IsAllocated());
+
+	const SIZE_T size = FMath::Max<SIZE_T>(Align(m_Size, Alignment), Alignment);
+
+	if (!backingDirectory.IsEmpty())
+	{
+		if (AllocateFileBacked(size, backingDirectory))
+		{
+			return true;
+		}
+		UE_LOG(LogTemp, Warning, TEXT("Falling back to memory for %llu bytes, FieldArena/Allocate"), static_cast<uint64>(size));
+	}
+
+#if PLATFORM_LINUX
+	//Mapped pages stay untouched until FirstTouch, which is what places them on the right node
+	if (bUseHugePages)
+	{
+		const SIZE_T hugeSize = Align(size, s_HugePageSize);
+		void* pMapped = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (pMapped != MAP_FAILED)
+		{
+			m_pMemory = static_cast<uint8*>(pMapped);
+			m_AllocatedBytes = hugeSize;
+			m_bIsMapped = true;
+			m_bUsesHugePages = true;
+			return true;
+		}
+
+		//No reserved huge pages, ask for transparent ones instead
+		pMapped = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (pMapped != MAP_FAILED)
+		{
+			m_bUsesHugePages = madvise(pMapped, hugeSize, MADV_HUGEPAGE) == 0;
+			m_pMemory = static_cast<uint8*>(pMapped);
+			m_AllocatedBytes = hugeSize;
+			m_bIsMapped = true;
+			return true;
+		}
+	}
+
+	void* pMapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pMapped != MAP_FAILED)
+	{
+		m_pMemory = static_cast<uint8*>(pMapped);
+		m_AllocatedBytes = size;
+		m_bIsMapped = true;
+		return true;
+	}
+#endif
+
+	m_pMemory = static_cast<uint8*>(FMemory::Malloc(size, Alignment));
+	m_AllocatedBytes = m_pMemory ? size : 0;
+
+	if (!m_pMemory)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to allocate %llu bytes, FieldArena/Allocate"), static_cast<uint64>(size));
+	}
+
+	return m_pMemory != nullptr;
+}
+
+void FC_FieldArena::Free()
+{
+	if (m_pMemory)
+	{
+#if PLATFORM_LINUX
+		if (m_bIsMapped)
+		{
+			munmap(m_pMemory, m_AllocatedBytes);
+		}
+		else
+#endif
+		{
+			FMemory::Free(m_pMemory);
+		}
+	}
+
+	m_pMemory = nullptr;
+	m_AllocatedBytes = 0;
+	m_bIsMapped = false;
+	m_bUsesHugePages = false;
+	m_bIsFileBacked = false;
+
+	m_Offsets.Reset();
+	m_Sizes.Reset();
+	m_ElementBytes.Reset();
+	m_Size = 0;
+}
+
+void FC_FieldArena::FirstTouch(int numSlabs, int64 sliceElements, TFunctionRef<void(int slabIdx, int& firstSlice, int& endSlice)> getSlabSlices)
+{
+	check(IsAllocated());
+
+	ParallelFor(FMath::Max(numSlabs, 1), [this, sliceElements, &getSlabSlices](int slabIdx)
+	{
+		int firstSlice{}, endSlice{};
+		getSlabSlices(slabIdx, firstSlice, endSlice);
+
+		TouchSlices(firstSlice, endSlice, sliceElements);
+	});
+}
+
+void FC_FieldArena::TouchSlices(int firstSlice, int endSlice, int64 sliceElements)
+{
+	check(IsAllocated());
+
+	//A fresh file reads back as zeroes already, writing them would pull the whole domain into memory
+	if (m_bIsFileBacked)
+	{
+		return;
+	}
+
+	for (int fieldIdx{}; fieldIdx < m_Offsets.Num(); ++fieldIdx)
+	{
+		const int64 firstElement = FMath::Min(firstSlice * sliceElements, m_Sizes[fieldIdx]);
+		const int64 endElement = FMath::Min(endSlice * sliceElements, m_Sizes[fieldIdx]);
+		const SIZE_T elementBytes = m_ElementBytes[fieldIdx];
+
+		FMemory::Memzero(static_cast<uint8*>(GetFieldData(fieldIdx)) + firstElement * elementBytes, (endElement - firstElement) * elementBytes);
+	}
+}
+
+void FC_FieldArena::AdviseSlices(int firstSlice, int endSlice, int64 sliceElements, EC_SliceAdvice advice) const
+{
+#if PLATFORM_LINUX
+	if (!m_bIsFileBacked || firstSlice >= endSlice)
+	{
+		return;
+	}
+
+	const SIZE_T pageSize = static_cast<SIZE_T>(sysconf(_SC_PAGESIZE));
+	for (int fieldIdx{}; fieldIdx < m_Offsets.Num(); ++fieldIdx)
+	{
+		const int64 firstElement = FMath::Clamp<int64>(firstSlice * sliceElements, 0, m_Sizes[fieldIdx]);
+		const int64 endElement = FMath::Clamp<int64>(endSlice * sliceElements, 0, m_Sizes[fieldIdx]);
+		const SIZE_T first = m_Offsets[fieldIdx] + static_cast<SIZE_T>(firstElement) * m_ElementBytes[fieldIdx];
+		const SIZE_T end = m_Offsets[fieldIdx] + static_cast<SIZE_T>(endElement) * m_ElementBytes[fieldIdx];
+
+		//Reading ahead may round out to whole pages, dropping only rounds in so pages shared with the neighbors stay
+		const bool bWillNeed = advice == EC_SliceAdvice::WillNeed;
+		const SIZE_T firstPage = bWillNeed ? AlignDown(first, pageSize) : Align(first, pageSize);
+		const SIZE_T endPage = bWillNeed ? Align(end, pageSize) : AlignDown(end, pageSize);
+		if (firstPage < endPage)
+		{
+			madvise(m_pMemory + firstPage, FMath::Min(endPage, m_AllocatedBytes) - firstPage, bWillNeed ? MADV_WILLNEED : MADV_DONTNEED);
+		}
+	}
+#endif
+}
+
+void FC_FieldArena::DiscardField(const void* pFieldData) const
+{
+#if PLATFORM_LINUX
+	const int fieldIdx = m_Offsets.IndexOfByKey(static_cast<SIZE_T>(static_cast<const uint8*>(pFieldData) - m_pMemory));
+	if (!m_bIsMapped || fieldIdx == INDEX_NONE)
+	{
+		return;
+	}
+
+	//Rounds in, so the pages shared with the neighboring fields stay
+	const SIZE_T pageSize = static_cast<SIZE_T>(sysconf(_SC_PAGESIZE));
+	const SIZE_T firstPage = Align(m_Offsets[fieldIdx], pageSize);
+	const SIZE_T endPage = AlignDown(m_Offsets[fieldIdx] + static_cast<SIZE_T>(m_Sizes[fieldIdx]) * m_ElementBytes[fieldIdx], pageSize);
+	if (firstPage < endPage)
+	{
+		madvise(m_pMemory + firstPage, endPage - firstPage, MADV_DONTNEED);
+	}
+#endif
+}
+
+bool FC_FieldArena::AllocateFileBacked(SIZE_T size, const FString& backingDirectory)
+{
+#if PLATFORM_LINUX
+	const FString directory = FPaths::ConvertRelativePathToFull(backingDirectory);
+	IFileManager::Get().MakeDirectory(*directory, true);
+	const FString path = FPaths::CreateTempFilename(*directory, TEXT("FluidArena"), TEXT(".bin"));
+
+	const int fileHandle = open(TCHAR_TO_UTF8(*path), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fileHandle < 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to create %s, FieldArena/AllocateFileBacked"), *path);
+		return false;
+	}
+
+	//Only the mapping keeps the file alive, so a crashed bake leaves nothing behind
+	unlink(TCHAR_TO_UTF8(*path));
+
+	const SIZE_T pageSize = static_cast<SIZE_T>(sysconf(_SC_PAGESIZE));
+	const SIZE_T mappedSize = Align(size, pageSize);
+	if (ftruncate(fileHandle, mappedSize) != 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to size %s to %llu bytes, FieldArena/AllocateFileBacked"), *path, static_cast<uint64>(mappedSize));
+		close(fileHandle);
+		return false;
+	}
+
+	void* pMapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileHandle, 0);
+	close(fileHandle);
+	if (pMapped == MAP_FAILED)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to map %s, FieldArena/AllocateFileBacked"), *path);
+		return false;
+	}
+
+	m_pMemory = static_cast<uint8*>(pMapped);
+	m_AllocatedBytes = mappedSize;
+	m_bIsMapped = true;
+	m_bIsFileBacked = true;
+	return true;
+#else
+	UE_LOG(LogTemp, Error, TEXT("File backed fields are only supported on Linux, FieldArena/AllocateFileBacked"));
+	return false;
+#endif
+}
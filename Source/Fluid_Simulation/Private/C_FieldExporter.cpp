@@ -0,0 +1,166 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_FieldExporter.h"
+
+#include <atomic>
+
+#if PLATFORM_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+FC_FieldExporter::~FC_FieldExporter()
+{
+	Close();
+}
+
+bool FC_FieldExporter::Open(const FString& name, const FC_FieldSnapshot& layout)
+{
+	Close();
+
+#if PLATFORM_LINUX
+	const int numCells = layout.m_Density.Num();
+	const int dataOffset = Align(static_cast<int>(sizeof(FC_ExportSlotHeader)), 64);
+	const SIZE_T slotStride = Align(dataOffset + static_cast<SIZE_T>(numCells) * NumFields * sizeof(float), 4096);
+	const SIZE_T size = Align(sizeof(FC_ExportHeader), 4096) + slotStride * NumSlots;
+
+	m_Name = FString::Printf(TEXT("/Fluid_%s"), *name);
+	const FTCHARToUTF8 shmName{ *m_Name };
+
+	//Start from a fresh segment, readers still mapping the old one keep their own copy of it
+	shm_unlink(shmName.Get());
+	const int fileHandle = shm_open(shmName.Get(), O_CREAT | O_RDWR, 0644);
+	if (fileHandle < 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to open %s, FieldExporter/Open"), *m_Name);
+		return false;
+	}
+
+	if (ftruncate(fileHandle, size) != 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to size %s, FieldExporter/Open"), *m_Name);
+		close(fileHandle);
+		shm_unlink(shmName.Get());
+		return false;
+	}
+
+	void* pMapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileHandle, 0);
+	close(fileHandle);
+
+	if (pMapped == MAP_FAILED)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to map %s, FieldExporter/Open"), *m_Name);
+		shm_unlink(shmName.Get());
+		return false;
+	}
+
+	m_pMemory = static_cast<uint8*>(pMapped);
+	m_Size = size;
+	m_NextSlot = 0;
+	m_NumSkipped = 0;
+
+	FC_ExportHeader& header = GetHeader();
+	header.m_GridSize = layout.m_GridSize;
+	header.m_RealGridSize = layout.m_RealGridSize;
+	header.m_RealDepth = layout.m_RealDepth;
+	header.m_NumCells = numCells;
+	header.m_NumFields = NumFields;
+	header.m_NumSlots = NumSlots;
+	header.m_DataOffset = dataOffset;
+	header.m_SlotStride = slotStride;
+	header.m_GapSize = layout.m_GapSize;
+	header.m_Origin[0] = layout.m_Origin.X;
+	header.m_Origin[1] = layout.m_Origin.Y;
+	header.m_Origin[2] = layout.m_Origin.Z;
+	header.m_LatestSlot = -1;
+	header.m_Version = FC_ExportHeader::Version;
+
+	//Magic goes last, a reader that sees it can trust the rest of the header
+	std::atomic_thread_fence(std::memory_order_release);
+	header.m_Magic = FC_ExportHeader::Magic;
+
+	return true;
+#else
+	UE_LOG(LogTemp, Error, TEXT("Field export is only supported on Linux, FieldExporter/Open"));
+	return false;
+#endif
+}
+
+void FC_FieldExporter::Close()
+{
+	if (m_ExportTask.IsValid())
+	{
+		m_ExportTask.Wait();
+		m_ExportTask = {};
+	}
+
+#if PLATFORM_LINUX
+	if (m_pMemory)
+	{
+		munmap(m_pMemory, m_Size);
+		shm_unlink(TCHAR_TO_UTF8(*m_Name));
+	}
+#endif
+
+	m_pMemory = nullptr;
+	m_Size = 0;
+}
+
+bool FC_FieldExporter::Publish(const FC_FieldSnapshotPtr& pSnapshot)
+{
+	if (!IsOpen() || !pSnapshot || pSnapshot->m_Density.Num() != GetHeader().m_NumCells)
+	{
+		return false;
+	}
+
+	//Readers are never waited on, and neither is our own previous export
+	if (m_ExportTask.IsValid() && !m_ExportTask.IsCompleted())
+	{
+		++m_NumSkipped;
+		return false;
+	}
+
+	const int slotIdx = m_NextSlot;
+	m_NextSlot = (m_NextSlot + 1) % NumSlots;
+
+	//The task holds the snapshot, so the grid manager won't refill it underneath us
+	m_ExportTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, slotIdx, pSnapshot]()
+	{
+		WriteSlot(slotIdx, *pSnapshot);
+	});
+
+	return true;
+}
+
+FC_ExportSlotHeader& FC_FieldExporter::GetSlot(int slotIdx) const
+{
+	const SIZE_T offset = Align(sizeof(FC_ExportHeader), 4096) + GetHeader().m_SlotStride * slotIdx;
+	return *reinterpret_cast<FC_ExportSlotHeader*>(m_pMemory + offset);
+}
+
+void FC_FieldExporter::WriteSlot(int slotIdx, const FC_FieldSnapshot& snapshot) const
+{
+	FC_ExportHeader& header = GetHeader();
+	FC_ExportSlotHeader& slot = GetSlot(slotIdx);
+	float* pData = reinterpret_cast<float*>(reinterpret_cast<uint8*>(&slot) + header.m_DataOffset);
+
+	//Seqlock, readers that overlap with this write see the odd or changed sequence and retry
+	const uint64 sequence = slot.m_Sequence;
+	slot.m_Sequence = sequence + 1;
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.m_Frame = snapshot.m_Frame;
+
+	const int numCells = header.m_NumCells;
+	const TArray<float>* pFields[NumFields]{ &snapshot.m_Density, &snapshot.m_VelocityX, &snapshot.m_VelocityY, &snapshot.m_VelocityZ };
+	for (int fieldIdx{}; fieldIdx < NumFields; ++fieldIdx)
+	{
+		FMemory::Memcpy(pData + fieldIdx * numCells, pFields[fieldIdx]->GetData(), numCells * sizeof(float));
+	}
+
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.m_Sequence = sequence + 2;
+	header.m_LatestSlot = slotIdx;
+}
@@ -0,0 +1,422 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_FieldReplication.h"
+#include "C_FieldSampler.h"
+#include "C_FluidSolver.h"
+#include "Async/ParallelFor.h"
+#include "Algo/Sort.h"
+
+namespace
+{
+	constexpr uint8 s_FormatVersion{ 1 };
+	constexpr float s_BlendWindows{ 5.f }; //Blend times a brick keeps getting pulled in, by then 99% of the gap is closed
+	constexpr int s_MinBrickBytes{ 4 }; //Index, two versions and one zero run, a packet with less room left is full
+
+	void WriteVarint(TArray<uint8>& outBytes, uint32 value)
+	{
+		while (value >= 0x80)
+		{
+			outBytes.Add(static_cast<uint8>(value | 0x80));
+			value >>= 7;
+		}
+		outBytes.Add(static_cast<uint8>(value));
+	}
+
+	bool ReadVarint(TArrayView<const uint8> bytes, int& inOutPos, uint32& outValue)
+	{
+		uint32 value{};
+		for (int shift{}; shift < 32; shift += 7)
+		{
+			if (inOutPos >= bytes.Num())
+			{
+				return false;
+			}
+
+			const uint8 byte = bytes[inOutPos++];
+			value |= static_cast<uint32>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				outValue = value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WriteFloat(TArray<uint8>& outBytes, float value)
+	{
+		uint32 bits{};
+		FMemory::Memcpy(&bits, &value, sizeof(bits));
+		for (int byteIdx{}; byteIdx < 4; ++byteIdx)
+		{
+			outBytes.Add(static_cast<uint8>(bits >> (byteIdx * 8)));
+		}
+	}
+
+	bool ReadFloat(TArrayView<const uint8> bytes, int& inOutPos, float& outValue)
+	{
+		if (inOutPos + 4 > bytes.Num())
+		{
+			return false;
+		}
+
+		uint32 bits{};
+		for (int byteIdx{}; byteIdx < 4; ++byteIdx)
+		{
+			bits |= static_cast<uint32>(bytes[inOutPos++]) << (byteIdx * 8);
+		}
+		FMemory::Memcpy(&outValue, &bits, sizeof(bits));
+		return true;
+	}
+
+	//Density is unsigned over [0, maxDensity], velocity signed over [-maxVelocity, maxVelocity]
+	FORCEINLINE uint8 QuantizeDensity(float value, float scale)
+	{
+		return static_cast<uint8>(FMath::Clamp(FMath::RoundToInt(value * scale), 0, 255));
+	}
+
+	FORCEINLINE uint8 QuantizeVelocity(float value, float scale)
+	{
+		return static_cast<uint8>(static_cast<int8>(FMath::Clamp(FMath::RoundToInt(value * scale), -127, 127)));
+	}
+
+	FORCEINLINE float Dequantize(uint8 value, int channel, float densityStep, float velocityStep)
+	{
+		return channel == 0 ? value * densityStep : static_cast<int8>(value) * velocityStep;
+	}
+}
+
+void FC_ReplicationBricks::Init(int gridSize, bool bIsPlanar)
+{
+	m_GridSize = FMath::Max(gridSize, 0);
+	m_bIsPlanar = bIsPlanar;
+	m_NumBricksX = FMath::DivideAndRoundUp(m_GridSize, BrickSize);
+	m_NumBricksY = m_NumBricksX;
+	m_NumBricksZ = m_bIsPlanar ? 1 : m_NumBricksX;
+	m_NumChannels = m_bIsPlanar ? 3 : 4;
+}
+
+FVector FC_ReplicationBricks::GetBrickCenter(int brickIdx) const
+{
+	const int brickZ = brickIdx % m_NumBricksZ;
+	const int brickY = brickIdx / m_NumBricksZ % m_NumBricksY;
+	const int brickX = brickIdx / (m_NumBricksZ * m_NumBricksY);
+	const float halfBrick{ BrickSize * 0.5f };
+
+	return FVector{ 1.f + brickX * BrickSize + halfBrick, 1.f + brickY * BrickSize + halfBrick, m_bIsPlanar ? 0.f : 1.f + brickZ * BrickSize + halfBrick };
+}
+
+#pragma region Encoder
+
+void FC_FieldReplicationEncoder::Reset(int gridSize, bool bIsPlanar)
+{
+	m_Bricks.Init(gridSize, bIsPlanar);
+
+	const int numValues = m_Bricks.Num() * m_Bricks.GetBrickValues();
+	m_Current.SetNumZeroed(numValues);
+	m_Sent.SetNumZeroed(numValues);
+	m_BrickStates.Init(FBrickState{}, m_Bricks.Num());
+	m_Candidates.Reset();
+	m_ByteCredit = 0.f;
+}
+
+void FC_FieldReplicationEncoder::Encode(const FC_FieldSnapshot& snapshot, const FC_ReplicationSettings& settings, TArrayView<const FVector> focusPoints, float time, TArray<uint8>& outPacket)
+{
+	outPacket.Reset();
+
+	const bool bIsPlanar = snapshot.m_RealDepth == 1;
+	if (m_Bricks.m_GridSize != snapshot.m_GridSize || m_Bricks.m_bIsPlanar != bIsPlanar)
+	{
+		Reset(snapshot.m_GridSize, bIsPlanar);
+	}
+	if (m_Bricks.Num() == 0)
+	{
+		return;
+	}
+
+	const float maxDensity = FMath::Max(settings.m_MaxDensity, KINDA_SMALL_NUMBER);
+	const float maxVelocity = FMath::Max(settings.m_MaxVelocity, KINDA_SMALL_NUMBER);
+	const float densityScale = 255.f / maxDensity;
+	const float velocityScale = 127.f / maxVelocity;
+	const float keyframeInterval = FMath::Max(settings.m_KeyframeInterval, KINDA_SMALL_NUMBER);
+	const float* pFields[]{ snapshot.m_Density.GetData(), snapshot.m_VelocityX.GetData(), snapshot.m_VelocityY.GetData(), snapshot.m_VelocityZ.GetData() };
+	const int brickCells = m_Bricks.GetBrickCells();
+	const int brickValues = m_Bricks.GetBrickValues();
+
+	//Quantize and score every brick, one that's unchanged and not due for a keyframe isn't a candidate
+	ParallelFor(m_Bricks.Num(), [&](int brickIdx)
+	{
+		uint8* pCurrent = &m_Current[brickIdx * brickValues];
+		const uint8* pSent = &m_Sent[brickIdx * brickValues];
+
+		m_Bricks.ForEachCell(brickIdx, [&](int localIdx, int idx)
+		{
+			pCurrent[localIdx] = QuantizeDensity(pFields[0][idx], densityScale);
+			for (int channel{ 1 }; channel < m_Bricks.m_NumChannels; ++channel)
+			{
+				pCurrent[channel * brickCells + localIdx] = QuantizeVelocity(pFields[channel][idx], velocityScale);
+			}
+		});
+
+		int change{};
+		for (int valueIdx{}; valueIdx < brickCells; ++valueIdx)
+		{
+			change += FMath::Abs(pCurrent[valueIdx] - pSent[valueIdx]);
+		}
+		for (int valueIdx{ brickCells }; valueIdx < brickValues; ++valueIdx)
+		{
+			change += FMath::Abs(static_cast<int8>(pCurrent[valueIdx]) - static_cast<int8>(pSent[valueIdx]));
+		}
+
+		FBrickState& state = m_BrickStates[brickIdx];
+		const float age = state.m_Version == 0 ? keyframeInterval : time - state.m_LastSendTime;
+		if (change == 0 && age < keyframeInterval)
+		{
+			state.m_Priority = 0.f;
+			return;
+		}
+
+		//Closer to a focus point is more important, a brick a few bricks away counts half
+		float focusWeight{ 1.f };
+		if (focusPoints.Num() > 0)
+		{
+			const FVector center = m_Bricks.GetBrickCenter(brickIdx);
+			float closestDistance{ TNumericLimits<float>::Max() };
+			for (const FVector& focusPoint : focusPoints)
+			{
+				closestDistance = FMath::Min(closestDistance, static_cast<float>(FVector::Dist(center, focusPoint)));
+			}
+			focusWeight = 1.f / (1.f + closestDistance / (FC_ReplicationBricks::BrickSize * 4));
+		}
+
+		state.m_Priority = (change + 1.f) * (1.f + age / keyframeInterval) * focusWeight;
+	});
+
+	m_Candidates.Reset();
+	for (int brickIdx{}; brickIdx < m_Bricks.Num(); ++brickIdx)
+	{
+		if (m_BrickStates[brickIdx].m_Priority > 0.f)
+		{
+			m_Candidates.Add(brickIdx);
+		}
+	}
+	Algo::Sort(m_Candidates, [this](int a, int b) { return m_BrickStates[a].m_Priority > m_BrickStates[b].m_Priority; });
+
+	//The ranges travel along, clients dequantize with what the server used, clamped the same so the decoder accepts them
+	outPacket.Add(s_FormatVersion);
+	WriteVarint(outPacket, m_Bricks.m_GridSize);
+	outPacket.Add(m_Bricks.m_bIsPlanar ? 1 : 0);
+	WriteFloat(outPacket, maxDensity);
+	WriteFloat(outPacket, maxVelocity);
+	const int headerBytes = outPacket.Num();
+
+	//Unused bytes carry over to the next packet, and a brick bigger than one packet's share is paid back by the ones after it
+	const float packetBytes = settings.m_BytesPerSecond / FMath::Max(settings.m_SendRate, KINDA_SMALL_NUMBER);
+	m_ByteCredit = FMath::Min(m_ByteCredit + packetBytes, packetBytes * 2.f);
+	const int budget = FMath::FloorToInt(m_ByteCredit);
+	if (budget < headerBytes + s_MinBrickBytes)
+	{
+		outPacket.Reset();
+		return;
+	}
+
+	for (const int brickIdx : m_Candidates)
+	{
+		if (outPacket.Num() + s_MinBrickBytes > budget)
+		{
+			break;
+		}
+
+		FBrickState& state = m_BrickStates[brickIdx];
+		const bool bIsKeyframe = state.m_Version == 0 || time - state.m_LastSendTime >= keyframeInterval;
+		EncodeBrick(brickIdx, bIsKeyframe, m_BrickBytes);
+
+		//A brick that doesn't fit waits for the next packet, smaller ones behind it may still fit
+		if (outPacket.Num() + m_BrickBytes.Num() > budget && outPacket.Num() > headerBytes)
+		{
+			continue;
+		}
+
+		outPacket.Append(m_BrickBytes);
+		FMemory::Memcpy(&m_Sent[brickIdx * brickValues], &m_Current[brickIdx * brickValues], brickValues);
+		state.m_Version = state.m_Version % MAX_uint16 + 1;
+		state.m_LastSendTime = time;
+	}
+
+	//Nothing changed, nothing to send
+	if (outPacket.Num() == headerBytes)
+	{
+		outPacket.Reset();
+	}
+	m_ByteCredit -= outPacket.Num();
+}
+
+void FC_FieldReplicationEncoder::EncodeBrick(int brickIdx, bool bIsKeyframe, TArray<uint8>& outBytes) const
+{
+	const FBrickState& state = m_BrickStates[brickIdx];
+	const int brickValues = m_Bricks.GetBrickValues();
+	const uint8* pCurrent = &m_Current[brickIdx * brickValues];
+	const uint8* pSent = &m_Sent[brickIdx * brickValues];
+
+	//A keyframe is a delta against zeroes with base version 0
+	outBytes.Reset();
+	WriteVarint(outBytes, brickIdx);
+	WriteVarint(outBytes, bIsKeyframe ? 0 : state.m_Version);
+	WriteVarint(outBytes, state.m_Version % MAX_uint16 + 1);
+
+	//Pairs of a zero run and the non-zero delta after it, a trailing run has no delta
+	int zeroRun{};
+	for (int valueIdx{}; valueIdx < brickValues; ++valueIdx)
+	{
+		const uint8 delta = static_cast<uint8>(pCurrent[valueIdx] - (bIsKeyframe ? 0 : pSent[valueIdx]));
+		if (delta == 0)
+		{
+			++zeroRun;
+			continue;
+		}
+
+		WriteVarint(outBytes, zeroRun);
+		outBytes.Add(delta);
+		zeroRun = 0;
+	}
+	if (zeroRun > 0)
+	{
+		WriteVarint(outBytes, zeroRun);
+	}
+}
+
+#pragma endregion
+
+#pragma region Decoder
+
+void FC_FieldReplicationDecoder::Reset(int gridSize, bool bIsPlanar)
+{
+	m_Bricks.Init(gridSize, bIsPlanar);
+	m_Received.SetNumZeroed(m_Bricks.Num() * m_Bricks.GetBrickValues());
+	m_Versions.Init(0, m_Bricks.Num());
+	m_BlendTimes.Init(-1.f, m_Bricks.Num());
+}
+
+bool FC_FieldReplicationDecoder::Decode(TArrayView<const uint8> packet)
+{
+	int pos{};
+	uint32 gridSize{};
+	if (packet.Num() < 1 || packet[pos++] != s_FormatVersion || !ReadVarint(packet, pos, gridSize) || pos >= packet.Num())
+	{
+		return false;
+	}
+
+	const bool bIsPlanar = packet[pos++] != 0;
+	if (static_cast<int>(gridSize) != m_Bricks.m_GridSize || bIsPlanar != m_Bricks.m_bIsPlanar)
+	{
+		return false;
+	}
+
+	//The quantization steps come from these, a zero, negative or non-finite one would turn every cell into garbage
+	float maxDensity{}, maxVelocity{};
+	if (!ReadFloat(packet, pos, maxDensity) || !ReadFloat(packet, pos, maxVelocity)
+		|| !FMath::IsFinite(maxDensity) || !FMath::IsFinite(maxVelocity) || maxDensity <= 0.f || maxVelocity <= 0.f)
+	{
+		return false;
+	}
+	m_MaxDensity = maxDensity;
+	m_MaxVelocity = maxVelocity;
+
+	const int brickValues = m_Bricks.GetBrickValues();
+	while (pos < packet.Num())
+	{
+		uint32 brickIdx{}, baseVersion{}, newVersion{};
+		if (!ReadVarint(packet, pos, brickIdx) || !ReadVarint(packet, pos, baseVersion) || !ReadVarint(packet, pos, newVersion)
+			|| brickIdx >= static_cast<uint32>(m_Bricks.Num()))
+		{
+			return false;
+		}
+
+		//Without the base the deltas still have to be read past, the brick waits for its next keyframe
+		const bool bIsKeyframe = baseVersion == 0;
+		const bool bCanApply = bIsKeyframe || m_Versions[brickIdx] == baseVersion;
+		uint8* pReceived = &m_Received[brickIdx * brickValues];
+		if (bCanApply && bIsKeyframe)
+		{
+			FMemory::Memzero(pReceived, brickValues);
+		}
+
+		int valueIdx{};
+		while (valueIdx < brickValues)
+		{
+			uint32 zeroRun{};
+			if (!ReadVarint(packet, pos, zeroRun) || zeroRun > static_cast<uint32>(brickValues - valueIdx))
+			{
+				return false;
+			}
+
+			valueIdx += zeroRun;
+			if (valueIdx == brickValues)
+			{
+				break;
+			}
+			if (pos >= packet.Num())
+			{
+				return false;
+			}
+
+			const uint8 delta = packet[pos++];
+			if (bCanApply)
+			{
+				pReceived[valueIdx] += delta;
+			}
+			++valueIdx;
+		}
+
+		if (bCanApply)
+		{
+			m_Versions[brickIdx] = static_cast<uint16>(newVersion);
+			m_BlendTimes[brickIdx] = 0.f;
+		}
+	}
+
+	return true;
+}
+
+void FC_FieldReplicationDecoder::Blend(FC_FluidSolver& solver, float dt, float blendTime)
+{
+	if (m_Bricks.Num() == 0)
+	{
+		return;
+	}
+
+	const float alpha = blendTime > 0.f ? 1.f - FMath::Exp(-dt / blendTime) : 1.f;
+	const float blendWindow = blendTime * s_BlendWindows;
+	const float densityStep = m_MaxDensity / 255.f;
+	const float velocityStep = m_MaxVelocity / 127.f;
+	const int brickCells = m_Bricks.GetBrickCells();
+	const int brickValues = m_Bricks.GetBrickValues();
+
+	//Every brick owns its cells, so the bricks can be pulled in in parallel
+	ParallelFor(m_Bricks.Num(), [&](int brickIdx)
+	{
+		float& blendedTime = m_BlendTimes[brickIdx];
+		if (blendedTime < 0.f || blendedTime > blendWindow)
+		{
+			return;
+		}
+		blendedTime += dt;
+
+		const uint8* pReceived = &m_Received[brickIdx * brickValues];
+		m_Bricks.ForEachCell(brickIdx, [&](int localIdx, int idx)
+		{
+			const float density = Dequantize(pReceived[localIdx], 0, densityStep, velocityStep);
+			solver.AddDensity(idx, (density - solver.GetDensity(idx)) * alpha);
+
+			FVector velocity{};
+			for (int channel{ 1 }; channel < m_Bricks.m_NumChannels; ++channel)
+			{
+				velocity[channel - 1] = Dequantize(pReceived[channel * brickCells + localIdx], channel, densityStep, velocityStep);
+			}
+			solver.AddVelocity(idx, (velocity - solver.GetVelocity(idx)) * alpha);
+		});
+	});
+}
+
+#pragma endregion
@@ -0,0 +1,165 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_FieldSampler.h"
+
+namespace
+{
+	FORCEINLINE VectorRegister4Float VectorLerp(const VectorRegister4Float& a, const VectorRegister4Float& b, const VectorRegister4Float& weight)
+	{
+		return VectorMultiplyAdd(VectorSubtract(b, a), weight, a);
+	}
+}
+
+void FC_FieldSampler::SampleGrid(const float* const* ppFields, float* const* ppOutputs, int numFields, int realGridSize, int realDepth,
+	const float* pX, const float* pY, const float* pZ, int count)
+{
+	const int strideX{ realGridSize * realDepth };
+	const int strideY{ realDepth };
+	//On a planar grid both z corners are the same cell and the clamp pins z to it, so the z lerp drops out
+	const bool bIsPlanar = realDepth == 1;
+	const int strideZ{ bIsPlanar ? 0 : 1 };
+
+	const VectorRegister4Float minCoord = VectorSetFloat1(0.5f);
+	const VectorRegister4Float maxCoord = VectorSetFloat1(realGridSize - 1.5f);
+	const VectorRegister4Float minCoordZ = VectorSetFloat1(bIsPlanar ? 0.f : 0.5f);
+	const VectorRegister4Float maxCoordZ = VectorSetFloat1(bIsPlanar ? 0.f : realDepth - 1.5f);
+
+	for (int first{}; first < count; first += 4)
+	{
+		const int lanes{ FMath::Min(4, count - first) };
+
+		//Pad the last group with a valid coordinate so the gathers stay in range
+		alignas(16) float x[4]{ 0.5f, 0.5f, 0.5f, 0.5f };
+		alignas(16) float y[4]{ 0.5f, 0.5f, 0.5f, 0.5f };
+		alignas(16) float z[4]{ 0.5f, 0.5f, 0.5f, 0.5f };
+		for (int lane{}; lane < lanes; ++lane)
+		{
+			x[lane] = pX[first + lane];
+			y[lane] = pY[first + lane];
+			z[lane] = pZ[first + lane];
+		}
+
+		const VectorRegister4Float coordX = VectorMin(VectorMax(VectorLoadAligned(x), minCoord), maxCoord);
+		const VectorRegister4Float coordY = VectorMin(VectorMax(VectorLoadAligned(y), minCoord), maxCoord);
+		const VectorRegister4Float coordZ = VectorMin(VectorMax(VectorLoadAligned(z), minCoordZ), maxCoordZ);
+
+		const VectorRegister4Float floorX = VectorFloor(coordX);
+		const VectorRegister4Float floorY = VectorFloor(coordY);
+		const VectorRegister4Float floorZ = VectorFloor(coordZ);
+
+		const VectorRegister4Float weightX = VectorSubtract(coordX, floorX);
+		const VectorRegister4Float weightY = VectorSubtract(coordY, floorY);
+		const VectorRegister4Float weightZ = VectorSubtract(coordZ, floorZ);
+
+		alignas(16) int i[4], j[4], k[4];
+		VectorIntStoreAligned(VectorFloatToInt(floorX), i);
+		VectorIntStoreAligned(VectorFloatToInt(floorY), j);
+		VectorIntStoreAligned(VectorFloatToInt(floorZ), k);
+
+		int baseIdx[4];
+		for (int lane{}; lane < 4; ++lane)
+		{
+			baseIdx[lane] = i[lane] * strideX + j[lane] * strideY + k[lane];
+		}
+
+		for (int fieldIdx{}; fieldIdx < numFields; ++fieldIdx)
+		{
+			const float* pField = ppFields[fieldIdx];
+
+			//No gathers on every target, so the 8 corners get transposed into registers by hand
+			alignas(16) float corners[8][4];
+			for (int lane{}; lane < 4; ++lane)
+			{
+				const int idx{ baseIdx[lane] };
+				corners[0][lane] = pField[idx];
+				corners[1][lane] = pField[idx + strideZ];
+				corners[2][lane] = pField[idx + strideY];
+				corners[3][lane] = pField[idx + strideY + strideZ];
+				corners[4][lane] = pField[idx + strideX];
+				corners[5][lane] = pField[idx + strideX + strideZ];
+				corners[6][lane] = pField[idx + strideX + strideY];
+				corners[7][lane] = pField[idx + strideX + strideY + strideZ];
+			}
+
+			const VectorRegister4Float c00 = VectorLerp(VectorLoadAligned(corners[0]), VectorLoadAligned(corners[1]), weightZ);
+			const VectorRegister4Float c01 = VectorLerp(VectorLoadAligned(corners[2]), VectorLoadAligned(corners[3]), weightZ);
+			const VectorRegister4Float c10 = VectorLerp(VectorLoadAligned(corners[4]), VectorLoadAligned(corners[5]), weightZ);
+			const VectorRegister4Float c11 = VectorLerp(VectorLoadAligned(corners[6]), VectorLoadAligned(corners[7]), weightZ);
+
+			const VectorRegister4Float c0 = VectorLerp(c00, c01, weightY);
+			const VectorRegister4Float c1 = VectorLerp(c10, c11, weightY);
+
+			alignas(16) float result[4];
+			VectorStoreAligned(VectorLerp(c0, c1, weightX), result);
+
+			float* pOutput = ppOutputs[fieldIdx];
+			for (int lane{}; lane < lanes; ++lane)
+			{
+				pOutput[first + lane] = result[lane];
+			}
+		}
+	}
+}
+
+void FC_FieldSnapshot::Sample(TArrayView<const FVector> positions, TArrayView<FVector> outVelocities, TArrayView<float> outDensities) const
+{
+	const bool wantsVelocity = outVelocities.Num() > 0;
+	const bool wantsDensity = outDensities.Num() > 0;
+	check(!wantsVelocity || outVelocities.Num() == positions.Num());
+	check(!wantsDensity || outDensities.Num() == positions.Num());
+
+	if (m_RealGridSize == 0 || (!wantsVelocity && !wantsDensity))
+	{
+		return;
+	}
+
+	//Positions get converted in small batches so everything stays on the stack
+	constexpr int batchSize{ 256 };
+	float x[batchSize], y[batchSize], z[batchSize];
+	float velocityX[batchSize], velocityY[batchSize], velocityZ[batchSize], density[batchSize];
+
+	const float* pFields[4]{};
+	float* pOutputs[4]{};
+	int numFields{};
+	if (wantsVelocity)
+	{
+		pFields[0] = m_VelocityX.GetData(); pOutputs[0] = velocityX;
+		pFields[1] = m_VelocityY.GetData(); pOutputs[1] = velocityY;
+		pFields[2] = m_VelocityZ.GetData(); pOutputs[2] = velocityZ;
+		numFields = 3;
+	}
+	if (wantsDensity)
+	{
+		pFields[numFields] = m_Density.GetData();
+		pOutputs[numFields] = density;
+		++numFields;
+	}
+
+	for (int first{}; first < positions.Num(); first += batchSize)
+	{
+		const int count{ FMath::Min(batchSize, positions.Num() - first) };
+
+		for (int idx{}; idx < count; ++idx)
+		{
+			const FVector gridPosition = WorldToGrid(positions[first + idx]);
+			x[idx] = gridPosition.X;
+			y[idx] = gridPosition.Y;
+			z[idx] = gridPosition.Z;
+		}
+
+		FC_FieldSampler::SampleGrid(pFields, pOutputs, numFields, m_RealGridSize, m_RealDepth, x, y, z, count);
+
+		for (int idx{}; idx < count; ++idx)
+		{
+			if (wantsVelocity)
+			{
+				outVelocities[first + idx] = FVector{ velocityX[idx], velocityY[idx], velocityZ[idx] };
+			}
+			if (wantsDensity)
+			{
+				outDensities[first + idx] = density[idx];
+			}
+		}
+	}
+}
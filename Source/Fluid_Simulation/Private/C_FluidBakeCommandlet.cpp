@@ -0,0 +1,270 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_FluidBakeCommandlet.h"
+#include "C_FluidSolver.h"
+#include "C_HaloTransport.h"
+#include "C_CompressedField.h"
+#include "C_SolverCrossCheck.h"
+#include "C_TracerParticles.h"
+#include "Misc/CommandLine.h"
+
+namespace
+{
+	//Ghost layers are one slice deep, so a backtrace may not leave the neighbor's first slice
+	constexpr float s_CflTarget{ 0.5f };
+	constexpr int s_MaxSubsteps{ 64 };
+	constexpr int s_ReportSlices{ 64 }; //Slices ReportCompression holds dense at once
+
+	//Size and worst round-trip error of the final density of this rank with the given settings, the solver kept it compressed between steps as well
+	//Goes through the slab a few slices at a time, so no array passes 2^31 cells on a big out-of-core domain,
+	//the chunks are whole blocks along x and compress exactly like the whole slab would
+	void ReportCompression(const FC_FluidSolver& solver, int rank, const FC_CompressionSettings& settings)
+	{
+		constexpr int blockSize{ FC_CompressedField::BlockSize };
+		const int64 sliceSize{ solver.GetSliceSize() };
+		const int sizeX = solver.GetSizeX() + 2;
+		const int chunkSlices = FMath::Max(static_cast<int>(FMath::Min<int64>(s_ReportSlices, MAX_int32 / sliceSize)) / blockSize * blockSize, blockSize);
+
+		TArray<float> density{};
+		TArray<float> decompressed{};
+		SIZE_T compressedBytes{};
+		float maxError{};
+		for (int firstX{}; firstX < sizeX; firstX += chunkSlices)
+		{
+			const int endX = FMath::Min(firstX + chunkSlices, sizeX);
+			solver.CopyDensitySlices(firstX, endX, density);
+
+			FC_CompressedField compressed{};
+			compressed.Init(endX - firstX, solver.GetRealGridSize(), solver.GetRealDepth(), settings);
+			compressed.Compress(density);
+			compressedBytes += compressed.GetCompressedBytes();
+
+			decompressed.SetNumUninitialized(density.Num(), false);
+			compressed.Decompress(decompressed);
+
+			for (int idx{}; idx < density.Num(); ++idx)
+			{
+				maxError = FMath::Max(maxError, FMath::Abs(decompressed[idx] - density[idx]));
+			}
+		}
+
+		const SIZE_T uncompressedBytes = sizeX * sliceSize * sizeof(float);
+		UE_LOG(LogTemp, Display, TEXT("Rank %d density: %llu of %llu bytes compressed (%.2fx), max error %g"), rank,
+			static_cast<uint64>(compressedBytes), static_cast<uint64>(uncompressedBytes),
+			static_cast<double>(uncompressedBytes) / compressedBytes, maxError);
+	}
+
+	int RunRank(const FString& jobName, int rank, int numRanks, float haloTimeout, int gridSize, int numSteps, float dt, float gapSize, const FString& backingDirectory, int outOfCoreSlices, const FC_CompressionSettings* pCompression)
+	{
+		TUniquePtr<FC_SharedMemoryTransport> pTransport{};
+		if (numRanks > 1)
+		{
+			pTransport = FC_SharedMemoryTransport::Create(jobName, rank, numRanks, (gridSize + 2) * (gridSize + 2), haloTimeout);
+			if (!pTransport || pTransport->IsAborted())
+			{
+				return 1;
+			}
+		}
+
+		const int firstGlobalX = 1 + gridSize * rank / numRanks;
+		const int sizeX = gridSize * (rank + 1) / numRanks - gridSize * rank / numRanks;
+
+		FC_FluidSolver solver{};
+		solver.m_BackingDirectory = backingDirectory;
+		solver.m_OutOfCoreSlices = outOfCoreSlices;
+		solver.m_bCompressDensity = pCompression != nullptr;
+		solver.m_DensityCompression = pCompression ? *pCompression : FC_CompressionSettings{};
+		solver.InitDecomposed(gridSize, gapSize, firstGlobalX, sizeX, pTransport.Get());
+		if (!solver.IsInitialized())
+		{
+			//The other ranks would wait on our halos forever
+			if (pTransport)
+			{
+				pTransport->Abort();
+			}
+			return 1;
+		}
+
+		//A cube of density in the middle of the global grid, every rank adds the part it owns
+		const int sourceMin = gridSize / 2 - gridSize / 8;
+		const int sourceMax = gridSize / 2 + gridSize / 8;
+		for (int x{ 1 }; x <= sizeX; ++x)
+		{
+			const int globalX = firstGlobalX + x - 1;
+			if (globalX < sourceMin || globalX > sourceMax)
+			{
+				continue;
+			}
+
+			for (int y{ sourceMin }; y <= sourceMax; ++y)
+			{
+				for (int z{ sourceMin }; z <= sourceMax; ++z)
+				{
+					solver.AddDensity(solver.GetIdx(x, y, z), 1.f);
+				}
+			}
+		}
+
+		for (int stepIdx{}; stepIdx < numSteps; ++stepIdx)
+		{
+			const double startTime = FPlatformTime::Seconds();
+
+			//The max velocity is already global, so every rank picks the same count and the exchanges stay paired
+			const int numSubsteps = solver.GetSubstepCount(dt, s_CflTarget, s_MaxSubsteps);
+			for (int substepIdx{}; substepIdx < numSubsteps; ++substepIdx)
+			{
+				solver.Step(dt / numSubsteps);
+			}
+
+			//Once a rank failed every exchange returns stale data, the step that noticed is thrown away
+			if (pTransport && pTransport->IsAborted())
+			{
+				UE_LOG(LogTemp, Error, TEXT("Rank %d stopped at step %d, another rank failed, FluidBakeCommandlet/RunRank"), rank, stepIdx);
+				return 1;
+			}
+
+			//The stats are already reduced over the ranks
+			const FC_SolverStats& stats = solver.GetStats();
+			if (rank == 0)
+			{
+				UE_LOG(LogTemp, Display, TEXT("Step %d: %d substeps, max velocity %f, total density %f, divergence %g, residual %g, active %s to %s, %.2f ms"), stepIdx, numSubsteps,
+					stats.m_MaxVelocity, stats.m_TotalDensity, stats.m_DivergenceRms, stats.m_PressureResidualRms, *stats.m_ActiveMin.ToString(), *stats.m_ActiveMax.ToString(), (FPlatformTime::Seconds() - startTime) * 1000.0);
+			}
+		}
+
+		if (pCompression)
+		{
+			ReportCompression(solver, rank, *pCompression);
+		}
+
+		return 0;
+	}
+}
+
+UC_FluidBakeCommandlet::UC_FluidBakeCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UC_FluidBakeCommandlet::Main(const FString& params)
+{
+	int numRanks{ 1 };
+	int rank{ -1 };
+	int gridSize{ 64 };
+	int numSteps{ 100 };
+	float dt{ 1.f / 60.f };
+	float gapSize{ 100.f };
+	FString jobName{};
+	float haloTimeout{ 300.f };
+
+	FParse::Value(*params, TEXT("Ranks="), numRanks);
+	FParse::Value(*params, TEXT("Rank="), rank);
+	FParse::Value(*params, TEXT("GridSize="), gridSize);
+	FParse::Value(*params, TEXT("Steps="), numSteps);
+	FParse::Value(*params, TEXT("Dt="), dt);
+	FParse::Value(*params, TEXT("GapSize="), gapSize);
+	FParse::Value(*params, TEXT("HaloTimeout="), haloTimeout);
+
+	//Scratch files for domains that don't fit in memory, every rank maps its own
+	FString backingDirectory{};
+	int outOfCoreSlices{ 8 };
+	FParse::Value(*params, TEXT("OutOfCore="), backingDirectory);
+	FParse::Value(*params, TEXT("OutOfCoreSlices="), outOfCoreSlices);
+
+	FC_CompressionSettings compression{};
+	const bool bReportCompression = FParse::Value(*params, TEXT("CompressBits="), compression.m_BitsPerValue)
+		| FParse::Value(*params, TEXT("CompressTolerance="), compression.m_Tolerance);
+
+	gridSize = FMath::Max(gridSize, 1);
+	numRanks = FMath::Clamp(numRanks, 1, gridSize);
+
+	//Single process, the decomposition has no fast path of its own to check
+	FString crossCheckConfig{};
+	if (FParse::Value(*params, TEXT("CrossCheck="), crossCheckConfig))
+	{
+		FC_CrossCheckSettings settings{};
+		if (!FC_SolverConfig::FromString(crossCheckConfig, settings.m_Config))
+		{
+			UE_LOG(LogTemp, Error, TEXT("CrossCheck wants threads,team,graph,blocked,spectral, not %s, FluidBakeCommandlet/Main"), *crossCheckConfig);
+			return 1;
+		}
+
+		settings.m_GridSize = gridSize;
+		settings.m_GapSize = gapSize;
+		settings.m_NumSteps = numSteps;
+		settings.m_Dt = dt;
+		settings.m_bPlanar = FParse::Param(*params, TEXT("Planar"));
+		settings.m_bUseMacCormack = FParse::Param(*params, TEXT("MacCormack"));
+		settings.m_FieldPrecision = FParse::Param(*params, TEXT("Half")) ? EC_FieldPrecision::Half : EC_FieldPrecision::Float;
+		FParse::Value(*params, TEXT("Tolerance="), settings.m_Tolerance);
+
+		const FC_CrossCheckReport report = FC_SolverCrossCheck::Run(settings);
+		UE_LOG(LogTemp, Display, TEXT("%d^%d [%s]: %s"), gridSize, settings.m_bPlanar ? 2 : 3, *settings.m_Config.ToString(), *report.ToString());
+
+		//The tracers sample the same fields, so they get checked against the direction the solver moves them in
+		const bool bTracersFollowFlow = FC_TracerParticles::CheckFollowsFlow();
+		if (!bTracersFollowFlow)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Tracers moved against a uniform +x velocity, FluidBakeCommandlet/Main"));
+		}
+		return report.m_bPassed && bTracersFollowFlow ? 0 : 1;
+	}
+
+	//A fresh name per launch, a segment left behind by a crashed job must never be joined
+	if (!FParse::Value(*params, TEXT("Job="), jobName))
+	{
+		jobName = FString::Printf(TEXT("%u_%llu"), FPlatformProcess::GetCurrentProcessId(), static_cast<uint64>(FDateTime::UtcNow().GetTicks()));
+	}
+
+	TArray<FProcHandle> children{};
+	if (rank < 0)
+	{
+		rank = 0;
+
+		for (int childRank{ 1 }; childRank < numRanks; ++childRank)
+		{
+			const FString childParams = FString::Printf(TEXT("%s -Ranks=%d -Job=%s -Rank=%d"), FCommandLine::GetOriginal(), numRanks, *jobName, childRank);
+			FProcHandle child = FPlatformProcess::CreateProc(FPlatformProcess::ExecutablePath(), *childParams, false, true, true, nullptr, 0, nullptr, nullptr);
+			if (!child.IsValid())
+			{
+				UE_LOG(LogTemp, Error, TEXT("Failed to launch rank %d, FluidBakeCommandlet/Main"), childRank);
+
+				//The ranks already running would wait for the missing one forever
+				for (FProcHandle& launchedChild : children)
+				{
+					FPlatformProcess::TerminateProc(launchedChild);
+					FPlatformProcess::CloseProc(launchedChild);
+				}
+				return 1;
+			}
+			children.Add(child);
+		}
+	}
+
+	int result = RunRank(jobName, rank, numRanks, haloTimeout, gridSize, numSteps, dt, gapSize, backingDirectory, outOfCoreSlices, bReportCompression ? &compression : nullptr);
+
+	//The children of a failed rank 0 could still be waiting on it or on each other
+	if (result != 0)
+	{
+		for (FProcHandle& child : children)
+		{
+			FPlatformProcess::TerminateProc(child);
+		}
+	}
+
+	for (FProcHandle& child : children)
+	{
+		FPlatformProcess::WaitForProc(child);
+
+		int32 childResult{};
+		FPlatformProcess::GetProcReturnCode(child, &childResult);
+		result = FMath::Max(result, static_cast<int>(childResult));
+		FPlatformProcess::CloseProc(child);
+	}
+
+	return result;
+}
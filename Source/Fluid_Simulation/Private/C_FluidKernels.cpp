@@ -0,0 +1,971 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_FluidKernels.h"
+#include "Math/Float16.h"
+
+namespace
+{
+	//Grid dimensions as compile-time constants, the runtime-size fallback is the 0 specialization below
+	template <int GridSize>
+	struct TGridDims
+	{
+		explicit TGridDims(int) {}
+
+		static constexpr int GetGridSize() { return GridSize; }
+		static constexpr int GetRealGridSize() { return GridSize + 2; }
+		static constexpr int GetStrideX() { return (GridSize + 2) * (GridSize + 2); }
+		static constexpr int GetStrideY() { return GridSize + 2; }
+	};
+
+	template <>
+	struct TGridDims<0>
+	{
+		explicit TGridDims(int gridSize) : m_GridSize{ gridSize } {}
+
+		int GetGridSize() const { return m_GridSize; }
+		int GetRealGridSize() const { return m_GridSize + 2; }
+		int GetStrideX() const { return (m_GridSize + 2) * (m_GridSize + 2); }
+		int GetStrideY() const { return m_GridSize + 2; }
+
+		int m_GridSize;
+	};
+
+	template <typename TDims>
+	FORCEINLINE int64 GetIdx(const TDims& dims, int x, int y, int z)
+	{
+		//A slice always fits an int, a whole domain doesn't
+		return static_cast<int64>(x) * dims.GetStrideX() + y * dims.GetStrideY() + z;
+	}
+
+	FORCEINLINE float AdVectIfChecks(int size, float value)
+	{
+		if (value < 0.5f) value = 0.5f;
+		if (value > size + 0.5f) value = size + 0.5f;
+
+		return value;
+	}
+
+	template <typename TDims, typename TCell>
+	FORCEINLINE float Interpolate(const TDims& dims, const TCell* pField, int64 idx, float s1, float t1, float u1)
+	{
+		const float s = 1.f - s1;
+		const float t = 1.f - t1;
+		const float u = 1.f - u1;
+
+		const int strideX = dims.GetStrideX();
+		const int strideY = dims.GetStrideY();
+
+		const float calc1 = s * (t * (u * pField[idx]
+										+ u1 * pField[idx + 1])
+								+ t1 * (u * pField[idx + strideY]
+										+ u1 * pField[idx + strideY + 1]));
+		const float calc2 = s1 * (t * (u * pField[idx + strideX]
+										+ u1 * pField[idx + strideX + 1])
+								+ t1 * (u * pField[idx + strideX + strideY]
+										+ u1 * pField[idx + strideX + strideY + 1]));
+
+		return calc1 + calc2;
+	}
+
+	//Smallest and largest of the cells Interpolate blends at idx, the MacCormack limiter keeps its result between them
+	template <typename TDims, typename TCell>
+	FORCEINLINE void SampleRange(const TDims& dims, const TCell* pField, int64 idx, float& outMin, float& outMax)
+	{
+		const int strideX = dims.GetStrideX();
+		const int strideY = dims.GetStrideY();
+		const int offsets[]{ 1, strideY, strideY + 1, strideX, strideX + 1, strideX + strideY, strideX + strideY + 1 };
+
+		outMin = pField[idx];
+		outMax = outMin;
+		for (const int offset : offsets)
+		{
+			const float value = pField[idx + offset];
+			outMin = FMath::Min(outMin, value);
+			outMax = FMath::Max(outMax, value);
+		}
+	}
+
+	//Rows of cells to floats and back, half cells go four at a time through the F16C instructions where the target has them
+	constexpr int s_ConvertWidth{ 4 };
+	constexpr int s_ChunkCells{ 256 }; //Cells per conversion for the passes that don't walk rows
+
+	FORCEINLINE void LoadRow(const float* pCells, float* pOut, int64 count)
+	{
+		FMemory::Memcpy(pOut, pCells, count * sizeof(float));
+	}
+
+	FORCEINLINE void LoadRow(const FFloat16* pCells, float* pOut, int64 count)
+	{
+		const uint16* pEncoded = reinterpret_cast<const uint16*>(pCells);
+		int64 i{};
+		for (; i + s_ConvertWidth <= count; i += s_ConvertWidth)
+		{
+			FPlatformMath::VectorLoadHalf(pOut + i, pEncoded + i);
+		}
+		for (; i < count; ++i)
+		{
+			pOut[i] = pCells[i];
+		}
+	}
+
+	FORCEINLINE void StoreRow(const float* pRow, FFloat16* pCells, int64 count)
+	{
+		uint16* pEncoded = reinterpret_cast<uint16*>(pCells);
+		int64 i{};
+		for (; i + s_ConvertWidth <= count; i += s_ConvertWidth)
+		{
+			FPlatformMath::VectorStoreHalf(pEncoded + i, pRow + i);
+		}
+		for (; i < count; ++i)
+		{
+			pCells[i] = pRow[i];
+		}
+	}
+
+	//Scratch rows the stencils below read and write as plain floats, so every cell converts once per row instead of once per read
+	//Float cells are used in place and cost nothing, half cells are loaded into a buffer and stored back from it
+	template <typename TCell>
+	class TCellRows;
+
+	template <>
+	class TCellRows<float> final
+	{
+	public:
+		TCellRows(int, int) {}
+
+		FORCEINLINE float* Load(int, float* pCells, int) { return pCells; }
+		FORCEINLINE const float* Load(int, const float* pCells, int) { return pCells; }
+		FORCEINLINE void Store(int, float*, int) {}
+	};
+
+	template <>
+	class TCellRows<FFloat16> final
+	{
+	public:
+		TCellRows(int numRows, int rowSize) : m_RowSize{ rowSize }
+		{
+			m_Buffer.SetNumUninitialized(numRows * rowSize);
+		}
+
+		FORCEINLINE float* Load(int rowIdx, const FFloat16* pCells, int count)
+		{
+			float* pRow = &m_Buffer[rowIdx * m_RowSize];
+			LoadRow(pCells, pRow, count);
+			return pRow;
+		}
+
+		FORCEINLINE void Store(int rowIdx, FFloat16* pCells, int count)
+		{
+			StoreRow(&m_Buffer[rowIdx * m_RowSize], pCells, count);
+		}
+
+	private:
+		int m_RowSize;
+		TArray<float, TInlineAllocator<6 * (128 + 2)>> m_Buffer{}; //Enough for every specialized grid size
+	};
+
+	template <int GridSize, typename TCell>
+	void LinearSolve(int gridSize, void* pFieldCells, const void* pPrevFieldCells, float a, int firstX, int endX)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+		TCell* pField = static_cast<TCell*>(pFieldCells);
+		const TCell* pPrevField = static_cast<const TCell*>(pPrevFieldCells);
+		const int strideX = dims.GetStrideX();
+		const int strideY = dims.GetStrideY();
+		const int rowSize = dims.GetRealGridSize();
+		const float divisor = 1 + 6 * a;
+		TCellRows<TCell> rows{ 6, rowSize };
+
+		for (int x{ firstX }; x < endX; ++x)
+		{
+			for (int y{ 1 }; y <= dims.GetGridSize(); ++y)
+			{
+				//The row itself is swept in place, so z - 1 is already this iteration's value like in the cells
+				const int64 rowIdx{ GetIdx(dims, x, y, 0) };
+				float* pRow = rows.Load(0, pField + rowIdx, rowSize);
+				const float* pPrevRow = rows.Load(1, pPrevField + rowIdx, rowSize);
+				const float* pBackRow = rows.Load(2, pField + rowIdx - strideX, rowSize);
+				const float* pFrontRow = rows.Load(3, pField + rowIdx + strideX, rowSize);
+				const float* pDownRow = rows.Load(4, pField + rowIdx - strideY, rowSize);
+				const float* pUpRow = rows.Load(5, pField + rowIdx + strideY, rowSize);
+
+				for (int z{ 1 }; z <= dims.GetGridSize(); ++z)
+				{
+					const float totalNeighbors = pBackRow[z] + pFrontRow[z]
+						+ pDownRow[z] + pUpRow[z]
+						+ pRow[z - 1] + pRow[z + 1];
+
+					pRow[z] = (pPrevRow[z] + totalNeighbors * a) / divisor;
+				}
+
+				rows.Store(0, pField + rowIdx, rowSize);
+			}
+		}
+	}
+
+	template <int GridSize>
+	void PressureSolve(int gridSize, float* pPressure, const float* pDivergence, int firstX, int endX)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+		const int strideX = dims.GetStrideX();
+		const int strideY = dims.GetStrideY();
+
+		for (int x{ firstX }; x < endX; ++x)
+		{
+			for (int y{ 1 }; y <= dims.GetGridSize(); ++y)
+			{
+				for (int z{ 1 }; z <= dims.GetGridSize(); ++z)
+				{
+					const int64 idx{ GetIdx(dims, x, y, z) };
+
+					float totalPressure = pDivergence[idx];
+					//Add neighbor pressures
+					totalPressure += pPressure[idx + strideX] + pPressure[idx - strideX];
+					totalPressure += pPressure[idx + strideY] + pPressure[idx - strideY];
+					totalPressure += pPressure[idx + 1] + pPressure[idx - 1];
+
+					pPressure[idx] = totalPressure / 6.f;
+				}
+			}
+		}
+	}
+
+	//Face bounds that only depend on the interior of plane x, see SetBoundsFaces
+	template <typename TDims, typename TCell>
+	void SetBoundsPlane(const TDims& dims, TCell* pField, int x, int reflectAxis, int sizeX)
+	{
+		const int last = dims.GetGridSize();
+
+		const float signX = reflectAxis == 0 ? -1.f : 1.f;
+		const float signY = reflectAxis == 1 ? -1.f : 1.f;
+		const float signZ = reflectAxis == 2 ? -1.f : 1.f;
+
+		for (int b{ 1 }; b <= last; ++b)
+		{
+			pField[GetIdx(dims, x, b, 0)] = signZ * pField[GetIdx(dims, x, b, 1)];
+			pField[GetIdx(dims, x, b, last + 1)] = signZ * pField[GetIdx(dims, x, b, last)];
+
+			pField[GetIdx(dims, x, 0, b)] = signY * pField[GetIdx(dims, x, 1, b)];
+			pField[GetIdx(dims, x, last + 1, b)] = signY * pField[GetIdx(dims, x, last, b)];
+		}
+
+		if (x == 1 || x == sizeX)
+		{
+			const int faceX = x == 1 ? 0 : sizeX + 1;
+			for (int a{ 1 }; a <= last; ++a)
+			{
+				for (int b{ 1 }; b <= last; ++b)
+				{
+					pField[GetIdx(dims, faceX, a, b)] = signX * pField[GetIdx(dims, x, a, b)];
+				}
+			}
+		}
+	}
+
+	//Skewed wavefront along x, at every step iteration i sweeps the plane right behind iteration i - 1
+	//A plane only reads its x neighbors, so iteration i at x sees x - 1 of its own iteration and x + 1 of the one before,
+	//exactly like running the iterations one after the other, while only numIterations + 2 planes are live in cache
+	template <typename TDims, typename TCell, typename TSweepPlane>
+	void SweepBlocked(const TDims& dims, TCell* pField, int reflectAxis, int sizeX, int numIterations, TSweepPlane sweepPlane)
+	{
+		for (int step{}; step < sizeX + numIterations - 1; ++step)
+		{
+			for (int iter{}; iter < numIterations; ++iter)
+			{
+				const int x = 1 + step - iter;
+				if (x < 1 || x > sizeX)
+				{
+					continue;
+				}
+
+				sweepPlane(x);
+				SetBoundsPlane(dims, pField, x, reflectAxis, sizeX);
+			}
+		}
+	}
+
+	template <int GridSize, typename TCell>
+	void LinearSolveBlocked(int gridSize, void* pFieldCells, const void* pPrevFieldCells, float a, int reflectAxis, int sizeX, int numIterations)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+
+		SweepBlocked(dims, static_cast<TCell*>(pFieldCells), reflectAxis, sizeX, numIterations, [=](int x)
+		{
+			LinearSolve<GridSize, TCell>(gridSize, pFieldCells, pPrevFieldCells, a, x, x + 1);
+		});
+	}
+
+	template <int GridSize>
+	void PressureSolveBlocked(int gridSize, float* pPressure, const float* pDivergence, int sizeX, int numIterations)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+
+		SweepBlocked(dims, pPressure, -1, sizeX, numIterations, [=](int x)
+		{
+			PressureSolve<GridSize>(gridSize, pPressure, pDivergence, x, x + 1);
+		});
+	}
+
+	template <int GridSize, typename TCell>
+	void LinearSolvePlanes(int gridSize, void* pFieldCells, const void* pPrevFieldCells, float a, int reflectAxis, int sizeX, int firstX, int endX)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+
+		for (int x{ firstX }; x < endX; ++x)
+		{
+			LinearSolve<GridSize, TCell>(gridSize, pFieldCells, pPrevFieldCells, a, x, x + 1);
+			SetBoundsPlane(dims, static_cast<TCell*>(pFieldCells), x, reflectAxis, sizeX);
+		}
+	}
+
+	template <int GridSize>
+	void PressureSolvePlanes(int gridSize, float* pPressure, const float* pDivergence, int sizeX, int firstX, int endX)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+
+		for (int x{ firstX }; x < endX; ++x)
+		{
+			PressureSolve<GridSize>(gridSize, pPressure, pDivergence, x, x + 1);
+			SetBoundsPlane(dims, pPressure, x, -1, sizeX);
+		}
+	}
+
+	template <int GridSize, typename TCell>
+	void AdVect(int gridSize, void* pFieldCells, const void* pPrevFieldCells, const void* pVelocityXCells, const void* pVelocityYCells, const void* pVelocityZCells, float dt0, int sizeX, int firstX, int endX, FC_SweepStats* pStats)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+		TCell* pField = static_cast<TCell*>(pFieldCells);
+		const TCell* pPrevField = static_cast<const TCell*>(pPrevFieldCells);
+		const TCell* pVelocityX = static_cast<const TCell*>(pVelocityXCells);
+		const TCell* pVelocityY = static_cast<const TCell*>(pVelocityYCells);
+		const TCell* pVelocityZ = static_cast<const TCell*>(pVelocityZCells);
+		const bool bWithStats{ pStats != nullptr };
+		const float activeThreshold{ bWithStats ? pStats->m_ActiveThreshold : 0.f };
+		FC_SweepStats stats{};
+
+		for (int idxX{ firstX }; idxX < endX; ++idxX)
+		{
+			for (int idxY{ 1 }; idxY <= dims.GetGridSize(); ++idxY)
+			{
+				for (int idxZ{ 1 }; idxZ <= dims.GetGridSize(); ++idxZ)
+				{
+					const int64 idx{ GetIdx(dims, idxX, idxY, idxZ) };
+
+					const float x = AdVectIfChecks(sizeX, idxX - pVelocityX[idx] * dt0);
+					const float y = AdVectIfChecks(dims.GetGridSize(), idxY - pVelocityY[idx] * dt0);
+					const float z = AdVectIfChecks(dims.GetGridSize(), idxZ - pVelocityZ[idx] * dt0);
+
+					const int i = static_cast<int>(x);
+					const int j = static_cast<int>(y);
+					const int k = static_cast<int>(z);
+
+					const float value = Interpolate(dims, pPrevField, GetIdx(dims, i, j, k), x - i, y - j, z - k);
+					pField[idx] = value;
+
+					if (bWithStats)
+					{
+						stats.m_TotalDensity += value;
+						if (value > activeThreshold)
+							stats.AddActiveCell(idxX, idxY, idxZ);
+					}
+				}
+			}
+		}
+
+		if (bWithStats)
+			pStats->Merge(stats);
+	}
+
+	template <int GridSize, typename TCell>
+	void AdVectVelocities(int gridSize, void* pVelocityXCells, void* pVelocityYCells, void* pVelocityZCells, const void* pPrevVelocityXCells, const void* pPrevVelocityYCells, const void* pPrevVelocityZCells, float dt0, int sizeX, int firstX, int endX)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+		TCell* pVelocityX = static_cast<TCell*>(pVelocityXCells);
+		TCell* pVelocityY = static_cast<TCell*>(pVelocityYCells);
+		TCell* pVelocityZ = static_cast<TCell*>(pVelocityZCells);
+		const TCell* pPrevVelocityX = static_cast<const TCell*>(pPrevVelocityXCells);
+		const TCell* pPrevVelocityY = static_cast<const TCell*>(pPrevVelocityYCells);
+		const TCell* pPrevVelocityZ = static_cast<const TCell*>(pPrevVelocityZCells);
+
+		for (int idxX{ firstX }; idxX < endX; ++idxX)
+		{
+			for (int idxY{ 1 }; idxY <= dims.GetGridSize(); ++idxY)
+			{
+				for (int idxZ{ 1 }; idxZ <= dims.GetGridSize(); ++idxZ)
+				{
+					const int64 idx{ GetIdx(dims, idxX, idxY, idxZ) };
+
+					const float x = AdVectIfChecks(sizeX, idxX - pPrevVelocityX[idx] * dt0);
+					const float y = AdVectIfChecks(dims.GetGridSize(), idxY - pPrevVelocityY[idx] * dt0);
+					const float z = AdVectIfChecks(dims.GetGridSize(), idxZ - pPrevVelocityZ[idx] * dt0);
+
+					const int i = static_cast<int>(x);
+					const int j = static_cast<int>(y);
+					const int k = static_cast<int>(z);
+					const int64 sampleIdx{ GetIdx(dims, i, j, k) };
+
+					pVelocityX[idx] = Interpolate(dims, pPrevVelocityX, sampleIdx, x - i, y - j, z - k);
+					pVelocityY[idx] = Interpolate(dims, pPrevVelocityY, sampleIdx, x - i, y - j, z - k);
+					pVelocityZ[idx] = Interpolate(dims, pPrevVelocityZ, sampleIdx, x - i, y - j, z - k);
+				}
+			}
+		}
+	}
+
+	template <int GridSize, typename TCell>
+	void MacCormack(int gridSize, void* pFieldCells, const void* pForwardFieldCells, const void* pPrevFieldCells, const void* pVelocityXCells, const void* pVelocityYCells, const void* pVelocityZCells, float dt0, int sizeX, int firstX, int endX, FC_SweepStats* pStats)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+		TCell* pField = static_cast<TCell*>(pFieldCells);
+		const TCell* pForwardField = static_cast<const TCell*>(pForwardFieldCells);
+		const TCell* pPrevField = static_cast<const TCell*>(pPrevFieldCells);
+		const TCell* pVelocityX = static_cast<const TCell*>(pVelocityXCells);
+		const TCell* pVelocityY = static_cast<const TCell*>(pVelocityYCells);
+		const TCell* pVelocityZ = static_cast<const TCell*>(pVelocityZCells);
+		const bool bWithStats{ pStats != nullptr };
+		const float activeThreshold{ bWithStats ? pStats->m_ActiveThreshold : 0.f };
+		FC_SweepStats stats{};
+
+		for (int idxX{ firstX }; idxX < endX; ++idxX)
+		{
+			for (int idxY{ 1 }; idxY <= dims.GetGridSize(); ++idxY)
+			{
+				for (int idxZ{ 1 }; idxZ <= dims.GetGridSize(); ++idxZ)
+				{
+					const int64 idx{ GetIdx(dims, idxX, idxY, idxZ) };
+					const float moveX = pVelocityX[idx] * dt0;
+					const float moveY = pVelocityY[idx] * dt0;
+					const float moveZ = pVelocityZ[idx] * dt0;
+
+					//Same backtrace as the forward pass, its cells bound the result
+					const float x = AdVectIfChecks(sizeX, idxX - moveX);
+					const float y = AdVectIfChecks(dims.GetGridSize(), idxY - moveY);
+					const float z = AdVectIfChecks(dims.GetGridSize(), idxZ - moveZ);
+					float minValue{}, maxValue{};
+					SampleRange(dims, pPrevField, GetIdx(dims, static_cast<int>(x), static_cast<int>(y), static_cast<int>(z)), minValue, maxValue);
+
+					//Advecting the forward result back along the reversed velocity shows the error the forward pass made, half of it gets taken out
+					//The round trip stays a scalar blend instead of going through FC_FieldSampler::SampleGrid a row at a time, the sampler
+					//reads the eight corners one lane at a time as well and then transposes them, so batched the pass ran 30-50% slower at 128^3
+					const float forwardX = AdVectIfChecks(sizeX, idxX + moveX);
+					const float forwardY = AdVectIfChecks(dims.GetGridSize(), idxY + moveY);
+					const float forwardZ = AdVectIfChecks(dims.GetGridSize(), idxZ + moveZ);
+
+					const int i = static_cast<int>(forwardX);
+					const int j = static_cast<int>(forwardY);
+					const int k = static_cast<int>(forwardZ);
+
+					const float roundTrip = Interpolate(dims, pForwardField, GetIdx(dims, i, j, k), forwardX - i, forwardY - j, forwardZ - k);
+					const float corrected = float(pForwardField[idx]) + 0.5f * (float(pPrevField[idx]) - roundTrip);
+					const float value = FMath::Clamp(corrected, minValue, maxValue);
+					pField[idx] = value;
+
+					if (bWithStats)
+					{
+						stats.m_TotalDensity += value;
+						if (value > activeThreshold)
+							stats.AddActiveCell(idxX, idxY, idxZ);
+					}
+				}
+			}
+		}
+
+		if (bWithStats)
+			pStats->Merge(stats);
+	}
+
+	template <int GridSize, typename TCell>
+	void Divergence(int gridSize, float* pDivergence, const void* pVelocityXCells, const void* pVelocityYCells, const void* pVelocityZCells, float h, int firstX, int endX, FC_SweepStats* pStats)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+		const TCell* pVelocityX = static_cast<const TCell*>(pVelocityXCells);
+		const TCell* pVelocityY = static_cast<const TCell*>(pVelocityYCells);
+		const TCell* pVelocityZ = static_cast<const TCell*>(pVelocityZCells);
+		const int strideX = dims.GetStrideX();
+		const int strideY = dims.GetStrideY();
+		const int rowSize = dims.GetRealGridSize();
+		double divergenceSquares{};
+		TCellRows<TCell> rows{ 5, rowSize };
+
+		for (int x{ firstX }; x < endX; ++x)
+		{
+			float rowSquares{};
+			for (int y{ 1 }; y <= dims.GetGridSize(); ++y)
+			{
+				const int64 rowIdx{ GetIdx(dims, x, y, 0) };
+				const float* pFrontRowX = rows.Load(0, pVelocityX + rowIdx + strideX, rowSize);
+				const float* pBackRowX = rows.Load(1, pVelocityX + rowIdx - strideX, rowSize);
+				const float* pUpRowY = rows.Load(2, pVelocityY + rowIdx + strideY, rowSize);
+				const float* pDownRowY = rows.Load(3, pVelocityY + rowIdx - strideY, rowSize);
+				const float* pRowZ = rows.Load(4, pVelocityZ + rowIdx, rowSize);
+				float* pDivergenceRow = pDivergence + rowIdx;
+
+				for (int z{ 1 }; z <= dims.GetGridSize(); ++z)
+				{
+					const float equationVelX = pFrontRowX[z] - pBackRowX[z];
+					const float equationVelY = pUpRowY[z] - pDownRowY[z];
+					const float equationVelZ = pRowZ[z + 1] - pRowZ[z - 1];
+
+					const float divergence = (equationVelX + equationVelY + equationVelZ) * -0.5f * h;
+					pDivergenceRow[z] = divergence;
+					rowSquares += divergence * divergence;
+				}
+			}
+			divergenceSquares += rowSquares;
+		}
+
+		if (pStats)
+			pStats->m_DivergenceSquares += divergenceSquares;
+	}
+
+	template <int GridSize, typename TCell>
+	void ProjectVelocities(int gridSize, void* pVelocityXCells, void* pVelocityYCells, void* pVelocityZCells, const float* pPressure, const float* pDivergence, float scale, int firstX, int endX, FC_SweepStats* pStats)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+		TCell* pVelocityX = static_cast<TCell*>(pVelocityXCells);
+		TCell* pVelocityY = static_cast<TCell*>(pVelocityYCells);
+		TCell* pVelocityZ = static_cast<TCell*>(pVelocityZCells);
+		const int strideX = dims.GetStrideX();
+		const int strideY = dims.GetStrideY();
+		const int rowSize = dims.GetRealGridSize();
+		double residualSquares{};
+		TCellRows<TCell> rows{ 3, rowSize };
+
+		for (int x{ firstX }; x < endX; ++x)
+		{
+			float rowSquares{};
+			for (int y{ 1 }; y <= dims.GetGridSize(); ++y)
+			{
+				const int64 rowIdx{ GetIdx(dims, x, y, 0) };
+				float* pRowX = rows.Load(0, pVelocityX + rowIdx, rowSize);
+				float* pRowY = rows.Load(1, pVelocityY + rowIdx, rowSize);
+				float* pRowZ = rows.Load(2, pVelocityZ + rowIdx, rowSize);
+				const float* pPressureRow = pPressure + rowIdx;
+
+				for (int z{ 1 }; z <= dims.GetGridSize(); ++z)
+				{
+					pRowX[z] = pRowX[z] - (pPressureRow[z + strideX] - pPressureRow[z - strideX]) * scale;
+					pRowY[z] = pRowY[z] - (pPressureRow[z + strideY] - pPressureRow[z - strideY]) * scale;
+					pRowZ[z] = pRowZ[z] - (pPressureRow[z + 1] - pPressureRow[z - 1]) * scale;
+				}
+
+				rows.Store(0, pVelocityX + rowIdx, rowSize);
+				rows.Store(1, pVelocityY + rowIdx, rowSize);
+				rows.Store(2, pVelocityZ + rowIdx, rowSize);
+
+				//Same pressure rows the gradient just read, still in cache
+				if (pStats)
+				{
+					const float* pDivergenceRow = pDivergence + rowIdx;
+					for (int z{ 1 }; z <= dims.GetGridSize(); ++z)
+					{
+						const float totalNeighbors = pPressureRow[z + strideX] + pPressureRow[z - strideX]
+							+ pPressureRow[z + strideY] + pPressureRow[z - strideY]
+							+ pPressureRow[z + 1] + pPressureRow[z - 1];
+
+						const float residual = pDivergenceRow[z] + totalNeighbors - 6.f * pPressureRow[z];
+						rowSquares += residual * residual;
+					}
+				}
+			}
+			residualSquares += rowSquares;
+		}
+
+		if (pStats)
+			pStats->m_ResidualSquares += residualSquares;
+	}
+
+	template <int GridSize, typename TCell>
+	void SetBoundsFaces(int gridSize, void* pFieldCells, int reflectAxis, int sizeX)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+		TCell* pField = static_cast<TCell*>(pFieldCells);
+		const int last = dims.GetGridSize();
+
+		const float signX = reflectAxis == 0 ? -1.f : 1.f;
+		const float signY = reflectAxis == 1 ? -1.f : 1.f;
+		const float signZ = reflectAxis == 2 ? -1.f : 1.f;
+
+		for (int a{ 1 }; a <= sizeX; ++a)
+		{
+			for (int b{ 1 }; b <= last; ++b)
+			{
+				//Z-edge
+				pField[GetIdx(dims, a, b, 0)] = signZ * pField[GetIdx(dims, a, b, 1)];
+				pField[GetIdx(dims, a, b, last + 1)] = signZ * pField[GetIdx(dims, a, b, last)];
+
+				//Y-edge
+				pField[GetIdx(dims, a, 0, b)] = signY * pField[GetIdx(dims, a, 1, b)];
+				pField[GetIdx(dims, a, last + 1, b)] = signY * pField[GetIdx(dims, a, last, b)];
+			}
+		}
+
+		for (int a{ 1 }; a <= last; ++a)
+		{
+			for (int b{ 1 }; b <= last; ++b)
+			{
+				//X-edge
+				pField[GetIdx(dims, 0, a, b)] = signX * pField[GetIdx(dims, 1, a, b)];
+				pField[GetIdx(dims, sizeX + 1, a, b)] = signX * pField[GetIdx(dims, sizeX, a, b)];
+			}
+		}
+	}
+
+	template <int GridSize, typename TCell>
+	void SetBoundsPlanes(int gridSize, void* pFieldCells, int reflectAxis, int sizeX, int firstX, int endX)
+	{
+		const TGridDims<GridSize> dims{ gridSize };
+
+		for (int x{ firstX }; x < endX; ++x)
+		{
+			SetBoundsPlane(dims, static_cast<TCell*>(pFieldCells), x, reflectAxis, sizeX);
+		}
+	}
+
+	template <int GridSize, typename TCell>
+	void SetBoundsCorners(int gridSize, void* pFieldCells, int sizeX)
+	{
+		//Every corner is the average of its 3 neighbors along the axes
+		const TGridDims<GridSize> dims{ gridSize };
+		TCell* pField = static_cast<TCell*>(pFieldCells);
+		const int last{ dims.GetRealGridSize() - 1 };
+
+		for (const int x : { 0, sizeX + 1 })
+		{
+			for (const int y : { 0, last })
+			{
+				for (const int z : { 0, last })
+				{
+					const int neighborX = x == 0 ? 1 : sizeX;
+					const int neighborY = y == 0 ? 1 : dims.GetGridSize();
+					const int neighborZ = z == 0 ? 1 : dims.GetGridSize();
+
+					pField[GetIdx(dims, x, y, z)] = (float(pField[GetIdx(dims, neighborX, y, z)]) + pField[GetIdx(dims, x, neighborY, z)] + pField[GetIdx(dims, x, y, neighborZ)]) / 3.f;
+				}
+			}
+		}
+	}
+
+	template <typename TCell>
+	float CopyVelocities(void* pPrevVelocityXCells, void* pPrevVelocityYCells, void* pPrevVelocityZCells, const void* pVelocityXCells, const void* pVelocityYCells, const void* pVelocityZCells, int64 firstIdx, int64 endIdx)
+	{
+		TCell* pPrevVelocityX = static_cast<TCell*>(pPrevVelocityXCells);
+		TCell* pPrevVelocityY = static_cast<TCell*>(pPrevVelocityYCells);
+		TCell* pPrevVelocityZ = static_cast<TCell*>(pPrevVelocityZCells);
+		const TCell* pVelocityX = static_cast<const TCell*>(pVelocityXCells);
+		const TCell* pVelocityY = static_cast<const TCell*>(pVelocityYCells);
+		const TCell* pVelocityZ = static_cast<const TCell*>(pVelocityZCells);
+
+		//The copy is bitwise in either precision, only the maximum needs the cells as floats
+		float maxSquaredVelocity{};
+		TCellRows<TCell> rows{ 3, s_ChunkCells };
+		for (int64 chunkIdx{ firstIdx }; chunkIdx < endIdx; chunkIdx += s_ChunkCells)
+		{
+			const int count = static_cast<int>(FMath::Min<int64>(endIdx - chunkIdx, s_ChunkCells));
+			FMemory::Memcpy(pPrevVelocityX + chunkIdx, pVelocityX + chunkIdx, count * sizeof(TCell));
+			FMemory::Memcpy(pPrevVelocityY + chunkIdx, pVelocityY + chunkIdx, count * sizeof(TCell));
+			FMemory::Memcpy(pPrevVelocityZ + chunkIdx, pVelocityZ + chunkIdx, count * sizeof(TCell));
+
+			const float* pChunkX = rows.Load(0, pVelocityX + chunkIdx, count);
+			const float* pChunkY = rows.Load(1, pVelocityY + chunkIdx, count);
+			const float* pChunkZ = rows.Load(2, pVelocityZ + chunkIdx, count);
+			for (int i{}; i < count; ++i)
+			{
+				maxSquaredVelocity = FMath::Max(maxSquaredVelocity, pChunkX[i] * pChunkX[i] + pChunkY[i] * pChunkY[i] + pChunkZ[i] * pChunkZ[i]);
+			}
+		}
+		return maxSquaredVelocity;
+	}
+
+	template <typename TCell>
+	void ReadCells(const void* pCells, float* pOut, int64 firstIdx, int64 endIdx)
+	{
+		LoadRow(static_cast<const TCell*>(pCells) + firstIdx, pOut + firstIdx, endIdx - firstIdx);
+	}
+
+	template <int GridSize, typename TCell>
+	FC_FluidKernels MakeKernels(EC_FieldPrecision precision)
+	{
+		FC_FluidKernels kernels{};
+		kernels.m_SpecializedGridSize = GridSize;
+		kernels.m_Precision = precision;
+		kernels.m_CellBytes = sizeof(TCell);
+		kernels.LinearSolve = &LinearSolve<GridSize, TCell>;
+		kernels.PressureSolve = &PressureSolve<GridSize>;
+		kernels.LinearSolveBlocked = &LinearSolveBlocked<GridSize, TCell>;
+		kernels.PressureSolveBlocked = &PressureSolveBlocked<GridSize>;
+		kernels.LinearSolvePlanes = &LinearSolvePlanes<GridSize, TCell>;
+		kernels.PressureSolvePlanes = &PressureSolvePlanes<GridSize>;
+		kernels.AdVect = &AdVect<GridSize, TCell>;
+		kernels.AdVectVelocities = &AdVectVelocities<GridSize, TCell>;
+		kernels.MacCormack = &MacCormack<GridSize, TCell>;
+		kernels.Divergence = &Divergence<GridSize, TCell>;
+		kernels.ProjectVelocities = &ProjectVelocities<GridSize, TCell>;
+		kernels.SetBoundsFaces = &SetBoundsFaces<GridSize, TCell>;
+		kernels.SetBoundsPlanes = &SetBoundsPlanes<GridSize, TCell>;
+		kernels.SetBoundsCorners = &SetBoundsCorners<GridSize, TCell>;
+		kernels.CopyVelocities = &CopyVelocities<TCell>;
+		kernels.ReadCells = &ReadCells<TCell>;
+
+		return kernels;
+	}
+}
+
+const FC_FluidKernels& FC_FluidKernels::Get(int gridSize, EC_FieldPrecision precision)
+{
+	//Our standard sizes, everything else runs the runtime-size versions
+	static const FC_FluidKernels s_Kernels32{ MakeKernels<32, float>(EC_FieldPrecision::Float) };
+	static const FC_FluidKernels s_Kernels64{ MakeKernels<64, float>(EC_FieldPrecision::Float) };
+	static const FC_FluidKernels s_Kernels128{ MakeKernels<128, float>(EC_FieldPrecision::Float) };
+	static const FC_FluidKernels s_KernelsRuntime{ MakeKernels<0, float>(EC_FieldPrecision::Float) };
+
+	//Half cells convert a row at a time in the stencil passes, see TCellRows, the backtraces of the advection still convert the cells they sample one by one
+	static const FC_FluidKernels s_HalfKernels32{ MakeKernels<32, FFloat16>(EC_FieldPrecision::Half) };
+	static const FC_FluidKernels s_HalfKernels64{ MakeKernels<64, FFloat16>(EC_FieldPrecision::Half) };
+	static const FC_FluidKernels s_HalfKernels128{ MakeKernels<128, FFloat16>(EC_FieldPrecision::Half) };
+	static const FC_FluidKernels s_HalfKernelsRuntime{ MakeKernels<0, FFloat16>(EC_FieldPrecision::Half) };
+
+	const bool bIsHalf = precision == EC_FieldPrecision::Half;
+	switch (gridSize)
+	{
+	case 32: return bIsHalf ? s_HalfKernels32 : s_Kernels32;
+	case 64: return bIsHalf ? s_HalfKernels64 : s_Kernels64;
+	case 128: return bIsHalf ? s_HalfKernels128 : s_Kernels128;
+	default: return bIsHalf ? s_HalfKernelsRuntime : s_KernelsRuntime;
+	}
+}
+
+namespace
+{
+	FORCEINLINE float InterpolatePlanar(const float* pField, int idx, int strideX, float s1, float t1)
+	{
+		const float s = 1.f - s1;
+		const float t = 1.f - t1;
+
+		return s * (t * pField[idx] + t1 * pField[idx + 1])
+			+ s1 * (t * pField[idx + strideX] + t1 * pField[idx + strideX + 1]);
+	}
+
+	FORCEINLINE void SampleRangePlanar(const float* pField, int idx, int strideX, float& outMin, float& outMax)
+	{
+		outMin = FMath::Min(FMath::Min(pField[idx], pField[idx + 1]), FMath::Min(pField[idx + strideX], pField[idx + strideX + 1]));
+		outMax = FMath::Max(FMath::Max(pField[idx], pField[idx + 1]), FMath::Max(pField[idx + strideX], pField[idx + strideX + 1]));
+	}
+}
+
+void FC_PlanarKernels::LinearSolve(int gridSize, float* pField, const float* pPrevField, float a, int firstX, int endX)
+{
+	const int strideX = gridSize + 2;
+	const float divisor = 1 + 4 * a;
+
+	for (int x{ firstX }; x < endX; ++x)
+	{
+		for (int y{ 1 }; y <= gridSize; ++y)
+		{
+			const int idx{ x * strideX + y };
+			const float totalNeighbors = pField[idx - strideX] + pField[idx + strideX] + pField[idx - 1] + pField[idx + 1];
+
+			pField[idx] = (pPrevField[idx] + totalNeighbors * a) / divisor;
+		}
+	}
+}
+
+void FC_PlanarKernels::PressureSolve(int gridSize, float* pPressure, const float* pDivergence, int firstX, int endX)
+{
+	const int strideX = gridSize + 2;
+
+	for (int x{ firstX }; x < endX; ++x)
+	{
+		for (int y{ 1 }; y <= gridSize; ++y)
+		{
+			const int idx{ x * strideX + y };
+			const float totalPressure = pDivergence[idx] + pPressure[idx + strideX] + pPressure[idx - strideX] + pPressure[idx + 1] + pPressure[idx - 1];
+
+			pPressure[idx] = totalPressure / 4.f;
+		}
+	}
+}
+
+void FC_PlanarKernels::AdVect(int gridSize, float* pField, const float* pPrevField, const float* pVelocityX, const float* pVelocityY, float dt0, int firstX, int endX, FC_SweepStats* pStats)
+{
+	const int strideX = gridSize + 2;
+	const bool bWithStats{ pStats != nullptr };
+	const float activeThreshold{ bWithStats ? pStats->m_ActiveThreshold : 0.f };
+	FC_SweepStats stats{};
+
+	for (int idxX{ firstX }; idxX < endX; ++idxX)
+	{
+		for (int idxY{ 1 }; idxY <= gridSize; ++idxY)
+		{
+			const int idx{ idxX * strideX + idxY };
+
+			const float x = AdVectIfChecks(gridSize, idxX - pVelocityX[idx] * dt0);
+			const float y = AdVectIfChecks(gridSize, idxY - pVelocityY[idx] * dt0);
+
+			const int i = static_cast<int>(x);
+			const int j = static_cast<int>(y);
+
+			const float value = InterpolatePlanar(pPrevField, i * strideX + j, strideX, x - i, y - j);
+			pField[idx] = value;
+
+			if (bWithStats)
+			{
+				stats.m_TotalDensity += value;
+				if (value > activeThreshold)
+					stats.AddActiveCell(idxX, idxY, 0);
+			}
+		}
+	}
+
+	if (bWithStats)
+		pStats->Merge(stats);
+}
+
+void FC_PlanarKernels::AdVectVelocities(int gridSize, float* pVelocityX, float* pVelocityY, const float* pPrevVelocityX, const float* pPrevVelocityY, float dt0, int firstX, int endX)
+{
+	const int strideX = gridSize + 2;
+
+	for (int idxX{ firstX }; idxX < endX; ++idxX)
+	{
+		for (int idxY{ 1 }; idxY <= gridSize; ++idxY)
+		{
+			const int idx{ idxX * strideX + idxY };
+
+			const float x = AdVectIfChecks(gridSize, idxX - pPrevVelocityX[idx] * dt0);
+			const float y = AdVectIfChecks(gridSize, idxY - pPrevVelocityY[idx] * dt0);
+
+			const int i = static_cast<int>(x);
+			const int j = static_cast<int>(y);
+			const int sampleIdx{ i * strideX + j };
+
+			pVelocityX[idx] = InterpolatePlanar(pPrevVelocityX, sampleIdx, strideX, x - i, y - j);
+			pVelocityY[idx] = InterpolatePlanar(pPrevVelocityY, sampleIdx, strideX, x - i, y - j);
+		}
+	}
+}
+
+void FC_PlanarKernels::MacCormack(int gridSize, float* pField, const float* pForwardField, const float* pPrevField, const float* pVelocityX, const float* pVelocityY, float dt0, int firstX, int endX, FC_SweepStats* pStats)
+{
+	const int strideX = gridSize + 2;
+	const bool bWithStats{ pStats != nullptr };
+	const float activeThreshold{ bWithStats ? pStats->m_ActiveThreshold : 0.f };
+	FC_SweepStats stats{};
+
+	for (int idxX{ firstX }; idxX < endX; ++idxX)
+	{
+		for (int idxY{ 1 }; idxY <= gridSize; ++idxY)
+		{
+			const int idx{ idxX * strideX + idxY };
+			const float moveX = pVelocityX[idx] * dt0;
+			const float moveY = pVelocityY[idx] * dt0;
+
+			const float x = AdVectIfChecks(gridSize, idxX - moveX);
+			const float y = AdVectIfChecks(gridSize, idxY - moveY);
+			float minValue{}, maxValue{};
+			SampleRangePlanar(pPrevField, static_cast<int>(x) * strideX + static_cast<int>(y), strideX, minValue, maxValue);
+
+			const float forwardX = AdVectIfChecks(gridSize, idxX + moveX);
+			const float forwardY = AdVectIfChecks(gridSize, idxY + moveY);
+
+			const int i = static_cast<int>(forwardX);
+			const int j = static_cast<int>(forwardY);
+
+			const float roundTrip = InterpolatePlanar(pForwardField, i * strideX + j, strideX, forwardX - i, forwardY - j);
+			const float value = FMath::Clamp(pForwardField[idx] + 0.5f * (pPrevField[idx] - roundTrip), minValue, maxValue);
+			pField[idx] = value;
+
+			if (bWithStats)
+			{
+				stats.m_TotalDensity += value;
+				if (value > activeThreshold)
+					stats.AddActiveCell(idxX, idxY, 0);
+			}
+		}
+	}
+
+	if (bWithStats)
+		pStats->Merge(stats);
+}
+
+void FC_PlanarKernels::Divergence(int gridSize, float* pDivergence, const float* pVelocityX, const float* pVelocityY, float h, int firstX, int endX, FC_SweepStats* pStats)
+{
+	const int strideX = gridSize + 2;
+	double divergenceSquares{};
+
+	for (int x{ firstX }; x < endX; ++x)
+	{
+		for (int y{ 1 }; y <= gridSize; ++y)
+		{
+			const int idx{ x * strideX + y };
+
+			const float equationVelX = pVelocityX[idx + strideX] - pVelocityX[idx - strideX];
+			const float equationVelY = pVelocityY[idx + 1] - pVelocityY[idx - 1];
+
+			const float divergence = (equationVelX + equationVelY) * -0.5f * h;
+			pDivergence[idx] = divergence;
+			divergenceSquares += divergence * divergence;
+		}
+	}
+
+	if (pStats)
+		pStats->m_DivergenceSquares += divergenceSquares;
+}
+
+void FC_PlanarKernels::ProjectVelocities(int gridSize, float* pVelocityX, float* pVelocityY, const float* pPressure, const float* pDivergence, float scale, int firstX, int endX, FC_SweepStats* pStats)
+{
+	const int strideX = gridSize + 2;
+	double residualSquares{};
+
+	for (int x{ firstX }; x < endX; ++x)
+	{
+		for (int y{ 1 }; y <= gridSize; ++y)
+		{
+			const int idx{ x * strideX + y };
+
+			pVelocityX[idx] -= (pPressure[idx + strideX] - pPressure[idx - strideX]) * scale;
+			pVelocityY[idx] -= (pPressure[idx + 1] - pPressure[idx - 1]) * scale;
+
+			if (pStats)
+			{
+				const float residual = pDivergence[idx] + pPressure[idx + strideX] + pPressure[idx - strideX] + pPressure[idx + 1] + pPressure[idx - 1] - 4.f * pPressure[idx];
+				residualSquares += residual * residual;
+			}
+		}
+	}
+
+	if (pStats)
+		pStats->m_ResidualSquares += residualSquares;
+}
+
+void FC_PlanarKernels::SetBounds(int gridSize, float* pField, int reflectAxis)
+{
+	const int strideX = gridSize + 2;
+	const int last = gridSize;
+
+	const float signX = reflectAxis == 0 ? -1.f : 1.f;
+	const float signY = reflectAxis == 1 ? -1.f : 1.f;
+
+	for (int a{ 1 }; a <= last; ++a)
+	{
+		//Y-edge
+		pField[a * strideX] = signY * pField[a * strideX + 1];
+		pField[a * strideX + last + 1] = signY * pField[a * strideX + last];
+
+		//X-edge
+		pField[a] = signX * pField[strideX + a];
+		pField[(last + 1) * strideX + a] = signX * pField[last * strideX + a];
+	}
+
+	//Every corner is the average of its 2 neighbors along the axes
+	for (const int x : { 0, last + 1 })
+	{
+		for (const int y : { 0, last + 1 })
+		{
+			const int neighborX = x == 0 ? 1 : last;
+			const int neighborY = y == 0 ? 1 : last;
+
+			pField[x * strideX + y] = (pField[neighborX * strideX + y] + pField[x * strideX + neighborY]) / 2.f;
+		}
+	}
+}
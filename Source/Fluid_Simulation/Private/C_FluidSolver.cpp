@@ -0,0 +1,1432 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_FluidSolver.h"
+#include "C_FluidKernels.h"
+#include "C_FluidStats.h"
+#include "C_HaloTransport.h"
+#include "Async/ParallelFor.h"
+#include "Math/Float16.h"
+
+namespace
+{
+	constexpr int s_CachedBlocksPerSlab{ 64 }; //Of the compressed density, 128 KiB per slab
+}
+
+void FC_FluidSolver::Init(int gridSize, float gapSize)
+{
+	InitDecomposed(gridSize, gapSize, 1, gridSize, nullptr);
+}
+
+void FC_FluidSolver::InitDecomposed(int gridSize, float gapSize, int firstGlobalX, int sizeX, IC_HaloTransport* pTransport)
+{
+	m_GridSize = FMath::Max(gridSize, 1);
+	m_RealGridSize = m_GridSize + 2; //2 Extra in all directions for boundaries
+	m_SizeX = FMath::Clamp(sizeX, 1, m_GridSize);
+	m_FirstGlobalX = firstGlobalX;
+	m_pTransport = pTransport;
+
+	//The planar kernels have no halo exchange
+	m_bIsPlanar = m_bPlanar && !m_pTransport;
+	if (m_bPlanar && m_pTransport)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Decomposed solvers can't be planar, FluidSolver/InitDecomposed"));
+	}
+	m_GapSize = gapSize;
+	m_MaxVelocity = 0.f;
+
+	//Ghost slices travel as floats, a decomposed solver can't store half cells, neither do the planar kernels
+	EC_FieldPrecision precision = m_bIsPlanar ? EC_FieldPrecision::Float : m_FieldPrecision;
+	if (m_pTransport && precision != EC_FieldPrecision::Float)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Decomposed solvers only store float fields, FluidSolver/InitDecomposed"));
+		precision = EC_FieldPrecision::Float;
+	}
+	m_pKernels = m_bUseReferenceKernels ? &FC_FluidKernels::GetReference() : &FC_FluidKernels::Get(m_GridSize, precision);
+	m_pPressureKernels = m_bUseReferenceKernels ? &FC_FluidKernels::GetReference() : &FC_FluidKernels::Get(m_GridSize, EC_FieldPrecision::Float);
+
+	//One slab per task thread, the arena gets first-touched with the same split the sweeps use
+	const int numThreads = m_NumThreads > 0 ? m_NumThreads : FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+	m_NumSlabs = FMath::Clamp(numThreads, 1, m_SizeX);
+	m_SlabPartials.SetNumZeroed(m_NumSlabs);
+	m_SlabDensityStats.Init(FC_SweepStats{}, m_NumSlabs);
+	m_SlabDivergenceStats.Init(FC_SweepStats{}, m_NumSlabs);
+	m_Stats = FC_SolverStats{};
+
+	const int64 numCells = GetNumCells();
+	m_Arena.Free();
+	void** ppCellFields[]{ &m_pDensity, &m_pPrevDensity, &m_pVelocityX, &m_pVelocityY, &m_pVelocityZ, &m_pPrevVelocityX, &m_pPrevVelocityY, &m_pPrevVelocityZ };
+	for (int fieldIdx{}; fieldIdx < UE_ARRAY_COUNT(ppCellFields); ++fieldIdx)
+	{
+		m_Arena.AddField(numCells, m_pKernels->m_CellBytes);
+	}
+	const int pressureField = m_Arena.AddField(numCells);
+	const int divergenceField = m_Arena.AddField(numCells);
+	const int adVectScratchField = m_bUseMacCormack ? m_Arena.AddField(numCells, m_pKernels->m_CellBytes) : INDEX_NONE;
+
+	if (!m_Arena.Allocate(m_bUseHugePages, m_BackingDirectory))
+	{
+		m_GridSize = 0;
+		m_RealGridSize = 0;
+		m_SizeX = 0;
+		return;
+	}
+
+	for (int fieldIdx{}; fieldIdx < UE_ARRAY_COUNT(ppCellFields); ++fieldIdx)
+	{
+		*ppCellFields[fieldIdx] = m_Arena.GetFieldData(fieldIdx);
+	}
+	m_pPressure = m_Arena.GetField(pressureField);
+	m_pDivergence = m_Arena.GetField(divergenceField);
+	m_pAdVectScratch = adVectScratchField != INDEX_NONE ? m_Arena.GetFieldData(adVectScratchField) : nullptr;
+
+	//The blocks decode to float cells, and a planar grid would fill only one of every eight cells of a block
+	m_CompressedDensity.Reset();
+	m_bIsDensityCompressed = false;
+	if (m_bCompressDensity && m_pKernels->m_Precision == EC_FieldPrecision::Float && !m_bIsPlanar)
+	{
+		m_CompressedDensity.Init(m_SizeX + 2, m_RealGridSize, GetRealDepth(), m_DensityCompression, s_CachedBlocksPerSlab, m_NumSlabs);
+	}
+
+	//The transforms run over whole lines of the global grid, a slab can't use them
+	if (!m_pTransport && !m_bIsPlanar)
+	{
+		m_SpectralPoisson.Init(m_GridSize);
+	}
+	else
+	{
+		m_SpectralPoisson = FC_SpectralPoisson{};
+	}
+
+	//The team takes every slab there is, its members first-touch their own
+	//It keeps its slabs for the whole step, so it can't walk a file backed grid window by window
+	//Its wavefront splits every slab in two halves, so it needs at least two interior slices per slab
+	const bool bUseTeam = m_bUseWorkerTeam && !m_pTransport && !m_bIsPlanar && !m_Arena.IsFileBacked() && m_NumSlabs > 1 && m_SizeX >= 2 * m_NumSlabs;
+	if (!bUseTeam || m_Team.GetNumMembers() != m_NumSlabs)
+	{
+		m_Team.Stop();
+		if (bUseTeam)
+		{
+			m_Team.Start(m_NumSlabs);
+		}
+	}
+
+	if (m_Team.IsRunning())
+	{
+		m_Team.Run([this](int memberIdx)
+		{
+			int firstSlice{}, endSlice{};
+			GetSlabRange(memberIdx, firstSlice, endSlice);
+			m_Arena.TouchSlices(firstSlice, endSlice, GetSliceSize());
+		});
+	}
+	else
+	{
+		m_Arena.FirstTouch(m_NumSlabs, GetSliceSize(), [this](int slabIdx, int& firstSlice, int& endSlice)
+		{
+			GetSlabRange(slabIdx, firstSlice, endSlice);
+		});
+	}
+
+	//Same start as the point vectors used to have, a random velocity in every cell
+	//Seeded per global slice, so every decomposition starts from the same field and the ghost slices match the neighbors
+	const int64 sliceSize{ GetSliceSize() };
+	for (int x{}; x < m_SizeX + 2; ++x)
+	{
+		FRandomStream random{ m_FirstGlobalX - 1 + x };
+
+		for (int64 idx{ x * sliceSize }; idx < (x + 1) * sliceSize; ++idx)
+		{
+			const float randomLength = random.FRandRange(1.f, 3.f);
+			const FVector velocity = random.VRand() * randomLength;
+
+			WriteCell(m_pVelocityX, idx, velocity.X);
+			WriteCell(m_pVelocityY, idx, velocity.Y);
+			if (m_bIsPlanar)
+			{
+				m_MaxVelocity = FMath::Max(m_MaxVelocity, static_cast<float>(velocity.Size2D()));
+				continue;
+			}
+
+			WriteCell(m_pVelocityZ, idx, velocity.Z);
+			m_MaxVelocity = FMath::Max(m_MaxVelocity, randomLength);
+		}
+	}
+
+	if (m_pTransport)
+	{
+		m_MaxVelocity = m_pTransport->AllReduceMax(m_MaxVelocity);
+	}
+
+	BuildStepGraph();
+}
+
+void FC_FluidSolver::Step(float dt)
+{
+	check(IsInitialized());
+	FLUID_SCOPE(Step);
+	INC_DWORD_STAT(STAT_FluidSubsteps);
+
+	DecompressDensity();
+
+	if (m_bIsPlanar)
+	{
+		StepPlanar(dt);
+	}
+	//The spectral solve runs its lines through ParallelFor, which can't nest inside the spinning team
+	else if (m_Team.IsRunning() && !m_bUseSpectralPressure)
+	{
+		m_Team.Run([this, dt](int memberIdx) { StepOnTeam(memberIdx, dt); });
+	}
+	//The graph exchanges no halos, a decomposed solver always runs the stages in order
+	else if (m_bUseTaskGraph && !m_pTransport)
+	{
+		m_StepDt = dt;
+		m_StepGraph.Run();
+	}
+	else
+	{
+		HandleVelocities(dt);
+		HandleDensities(dt);
+	}
+
+	ReduceStats();
+
+	CompressDensity();
+}
+
+int FC_FluidSolver::GetSubstepCount(float dt, float cflTarget, int maxSubsteps) const
+{
+	//Advection moves a cell maxVelocity * dt * m_GridSize cells (see dt0 in the AdVect functions)
+	const float cellsMoved = m_MaxVelocity * dt * m_GridSize;
+	const float neededSubsteps = cellsMoved / FMath::Max(cflTarget, KINDA_SMALL_NUMBER);
+	const int substeps = FMath::CeilToInt(FMath::Min(neededSubsteps, 1000000.f)); //Guard the int conversion on blow-ups
+
+	return FMath::Clamp(substeps, 1, FMath::Max(maxSubsteps, 1));
+}
+
+float FC_FluidSolver::GetDensity(int64 idx) const
+{
+	if (m_bIsDensityCompressed)
+	{
+		int x{}, y{}, z{};
+		GetCellCoords(idx, x, y, z);
+		return m_CompressedDensity.GetValue(x, y, z);
+	}
+	return ReadCell(m_pDensity, idx);
+}
+
+FVector FC_FluidSolver::GetVelocity(int64 idx) const
+{
+	return FVector{ ReadCell(m_pVelocityX, idx), ReadCell(m_pVelocityY, idx), ReadCell(m_pVelocityZ, idx) };
+}
+
+void FC_FluidSolver::CopyDensityField(TArray<float>& outField) const
+{
+	if (m_bIsDensityCompressed)
+	{
+		CopyDensitySlices(0, m_SizeX + 2, outField);
+		return;
+	}
+	CopyField(m_pDensity, outField);
+}
+
+void FC_FluidSolver::CopyDensitySlices(int firstX, int endX, TArray<float>& outSlices) const
+{
+	check(firstX >= 0 && firstX <= endX && endX <= m_SizeX + 2);
+
+	const int64 sliceSize{ GetSliceSize() };
+	const int64 numCells = (endX - firstX) * sliceSize;
+	check(numCells <= MAX_int32);
+	outSlices.SetNumUninitialized(static_cast<int>(numCells), false);
+
+	if (m_bIsDensityCompressed)
+	{
+		FLUID_SCOPE(Compression);
+		m_CompressedDensity.Flush();
+		m_CompressedDensity.DecompressSlices(firstX, endX, outSlices);
+		return;
+	}
+
+	const uint8* pFirstCell = static_cast<const uint8*>(m_pDensity) + firstX * sliceSize * m_pKernels->m_CellBytes;
+	ParallelFor(endX - firstX, [this, pFirstCell, &outSlices, sliceSize](int sliceIdx)
+	{
+		m_pKernels->ReadCells(pFirstCell, outSlices.GetData(), sliceIdx * sliceSize, (sliceIdx + 1) * sliceSize);
+	});
+}
+
+void FC_FluidSolver::CopyVelocityFields(TArray<float>& outFieldX, TArray<float>& outFieldY, TArray<float>& outFieldZ) const
+{
+	CopyField(m_pVelocityX, outFieldX);
+	CopyField(m_pVelocityY, outFieldY);
+	CopyField(m_pVelocityZ, outFieldZ);
+}
+
+void FC_FluidSolver::AddDensity(int64 idx, float amount)
+{
+	if (m_bIsDensityCompressed)
+	{
+		int x{}, y{}, z{};
+		GetCellCoords(idx, x, y, z);
+		m_CompressedDensity.AddValue(x, y, z, amount);
+		return;
+	}
+	WriteCell(m_pDensity, idx, ReadCell(m_pDensity, idx) + amount);
+}
+
+void FC_FluidSolver::AddVelocity(int64 idx, const FVector& amount)
+{
+	WriteCell(m_pVelocityX, idx, ReadCell(m_pVelocityX, idx) + amount.X);
+	WriteCell(m_pVelocityY, idx, ReadCell(m_pVelocityY, idx) + amount.Y);
+	if (!m_bIsPlanar)
+	{
+		WriteCell(m_pVelocityZ, idx, ReadCell(m_pVelocityZ, idx) + amount.Z);
+	}
+}
+
+#pragma region Density
+
+void FC_FluidSolver::HandleDensities(float dt)
+{
+	//Advection reads the previous density, without diffusion that has to be the current one
+	SwapDensities();
+
+	if (!m_bSkipDensityDiffusion)
+	{
+		const float a = dt * m_DiffuseAmount * m_GridSize * m_GridSize;
+		LinearSolveDensities(a);
+
+		SwapDensities();
+	}
+
+	AdVectDensities(dt);
+}
+
+void FC_FluidSolver::LinearSolveDensities(float a)
+{
+	FLUID_SCOPE(Diffuse);
+	CountSweeps(1, m_DiffuseIterations);
+
+	//The windowed wavefront bounds every plane right after its last sweep, only the corners are left
+	if (CanSweepWindows(m_DiffuseIterations))
+	{
+		SweepWindows(m_DiffuseIterations, [this, a](int firstX, int endX)
+		{
+			m_pKernels->LinearSolvePlanes(m_GridSize, m_pDensity, m_pPrevDensity, a, -1, m_SizeX, firstX, endX);
+		});
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pDensity, m_SizeX);
+		return;
+	}
+
+	if (CanBlockSweeps(m_DiffuseIterations))
+	{
+		m_pKernels->LinearSolveBlocked(m_GridSize, m_pDensity, m_pPrevDensity, a, -1, m_SizeX, m_DiffuseIterations);
+		SetBoundsDiffuse();
+		return;
+	}
+
+	for (int iter{}; iter < m_DiffuseIterations; ++iter)
+	{
+		FLUID_TRACE_SCOPE(FluidDiffuseIteration);
+		LinearSolve(m_pDensity, m_pPrevDensity, a);
+		SetBoundsDiffuse();
+	}
+}
+
+void FC_FluidSolver::AdVectDensities(float dt)
+{
+	FLUID_SCOPE(Advect);
+	AdVect(m_pDensity, m_pPrevDensity, dt);
+	SetBoundsDiffuse();
+}
+
+void FC_FluidSolver::SwapDensities()
+{
+	Swap(m_pDensity, m_pPrevDensity);
+}
+
+void FC_FluidSolver::SetBoundsDiffuse()
+{
+	FLUID_SCOPE(SetBounds);
+	SetFieldFaces(*m_pKernels, m_pDensity, -1);
+	m_pKernels->SetBoundsCorners(m_GridSize, m_pDensity, m_SizeX);
+	ExchangeHalos(m_pDensity);
+}
+
+#pragma endregion
+
+#pragma region Velocity
+
+void FC_FluidSolver::HandleVelocities(float dt)
+{
+	SwapVelocities();
+
+	const float a = dt * m_Viscosity * m_GridSize * m_GridSize;
+	LinearSolveVelocities(a);
+
+	Project();
+
+	SwapVelocities();
+
+	AdVectVelocities(dt);
+
+	Project();
+}
+
+void FC_FluidSolver::LinearSolveVelocities(float a)
+{
+	FLUID_SCOPE(Diffuse);
+	CountSweeps(3, m_DiffuseIterations);
+
+	if (CanSweepWindows(m_DiffuseIterations))
+	{
+		SweepWindows(m_DiffuseIterations, [this, a](int firstX, int endX)
+		{
+			m_pKernels->LinearSolvePlanes(m_GridSize, m_pVelocityX, m_pPrevVelocityX, a, 0, m_SizeX, firstX, endX);
+			m_pKernels->LinearSolvePlanes(m_GridSize, m_pVelocityY, m_pPrevVelocityY, a, 1, m_SizeX, firstX, endX);
+			m_pKernels->LinearSolvePlanes(m_GridSize, m_pVelocityZ, m_pPrevVelocityZ, a, 2, m_SizeX, firstX, endX);
+		});
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityX, m_SizeX);
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityY, m_SizeX);
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityZ, m_SizeX);
+		return;
+	}
+
+	if (CanBlockSweeps(m_DiffuseIterations))
+	{
+		m_pKernels->LinearSolveBlocked(m_GridSize, m_pVelocityX, m_pPrevVelocityX, a, 0, m_SizeX, m_DiffuseIterations);
+		m_pKernels->LinearSolveBlocked(m_GridSize, m_pVelocityY, m_pPrevVelocityY, a, 1, m_SizeX, m_DiffuseIterations);
+		m_pKernels->LinearSolveBlocked(m_GridSize, m_pVelocityZ, m_pPrevVelocityZ, a, 2, m_SizeX, m_DiffuseIterations);
+		SetBoundsVelocity();
+		return;
+	}
+
+	for (int iter{}; iter < m_DiffuseIterations; ++iter)
+	{
+		FLUID_TRACE_SCOPE(FluidDiffuseIteration);
+		LinearSolve(m_pVelocityX, m_pPrevVelocityX, a);
+		LinearSolve(m_pVelocityY, m_pPrevVelocityY, a);
+		LinearSolve(m_pVelocityZ, m_pPrevVelocityZ, a);
+		SetBoundsVelocity();
+	}
+}
+
+void FC_FluidSolver::LinearSolveVelocity(int axis, float a)
+{
+	void* pFields[]{ m_pVelocityX, m_pVelocityY, m_pVelocityZ };
+	const void* pPrevFields[]{ m_pPrevVelocityX, m_pPrevVelocityY, m_pPrevVelocityZ };
+	void* pField = pFields[axis];
+
+	FLUID_SCOPE(Diffuse);
+	CountSweeps(1, m_DiffuseIterations);
+
+	//The components only meet in Project(), so each one can be diffused on its own
+	if (CanSweepWindows(m_DiffuseIterations))
+	{
+		SweepWindows(m_DiffuseIterations, [this, pField, pPrevFields, axis, a](int firstX, int endX)
+		{
+			m_pKernels->LinearSolvePlanes(m_GridSize, pField, pPrevFields[axis], a, axis, m_SizeX, firstX, endX);
+		});
+		m_pKernels->SetBoundsCorners(m_GridSize, pField, m_SizeX);
+		return;
+	}
+
+	if (CanBlockSweeps(m_DiffuseIterations))
+	{
+		m_pKernels->LinearSolveBlocked(m_GridSize, pField, pPrevFields[axis], a, axis, m_SizeX, m_DiffuseIterations);
+		m_pKernels->SetBoundsCorners(m_GridSize, pField, m_SizeX);
+		return;
+	}
+
+	for (int iter{}; iter < m_DiffuseIterations; ++iter)
+	{
+		FLUID_TRACE_SCOPE(FluidDiffuseIteration);
+		LinearSolve(pField, pPrevFields[axis], a);
+		FLUID_SCOPE(SetBounds);
+		SetFieldFaces(*m_pKernels, pField, axis);
+		m_pKernels->SetBoundsCorners(m_GridSize, pField, m_SizeX);
+	}
+}
+
+void FC_FluidSolver::AdVectVelocities(float dt)
+{
+	AdVectVelocityFields(dt);
+	SetBoundsDiffuse();
+}
+
+void FC_FluidSolver::AdVectVelocityFields(float dt)
+{
+	//After Project() and the swap the previous velocity equals the current one, so the backtrace
+	//can use the previous field and all three components get written in one pass
+	const float dt0 = dt * m_GridSize;
+
+	FLUID_SCOPE(Advect);
+	CountSweeps(3, 1);
+	if (m_pAdVectScratch)
+	{
+		void* pFields[]{ m_pVelocityX, m_pVelocityY, m_pVelocityZ };
+		const void* pPrevFields[]{ m_pPrevVelocityX, m_pPrevVelocityY, m_pPrevVelocityZ };
+		for (int axis{}; axis < 3; ++axis)
+		{
+			AdVectMacCormack(pFields[axis], pPrevFields[axis], axis, m_pPrevVelocityX, m_pPrevVelocityY, m_pPrevVelocityZ, dt0, nullptr);
+		}
+		return;
+	}
+
+	ParallelForSlabs([this, dt0](int slabIdx, int firstX, int endX)
+	{
+		m_pKernels->AdVectVelocities(m_GridSize, m_pVelocityX, m_pVelocityY, m_pVelocityZ, m_pPrevVelocityX, m_pPrevVelocityY, m_pPrevVelocityZ, dt0, m_SizeX, firstX, endX);
+	});
+}
+
+void FC_FluidSolver::Project()
+{
+	FLUID_SCOPE(Project);
+	const float h = m_GapSize / m_GridSize;
+
+	SetDivergence(h);
+	SetBoundsDivergence();
+	SetBoundsPressure();
+
+	LinearSolvePressure();
+
+	SetProjectedVelocities(h);
+
+	CopyVelocities();
+}
+
+void FC_FluidSolver::CopyVelocities()
+{
+	FLUID_SCOPE(CopyVelocities);
+	//Max velocity is reduced in the copy pass so the CFL check doesn't need its own sweep
+	ParallelFor(m_NumSlabs, [this](int slabIdx)
+	{
+		CopyVelocitiesSlab(slabIdx);
+	});
+
+	ReduceMaxVelocity();
+}
+
+void FC_FluidSolver::CopyVelocitiesSlab(int slabIdx)
+{
+	const int64 sliceSize{ GetSliceSize() };
+	int firstX{}, endX{};
+	GetSlabRange(slabIdx, firstX, endX);
+
+	m_SlabPartials[slabIdx] = m_pKernels->CopyVelocities(m_pPrevVelocityX, m_pPrevVelocityY, m_pPrevVelocityZ, m_pVelocityX, m_pVelocityY, m_pVelocityZ, firstX * sliceSize, endX * sliceSize);
+}
+
+void FC_FluidSolver::ReduceMaxVelocity()
+{
+	float maxSquaredVelocity{};
+	for (const float partial : m_SlabPartials)
+	{
+		maxSquaredVelocity = FMath::Max(maxSquaredVelocity, partial);
+	}
+	m_MaxVelocity = FMath::Sqrt(maxSquaredVelocity);
+	CountSweeps(3, 1); //Every path reduces once per copy pass, the team's included
+
+	if (m_pTransport)
+	{
+		m_MaxVelocity = m_pTransport->AllReduceMax(m_MaxVelocity);
+	}
+}
+
+void FC_FluidSolver::ResetSlabStats(TArray<FC_SweepStats>& slabStats) const
+{
+	for (FC_SweepStats& partial : slabStats)
+	{
+		partial = FC_SweepStats{ m_ActiveDensityThreshold };
+	}
+}
+
+FC_SweepStats* FC_FluidSolver::GetResidualStats(int slabIdx)
+{
+#if STATS
+	return &m_SlabDivergenceStats[slabIdx];
+#else
+	return nullptr;
+#endif
+}
+
+void FC_FluidSolver::ReduceStats()
+{
+	FC_SweepStats stats{};
+	for (const FC_SweepStats& partial : m_SlabDensityStats)
+	{
+		stats.Merge(partial);
+	}
+	for (const FC_SweepStats& partial : m_SlabDivergenceStats)
+	{
+		stats.Merge(partial);
+	}
+
+	//The box is in local cells, an empty one gets corners every other rank's box wins against
+	FIntVector activeMin{ m_GridSize + 1 };
+	FIntVector activeMax{ 0 };
+	if (stats.HasActiveCells())
+	{
+		activeMin = stats.m_ActiveMin + FIntVector{ m_FirstGlobalX - 1, 0, 0 };
+		activeMax = stats.m_ActiveMax + FIntVector{ m_FirstGlobalX - 1, 0, 0 };
+	}
+
+	float totalDensity = static_cast<float>(stats.m_TotalDensity);
+	float divergenceSquares = static_cast<float>(stats.m_DivergenceSquares);
+	float residualSquares = static_cast<float>(stats.m_ResidualSquares);
+	if (m_pTransport)
+	{
+		totalDensity = m_pTransport->AllReduceSum(totalDensity);
+		divergenceSquares = m_pTransport->AllReduceSum(divergenceSquares);
+#if STATS
+		residualSquares = m_pTransport->AllReduceSum(residualSquares);
+#endif
+		for (int axis{}; axis < 3; ++axis)
+		{
+			activeMin[axis] = -FMath::RoundToInt(m_pTransport->AllReduceMax(static_cast<float>(-activeMin[axis])));
+			activeMax[axis] = FMath::RoundToInt(m_pTransport->AllReduceMax(static_cast<float>(activeMax[axis])));
+		}
+	}
+
+	const float numInteriorCells = static_cast<float>(m_GridSize) * m_GridSize * (m_bIsPlanar ? 1 : m_GridSize);
+	m_Stats.m_TotalDensity = totalDensity;
+	m_Stats.m_MaxVelocity = m_MaxVelocity;
+	m_Stats.m_DivergenceRms = FMath::Sqrt(divergenceSquares / numInteriorCells);
+	m_Stats.m_PressureResidualRms = FMath::Sqrt(residualSquares / numInteriorCells);
+	m_Stats.m_bHasActiveCells = activeMin.X <= activeMax.X;
+	m_Stats.m_ActiveMin = m_Stats.m_bHasActiveCells ? activeMin : FIntVector{};
+	m_Stats.m_ActiveMax = m_Stats.m_bHasActiveCells ? activeMax : FIntVector{};
+
+	SET_FLOAT_STAT(STAT_FluidDivergenceRms, m_Stats.m_DivergenceRms);
+	SET_FLOAT_STAT(STAT_FluidPressureResidualRms, m_Stats.m_PressureResidualRms);
+	SET_FLOAT_STAT(STAT_FluidMaxVelocity, m_Stats.m_MaxVelocity);
+}
+
+void FC_FluidSolver::SwapVelocities()
+{
+	Swap(m_pVelocityX, m_pPrevVelocityX);
+	Swap(m_pVelocityY, m_pPrevVelocityY);
+	Swap(m_pVelocityZ, m_pPrevVelocityZ);
+}
+
+void FC_FluidSolver::SetBoundsVelocity()
+{
+	FLUID_SCOPE(SetBounds);
+	SetFieldFaces(*m_pKernels, m_pVelocityX, 0);
+	SetFieldFaces(*m_pKernels, m_pVelocityY, 1);
+	SetFieldFaces(*m_pKernels, m_pVelocityZ, 2);
+
+	m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityX, m_SizeX);
+	m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityY, m_SizeX);
+	m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityZ, m_SizeX);
+
+	ExchangeHalos(m_pVelocityX);
+	ExchangeHalos(m_pVelocityY);
+	ExchangeHalos(m_pVelocityZ);
+}
+
+void FC_FluidSolver::SetDivergence(float h)
+{
+	//The pressure is left alone, the solve warm starts from it
+	FLUID_SCOPE(Divergence);
+	CountSweeps(1, 1);
+	ResetSlabStats(m_SlabDivergenceStats);
+	ParallelForSlabs([this, h](int slabIdx, int firstX, int endX)
+	{
+		m_pKernels->Divergence(m_GridSize, m_pDivergence, m_pVelocityX, m_pVelocityY, m_pVelocityZ, h, firstX, endX, &m_SlabDivergenceStats[slabIdx]);
+	});
+}
+
+void FC_FluidSolver::SetBoundsDivergence()
+{
+	FLUID_SCOPE(SetBounds);
+	SetFieldFaces(*m_pPressureKernels, m_pDivergence, -1);
+	m_pPressureKernels->SetBoundsCorners(m_GridSize, m_pDivergence, m_SizeX);
+	ExchangeHalos(m_pDivergence);
+}
+
+void FC_FluidSolver::SetBoundsPressure()
+{
+	FLUID_SCOPE(SetBounds);
+	SetFieldFaces(*m_pPressureKernels, m_pPressure, -1);
+	m_pPressureKernels->SetBoundsCorners(m_GridSize, m_pPressure, m_SizeX);
+	ExchangeHalos(m_pPressure);
+}
+
+void FC_FluidSolver::LinearSolvePressure()
+{
+	FLUID_SCOPE(PressureSolve);
+
+	//The spectral solve counts as one sweep, it's exact
+	if (m_bUseSpectralPressure && m_SpectralPoisson.IsInitialized())
+	{
+		CountSweeps(1, 1);
+		m_SpectralPoisson.Solve(m_pPressure, m_pDivergence);
+		SetBoundsPressure();
+		return;
+	}
+
+	CountSweeps(1, m_PressureIterations);
+
+	if (CanSweepWindows(m_PressureIterations))
+	{
+		SweepWindows(m_PressureIterations, [this](int firstX, int endX)
+		{
+			m_pPressureKernels->PressureSolvePlanes(m_GridSize, m_pPressure, m_pDivergence, m_SizeX, firstX, endX);
+		});
+		m_pPressureKernels->SetBoundsCorners(m_GridSize, m_pPressure, m_SizeX);
+		return;
+	}
+
+	if (CanBlockSweeps(m_PressureIterations))
+	{
+		m_pKernels->PressureSolveBlocked(m_GridSize, m_pPressure, m_pDivergence, m_SizeX, m_PressureIterations);
+		SetBoundsPressure();
+		return;
+	}
+
+	for (int iter{}; iter < m_PressureIterations; ++iter)
+	{
+		FLUID_TRACE_SCOPE(FluidPressureIteration);
+		m_pKernels->PressureSolve(m_GridSize, m_pPressure, m_pDivergence, 1, m_SizeX + 1);
+		SetBoundsPressure();
+	}
+}
+
+void FC_FluidSolver::SetProjectedVelocities(float h)
+{
+	const float scale{ -0.5f / h };
+
+	FLUID_SCOPE(ProjectVelocities);
+	CountSweeps(3, 1);
+	ParallelForSlabs([this, scale](int slabIdx, int firstX, int endX)
+	{
+		m_pKernels->ProjectVelocities(m_GridSize, m_pVelocityX, m_pVelocityY, m_pVelocityZ, m_pPressure, m_pDivergence, scale, firstX, endX, GetResidualStats(slabIdx));
+	});
+	SetBoundsVelocity();
+}
+
+#pragma endregion
+
+#pragma region Planar
+
+void FC_FluidSolver::StepPlanar(float dt)
+{
+	//Same stages as HandleVelocities and HandleDensities with the 2D kernels, planar fields are always float
+	//The swaps move the field pointers around, so they're cast at every use
+	const auto floats = [](void* pField) { return static_cast<float*>(pField); };
+	const float dt0 = dt * m_GridSize;
+
+	SwapVelocities();
+
+	const float viscosityA = dt * m_Viscosity * m_GridSize * m_GridSize;
+	{
+		FLUID_SCOPE(Diffuse);
+		CountSweeps(2, m_DiffuseIterations);
+		for (int iter{}; iter < m_DiffuseIterations; ++iter)
+		{
+			FLUID_TRACE_SCOPE(FluidDiffuseIteration);
+			FC_PlanarKernels::LinearSolve(m_GridSize, floats(m_pVelocityX), floats(m_pPrevVelocityX), viscosityA, 1, m_GridSize + 1);
+			FC_PlanarKernels::LinearSolve(m_GridSize, floats(m_pVelocityY), floats(m_pPrevVelocityY), viscosityA, 1, m_GridSize + 1);
+			FLUID_SCOPE(SetBounds);
+			FC_PlanarKernels::SetBounds(m_GridSize, floats(m_pVelocityX), 0);
+			FC_PlanarKernels::SetBounds(m_GridSize, floats(m_pVelocityY), 1);
+		}
+	}
+
+	ProjectPlanar();
+
+	SwapVelocities();
+
+	{
+		FLUID_SCOPE(Advect);
+		CountSweeps(2, 1);
+		if (m_pAdVectScratch)
+		{
+			AdVectMacCormack(m_pVelocityX, m_pPrevVelocityX, 0, m_pPrevVelocityX, m_pPrevVelocityY, nullptr, dt0, nullptr);
+			AdVectMacCormack(m_pVelocityY, m_pPrevVelocityY, 1, m_pPrevVelocityX, m_pPrevVelocityY, nullptr, dt0, nullptr);
+		}
+		else
+		{
+			ParallelForSlabs([this, &floats, dt0](int slabIdx, int firstX, int endX)
+			{
+				FC_PlanarKernels::AdVectVelocities(m_GridSize, floats(m_pVelocityX), floats(m_pVelocityY), floats(m_pPrevVelocityX), floats(m_pPrevVelocityY), dt0, firstX, endX);
+			});
+		}
+		FLUID_SCOPE(SetBounds);
+		FC_PlanarKernels::SetBounds(m_GridSize, floats(m_pVelocityX), 0);
+		FC_PlanarKernels::SetBounds(m_GridSize, floats(m_pVelocityY), 1);
+	}
+
+	ProjectPlanar();
+
+	SwapDensities();
+
+	if (!m_bSkipDensityDiffusion)
+	{
+		const float diffuseA = dt * m_DiffuseAmount * m_GridSize * m_GridSize;
+		FLUID_SCOPE(Diffuse);
+		CountSweeps(1, m_DiffuseIterations);
+		for (int iter{}; iter < m_DiffuseIterations; ++iter)
+		{
+			FLUID_TRACE_SCOPE(FluidDiffuseIteration);
+			FC_PlanarKernels::LinearSolve(m_GridSize, floats(m_pDensity), floats(m_pPrevDensity), diffuseA, 1, m_GridSize + 1);
+			FLUID_SCOPE(SetBounds);
+			FC_PlanarKernels::SetBounds(m_GridSize, floats(m_pDensity), -1);
+		}
+
+		SwapDensities();
+	}
+
+	FLUID_SCOPE(Advect);
+	CountSweeps(1, 1);
+	ResetSlabStats(m_SlabDensityStats);
+	if (m_pAdVectScratch)
+	{
+		AdVectMacCormack(m_pDensity, m_pPrevDensity, -1, m_pVelocityX, m_pVelocityY, nullptr, dt0, &m_SlabDensityStats);
+	}
+	else
+	{
+		ParallelForSlabs([this, &floats, dt0](int slabIdx, int firstX, int endX)
+		{
+			FC_PlanarKernels::AdVect(m_GridSize, floats(m_pDensity), floats(m_pPrevDensity), floats(m_pVelocityX), floats(m_pVelocityY), dt0, firstX, endX, &m_SlabDensityStats[slabIdx]);
+		});
+	}
+	FLUID_SCOPE(SetBounds);
+	FC_PlanarKernels::SetBounds(m_GridSize, floats(m_pDensity), -1);
+}
+
+void FC_FluidSolver::ProjectPlanar()
+{
+	float* pVelocityX = static_cast<float*>(m_pVelocityX);
+	float* pVelocityY = static_cast<float*>(m_pVelocityY);
+	const float h = m_GapSize / m_GridSize;
+	FLUID_SCOPE(Project);
+
+	{
+		FLUID_SCOPE(Divergence);
+		CountSweeps(1, 1);
+		ResetSlabStats(m_SlabDivergenceStats);
+		ParallelForSlabs([this, pVelocityX, pVelocityY, h](int slabIdx, int firstX, int endX)
+		{
+			FC_PlanarKernels::Divergence(m_GridSize, m_pDivergence, pVelocityX, pVelocityY, h, firstX, endX, &m_SlabDivergenceStats[slabIdx]);
+		});
+		FLUID_SCOPE(SetBounds);
+		FC_PlanarKernels::SetBounds(m_GridSize, m_pDivergence, -1);
+		FC_PlanarKernels::SetBounds(m_GridSize, m_pPressure, -1);
+	}
+
+	{
+		FLUID_SCOPE(PressureSolve);
+		CountSweeps(1, m_PressureIterations);
+		for (int iter{}; iter < m_PressureIterations; ++iter)
+		{
+			FLUID_TRACE_SCOPE(FluidPressureIteration);
+			FC_PlanarKernels::PressureSolve(m_GridSize, m_pPressure, m_pDivergence, 1, m_GridSize + 1);
+			FLUID_SCOPE(SetBounds);
+			FC_PlanarKernels::SetBounds(m_GridSize, m_pPressure, -1);
+		}
+	}
+
+	{
+		const float scale{ -0.5f / h };
+		FLUID_SCOPE(ProjectVelocities);
+		CountSweeps(2, 1);
+		ParallelForSlabs([this, pVelocityX, pVelocityY, scale](int slabIdx, int firstX, int endX)
+		{
+			FC_PlanarKernels::ProjectVelocities(m_GridSize, pVelocityX, pVelocityY, m_pPressure, m_pDivergence, scale, firstX, endX, GetResidualStats(slabIdx));
+		});
+		FLUID_SCOPE(SetBounds);
+		FC_PlanarKernels::SetBounds(m_GridSize, pVelocityX, 0);
+		FC_PlanarKernels::SetBounds(m_GridSize, pVelocityY, 1);
+	}
+
+	//Velocity z is all zeroes, copying it along keeps CopyVelocities the same for both modes
+	CopyVelocities();
+}
+
+#pragma endregion
+
+#pragma region Helpers
+
+int64 FC_FluidSolver::GetIdx(int x, int y, int z) const
+{
+	const int64 xIdx = static_cast<int64>(x) * GetSliceSize();
+	const int yIdx = y * GetRealDepth();
+	const int zIdx = z;
+
+	return xIdx + yIdx + zIdx;
+}
+
+void FC_FluidSolver::GetSlabRange(int slabIdx, int& firstX, int& endX) const
+{
+	firstX = slabIdx == 0 ? 0 : 1 + m_SizeX * slabIdx / m_NumSlabs;
+	endX = slabIdx == m_NumSlabs - 1 ? m_SizeX + 2 : 1 + m_SizeX * (slabIdx + 1) / m_NumSlabs;
+}
+
+void FC_FluidSolver::ParallelForSlabs(TFunctionRef<void(int slabIdx, int firstX, int endX)> function) const
+{
+	if (m_Arena.IsFileBacked())
+	{
+		ParallelForWindows(function);
+		return;
+	}
+
+	ParallelFor(m_NumSlabs, [this, &function](int slabIdx)
+	{
+		int firstX{}, endX{};
+		GetSlabRange(slabIdx, firstX, endX);
+
+		//Boundary slices are handled by the bounds passes
+		function(slabIdx, FMath::Max(firstX, 1), FMath::Min(endX, m_SizeX + 1));
+	});
+}
+
+void FC_FluidSolver::ParallelForWindows(TFunctionRef<void(int slabIdx, int firstX, int endX)> function) const
+{
+	//The next window is read ahead while the slabs sweep this one, and the window behind is handed back to the OS,
+	//so only a few windows have to be resident however large the grid is
+	//Stencils reach one slice past a window, a slice that isn't resident yet still gets paged in, just without the overlap
+	const int64 sliceSize{ GetSliceSize() };
+	const int windowSize = FMath::Max(m_OutOfCoreSlices, 1);
+
+	m_Arena.AdviseSlices(0, FMath::Min(windowSize + 2, m_SizeX + 2), sliceSize, EC_SliceAdvice::WillNeed);
+	for (int windowFirstX{ 1 }; windowFirstX <= m_SizeX; windowFirstX += windowSize)
+	{
+		const int windowEndX = FMath::Min(windowFirstX + windowSize, m_SizeX + 1);
+		m_Arena.AdviseSlices(windowEndX + 1, FMath::Min(windowEndX + windowSize + 1, m_SizeX + 2), sliceSize, EC_SliceAdvice::WillNeed);
+
+		ParallelFor(m_NumSlabs, [this, &function, windowFirstX, windowEndX](int slabIdx)
+		{
+			const int firstX = windowFirstX + (windowEndX - windowFirstX) * slabIdx / m_NumSlabs;
+			const int endX = windowFirstX + (windowEndX - windowFirstX) * (slabIdx + 1) / m_NumSlabs;
+			if (firstX < endX)
+			{
+				function(slabIdx, firstX, endX);
+			}
+		});
+
+		//The last slice stays, the next window's stencils read it
+		m_Arena.AdviseSlices(windowFirstX - 1, windowEndX - 1, sliceSize, EC_SliceAdvice::DontNeed);
+	}
+}
+
+void FC_FluidSolver::StepOnTeam(int memberIdx, float dt)
+{
+	//Every member runs this whole function on its own slab, only the corners and the reductions go to member 0 between two barriers
+	int firstX{}, endX{};
+	GetSlabRange(memberIdx, firstX, endX);
+	firstX = FMath::Max(firstX, 1);
+	endX = FMath::Min(endX, m_SizeX + 1);
+
+	if (memberIdx == 0)
+	{
+		SwapVelocities();
+		//Advection reads the previous density, without diffusion that has to be the current one
+		SwapDensities();
+	}
+	m_Team.Barrier();
+
+	//The diffusions don't touch each other's fields, they share one wavefront
+	const float viscosityA = dt * m_Viscosity * m_GridSize * m_GridSize;
+	const float diffuseA = dt * m_DiffuseAmount * m_GridSize * m_GridSize;
+	const bool bDiffuseDensity = !m_bSkipDensityDiffusion;
+	{
+		FLUID_SCOPE(Diffuse);
+		SweepOnTeam(memberIdx, firstX, endX, m_DiffuseIterations, [this, viscosityA, diffuseA, bDiffuseDensity](int sweepFirstX, int sweepEndX)
+		{
+			m_pKernels->LinearSolvePlanes(m_GridSize, m_pVelocityX, m_pPrevVelocityX, viscosityA, 0, m_SizeX, sweepFirstX, sweepEndX);
+			m_pKernels->LinearSolvePlanes(m_GridSize, m_pVelocityY, m_pPrevVelocityY, viscosityA, 1, m_SizeX, sweepFirstX, sweepEndX);
+			m_pKernels->LinearSolvePlanes(m_GridSize, m_pVelocityZ, m_pPrevVelocityZ, viscosityA, 2, m_SizeX, sweepFirstX, sweepEndX);
+			if (bDiffuseDensity)
+			{
+				m_pKernels->LinearSolvePlanes(m_GridSize, m_pDensity, m_pPrevDensity, diffuseA, -1, m_SizeX, sweepFirstX, sweepEndX);
+			}
+		});
+	}
+
+	if (memberIdx == 0)
+	{
+		CountSweeps(bDiffuseDensity ? 4 : 3, m_DiffuseIterations);
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityX, m_SizeX);
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityY, m_SizeX);
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityZ, m_SizeX);
+		if (bDiffuseDensity)
+		{
+			m_pKernels->SetBoundsCorners(m_GridSize, m_pDensity, m_SizeX);
+			SwapDensities();
+		}
+	}
+	m_Team.Barrier();
+
+	ProjectOnTeam(memberIdx, firstX, endX);
+
+	if (memberIdx == 0)
+	{
+		SwapVelocities();
+	}
+	m_Team.Barrier();
+
+	//Like in the step graph, the density bounds AdVectVelocities writes are dead and left out
+	const float dt0 = dt * m_GridSize;
+	{
+		FLUID_SCOPE(Advect);
+		if (m_pAdVectScratch)
+		{
+			void* pFields[]{ m_pVelocityX, m_pVelocityY, m_pVelocityZ };
+			const void* pPrevFields[]{ m_pPrevVelocityX, m_pPrevVelocityY, m_pPrevVelocityZ };
+			for (int axis{}; axis < 3; ++axis)
+			{
+				AdVectMacCormackOnTeam(memberIdx, firstX, endX, pFields[axis], pPrevFields[axis], axis, m_pPrevVelocityX, m_pPrevVelocityY, m_pPrevVelocityZ, dt0, nullptr);
+			}
+		}
+		else
+		{
+			m_pKernels->AdVectVelocities(m_GridSize, m_pVelocityX, m_pVelocityY, m_pVelocityZ, m_pPrevVelocityX, m_pPrevVelocityY, m_pPrevVelocityZ, dt0, m_SizeX, firstX, endX);
+		}
+	}
+	m_Team.Barrier();
+
+	ProjectOnTeam(memberIdx, firstX, endX);
+
+	m_SlabDensityStats[memberIdx] = FC_SweepStats{ m_ActiveDensityThreshold };
+	{
+		FLUID_SCOPE(Advect);
+		if (m_pAdVectScratch)
+		{
+			AdVectMacCormackOnTeam(memberIdx, firstX, endX, m_pDensity, m_pPrevDensity, -1, m_pVelocityX, m_pVelocityY, m_pVelocityZ, dt0, &m_SlabDensityStats[memberIdx]);
+		}
+		else
+		{
+			m_pKernels->AdVect(m_GridSize, m_pDensity, m_pPrevDensity, m_pVelocityX, m_pVelocityY, m_pVelocityZ, dt0, m_SizeX, firstX, endX, &m_SlabDensityStats[memberIdx]);
+		}
+		m_pKernels->SetBoundsPlanes(m_GridSize, m_pDensity, -1, m_SizeX, firstX, endX);
+	}
+	m_Team.Barrier();
+
+	//The slab passes are counted once for the whole grid
+	if (memberIdx == 0)
+	{
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pDensity, m_SizeX);
+		CountSweeps(4, 1);
+	}
+}
+
+void FC_FluidSolver::ProjectOnTeam(int memberIdx, int firstX, int endX)
+{
+	const float h = m_GapSize / m_GridSize;
+
+	//A plane's face bounds only read that plane, every member sets the ones of its own slab
+	m_SlabDivergenceStats[memberIdx] = FC_SweepStats{ m_ActiveDensityThreshold };
+	{
+		FLUID_SCOPE(Divergence);
+		m_pKernels->Divergence(m_GridSize, m_pDivergence, m_pVelocityX, m_pVelocityY, m_pVelocityZ, h, firstX, endX, &m_SlabDivergenceStats[memberIdx]);
+		m_pPressureKernels->SetBoundsPlanes(m_GridSize, m_pDivergence, -1, m_SizeX, firstX, endX);
+		m_pPressureKernels->SetBoundsPlanes(m_GridSize, m_pPressure, -1, m_SizeX, firstX, endX);
+	}
+	m_Team.Barrier();
+
+	if (memberIdx == 0)
+	{
+		CountSweeps(4, 1); //Divergence and the projected velocities
+		m_pPressureKernels->SetBoundsCorners(m_GridSize, m_pDivergence, m_SizeX);
+		m_pPressureKernels->SetBoundsCorners(m_GridSize, m_pPressure, m_SizeX);
+	}
+	m_Team.Barrier();
+
+	{
+		FLUID_SCOPE(PressureSolve);
+		SweepOnTeam(memberIdx, firstX, endX, m_PressureIterations, [this](int sweepFirstX, int sweepEndX)
+		{
+			m_pPressureKernels->PressureSolvePlanes(m_GridSize, m_pPressure, m_pDivergence, m_SizeX, sweepFirstX, sweepEndX);
+		});
+	}
+
+	if (memberIdx == 0)
+	{
+		CountSweeps(1, m_PressureIterations);
+		m_pPressureKernels->SetBoundsCorners(m_GridSize, m_pPressure, m_SizeX);
+	}
+	m_Team.Barrier();
+
+	{
+		FLUID_SCOPE(ProjectVelocities);
+		m_pKernels->ProjectVelocities(m_GridSize, m_pVelocityX, m_pVelocityY, m_pVelocityZ, m_pPressure, m_pDivergence, -0.5f / h, firstX, endX, GetResidualStats(memberIdx));
+		m_pKernels->SetBoundsPlanes(m_GridSize, m_pVelocityX, 0, m_SizeX, firstX, endX);
+		m_pKernels->SetBoundsPlanes(m_GridSize, m_pVelocityY, 1, m_SizeX, firstX, endX);
+		m_pKernels->SetBoundsPlanes(m_GridSize, m_pVelocityZ, 2, m_SizeX, firstX, endX);
+	}
+	m_Team.Barrier();
+
+	if (memberIdx == 0)
+	{
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityX, m_SizeX);
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityY, m_SizeX);
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pVelocityZ, m_SizeX);
+	}
+	m_Team.Barrier();
+
+	{
+		FLUID_SCOPE(CopyVelocities);
+		CopyVelocitiesSlab(memberIdx);
+	}
+	m_Team.Barrier();
+
+	if (memberIdx == 0)
+	{
+		ReduceMaxVelocity();
+	}
+}
+
+void FC_FluidSolver::SweepOnTeam(int memberIdx, int firstX, int endX, int numIterations, TFunctionRef<void(int sweepFirstX, int sweepEndX)> sweepPlanes)
+{
+	//Wavefront over the slabs, in phase p member m runs iteration p - m of its own slab, first half and second half with a barrier in between
+	//A slab's first plane then sees its lower neighbor's last plane already at the same iteration, and its last plane sees the upper neighbor's
+	//first plane at the iteration before, exactly like one thread sweeping the whole grid in order, while every member has work once the front is in
+	const int numMembers = m_Team.GetNumMembers();
+	const int midX = firstX + (endX - firstX) / 2;
+
+	for (int phase{}; phase < numIterations + numMembers - 1; ++phase)
+	{
+		const int iter = phase - memberIdx;
+		const bool bIsActive = iter >= 0 && iter < numIterations;
+
+		FLUID_TRACE_SCOPE(FluidTeamSweepPhase);
+		if (bIsActive)
+		{
+			sweepPlanes(firstX, midX);
+		}
+		m_Team.Barrier();
+
+		if (bIsActive)
+		{
+			sweepPlanes(midX, endX);
+		}
+		m_Team.Barrier();
+	}
+}
+
+void FC_FluidSolver::AdVectMacCormackOnTeam(int memberIdx, int firstX, int endX, void* pField, const void* pPrevField, int reflectAxis, const void* pVelocityX, const void* pVelocityY, const void* pVelocityZ, float dt0, FC_SweepStats* pStats)
+{
+	m_pKernels->AdVect(m_GridSize, m_pAdVectScratch, pPrevField, pVelocityX, pVelocityY, pVelocityZ, dt0, m_SizeX, firstX, endX, nullptr);
+	m_pKernels->SetBoundsPlanes(m_GridSize, m_pAdVectScratch, reflectAxis, m_SizeX, firstX, endX);
+	m_Team.Barrier();
+
+	if (memberIdx == 0)
+	{
+		CountSweeps(1, 1);
+		m_pKernels->SetBoundsCorners(m_GridSize, m_pAdVectScratch, m_SizeX);
+	}
+	m_Team.Barrier();
+
+	m_pKernels->MacCormack(m_GridSize, pField, m_pAdVectScratch, pPrevField, pVelocityX, pVelocityY, pVelocityZ, dt0, m_SizeX, firstX, endX, pStats);
+	//The next call writes the scratch field again
+	m_Team.Barrier();
+}
+
+void FC_FluidSolver::BuildStepGraph()
+{
+	m_StepGraph.Reset();
+
+	//Velocity chain, the three diffusions are independent until the projection
+	const int swapVelocities = m_StepGraph.AddNode(TEXT("SwapVelocities"), [this]() { SwapVelocities(); }, {});
+
+	TArray<int> diffusions{};
+	const TCHAR* pAxisNames[]{ TEXT("X"), TEXT("Y"), TEXT("Z") };
+	for (int axis{}; axis < 3; ++axis)
+	{
+		diffusions.Add(m_StepGraph.AddNode(FString::Printf(TEXT("DiffuseVelocity%s"), pAxisNames[axis]), [this, axis]()
+		{
+			LinearSolveVelocity(axis, m_StepDt * m_Viscosity * m_GridSize * m_GridSize);
+		}, { swapVelocities }));
+	}
+
+	int projected{};
+	const int firstProject = AddProjectNodes(TEXT("First"), diffusions, projected);
+
+	//The SetBoundsDiffuse AdVectVelocities does is left out, the density it touches gets fully rewritten before it's read
+	const int adVectVelocities = m_StepGraph.AddNode(TEXT("AdVectVelocities"), [this]()
+	{
+		SwapVelocities();
+		AdVectVelocityFields(m_StepDt);
+	}, { firstProject });
+
+	AddProjectNodes(TEXT("Second"), { adVectVelocities }, projected);
+
+	//Density diffusion doesn't read any velocity, it runs alongside the whole velocity chain
+	const int diffuseDensity = m_StepGraph.AddNode(TEXT("DiffuseDensity"), [this]()
+	{
+		SwapDensities();
+		if (!m_bSkipDensityDiffusion)
+		{
+			LinearSolveDensities(m_StepDt * m_DiffuseAmount * m_GridSize * m_GridSize);
+			SwapDensities();
+		}
+	}, {});
+
+	m_StepGraph.AddNode(TEXT("AdVectDensity"), [this]() { AdVectDensities(m_StepDt); }, { diffuseDensity, projected });
+}
+
+int FC_FluidSolver::AddProjectNodes(const TCHAR* pPass, const TArray<int>& prerequisites, int& outProjectedNode)
+{
+	const float h = m_GapSize / m_GridSize;
+
+	const int divergence = m_StepGraph.AddNode(FString::Printf(TEXT("%sDivergence"), pPass), [this, h]()
+	{
+		SetDivergence(h);
+		SetBoundsDivergence();
+		SetBoundsPressure();
+	}, prerequisites);
+
+	const int pressure = m_StepGraph.AddNode(FString::Printf(TEXT("%sPressureSolve"), pPass), [this]() { LinearSolvePressure(); }, { divergence });
+	outProjectedNode = m_StepGraph.AddNode(FString::Printf(TEXT("%sProjectVelocities"), pPass), [this, h]() { SetProjectedVelocities(h); }, { pressure });
+
+	//Only the copy into the previous velocity waits on this, readers of the projected velocity can start right away
+	return m_StepGraph.AddNode(FString::Printf(TEXT("%sCopyVelocities"), pPass), [this]() { CopyVelocities(); }, { outProjectedNode });
+}
+
+bool FC_FluidSolver::CanBlockSweeps(int numIterations) const
+{
+	//Decomposed solvers need a halo exchange between every iteration
+	return m_bUseBlockedSweeps && !m_pTransport && numIterations > 0;
+}
+
+bool FC_FluidSolver::CanSweepWindows(int numIterations) const
+{
+	//Same wavefront as the blocked sweeps, so the same limits, m_bUseBlockedSweeps doesn't matter since it gives the same result
+	return m_Arena.IsFileBacked() && !m_pTransport && !m_bIsPlanar && numIterations > 0;
+}
+
+void FC_FluidSolver::SweepWindows(int numIterations, TFunctionRef<void(int firstX, int endX)> sweepPlanes) const
+{
+	//The blocked wavefront a window at a time, at every step iteration i sweeps the window right behind iteration i - 1
+	//Iteration i then reads the windows around it after iteration i - 1 and before iteration i + 1, as a full sweep per iteration would,
+	//and only numIterations + 1 windows are resident instead of the whole grid being paged through once per iteration
+	const int64 sliceSize{ GetSliceSize() };
+	const int windowSize = FMath::Max(m_OutOfCoreSlices, 1);
+	const int numWindows = (m_SizeX + windowSize - 1) / windowSize;
+
+	m_Arena.AdviseSlices(0, FMath::Min(windowSize + 2, m_SizeX + 2), sliceSize, EC_SliceAdvice::WillNeed);
+	for (int step{}; step < numWindows + numIterations - 1; ++step)
+	{
+		const int aheadFirstX = 1 + (step + 1) * windowSize;
+		m_Arena.AdviseSlices(aheadFirstX + 1, FMath::Min(aheadFirstX + windowSize + 1, m_SizeX + 2), sliceSize, EC_SliceAdvice::WillNeed);
+
+		for (int iter{}; iter < numIterations; ++iter)
+		{
+			const int windowIdx = step - iter;
+			if (windowIdx < 0 || windowIdx >= numWindows)
+			{
+				continue;
+			}
+
+			const int firstX = 1 + windowIdx * windowSize;
+			sweepPlanes(firstX, FMath::Min(firstX + windowSize, m_SizeX + 1));
+		}
+
+		//Every iteration is done with the window the last one just swept, its last slice stays for the stencils of the next
+		const int doneIdx = step - (numIterations - 1);
+		if (doneIdx >= 0 && doneIdx < numWindows)
+		{
+			const int doneFirstX = 1 + doneIdx * windowSize;
+			m_Arena.AdviseSlices(doneFirstX - 1, FMath::Min(doneFirstX + windowSize, m_SizeX + 1) - 1, sliceSize, EC_SliceAdvice::DontNeed);
+		}
+	}
+}
+
+void FC_FluidSolver::SetFieldFaces(const FC_FluidKernels& kernels, void* pField, int reflectAxis) const
+{
+	//The faces pass touches every slice, so a file backed grid walks it in windows like the other passes
+	if (m_Arena.IsFileBacked())
+	{
+		ParallelForWindows([this, &kernels, pField, reflectAxis](int slabIdx, int firstX, int endX)
+		{
+			kernels.SetBoundsPlanes(m_GridSize, pField, reflectAxis, m_SizeX, firstX, endX);
+		});
+		return;
+	}
+
+	kernels.SetBoundsFaces(m_GridSize, pField, reflectAxis, m_SizeX);
+}
+
+void FC_FluidSolver::ExchangeHalos(void* pCells)
+{
+	if (!m_pTransport)
+	{
+		return;
+	}
+
+	//Init keeps decomposed solvers on float cells
+	check(m_pKernels->m_Precision == EC_FieldPrecision::Float);
+	float* pField = static_cast<float*>(pCells);
+
+	//Our first and last interior slices go out, the neighbors' land in our ghost slices
+	//On a side without neighbor the views stay empty and the wall bounds just written are kept
+	const int sliceSize{ m_RealGridSize * m_RealGridSize };
+	const bool bHasLow = m_pTransport->GetRank() > 0;
+	const bool bHasHigh = m_pTransport->GetRank() < m_pTransport->GetNumRanks() - 1;
+
+	m_pTransport->ExchangeHalos(
+		TArrayView<const float>{ pField + 1 * sliceSize, bHasLow ? sliceSize : 0 },
+		TArrayView<float>{ pField, bHasLow ? sliceSize : 0 },
+		TArrayView<const float>{ pField + static_cast<int64>(m_SizeX) * sliceSize, bHasHigh ? sliceSize : 0 },
+		TArrayView<float>{ pField + static_cast<int64>(m_SizeX + 1) * sliceSize, bHasHigh ? sliceSize : 0 });
+}
+
+void FC_FluidSolver::CountSweeps(int numFields, int numIterations) const
+{
+	INC_DWORD_STAT_BY(STAT_FluidIterations, numIterations);
+	INC_DWORD_STAT_BY(STAT_FluidCellsProcessed, numFields * numIterations * m_SizeX * m_GridSize * (m_bIsPlanar ? 1 : m_GridSize));
+}
+
+void FC_FluidSolver::LinearSolve(void* pField, const void* pPrevField, float a)
+{
+	m_pKernels->LinearSolve(m_GridSize, pField, pPrevField, a, 1, m_SizeX + 1);
+}
+
+void FC_FluidSolver::AdVect(void* pField, const void* pPrevField, float dt)
+{
+	const float dt0 = dt * m_GridSize;
+
+	//Only density gets advected on its own, its stats come along
+	CountSweeps(1, 1);
+	ResetSlabStats(m_SlabDensityStats);
+	if (m_pAdVectScratch)
+	{
+		AdVectMacCormack(pField, pPrevField, -1, m_pVelocityX, m_pVelocityY, m_pVelocityZ, dt0, &m_SlabDensityStats);
+		return;
+	}
+
+	ParallelForSlabs([this, pField, pPrevField, dt0](int slabIdx, int firstX, int endX)
+	{
+		m_pKernels->AdVect(m_GridSize, pField, pPrevField, m_pVelocityX, m_pVelocityY, m_pVelocityZ, dt0, m_SizeX, firstX, endX, &m_SlabDensityStats[slabIdx]);
+	});
+}
+
+void FC_FluidSolver::AdVectMacCormack(void* pField, const void* pPrevField, int reflectAxis, const void* pVelocityX, const void* pVelocityY, const void* pVelocityZ, float dt0, TArray<FC_SweepStats>* pSlabStats)
+{
+	//The correction samples the forward result around every cell, so all of it, bounds and ghost slices included, has to be written first
+	CountSweeps(1, 1);
+
+	if (m_bIsPlanar)
+	{
+		float* pScratch = static_cast<float*>(m_pAdVectScratch);
+		const float* pPlanarVelocityX = static_cast<const float*>(pVelocityX);
+		const float* pPlanarVelocityY = static_cast<const float*>(pVelocityY);
+
+		ParallelForSlabs([this, pScratch, pPrevField, pPlanarVelocityX, pPlanarVelocityY, dt0](int slabIdx, int firstX, int endX)
+		{
+			FC_PlanarKernels::AdVect(m_GridSize, pScratch, static_cast<const float*>(pPrevField), pPlanarVelocityX, pPlanarVelocityY, dt0, firstX, endX, nullptr);
+		});
+		FC_PlanarKernels::SetBounds(m_GridSize, pScratch, reflectAxis);
+		ParallelForSlabs([this, pField, pScratch, pPrevField, pPlanarVelocityX, pPlanarVelocityY, dt0, pSlabStats](int slabIdx, int firstX, int endX)
+		{
+			FC_PlanarKernels::MacCormack(m_GridSize, static_cast<float*>(pField), pScratch, static_cast<const float*>(pPrevField), pPlanarVelocityX, pPlanarVelocityY, dt0, firstX, endX, pSlabStats ? &(*pSlabStats)[slabIdx] : nullptr);
+		});
+		return;
+	}
+
+	ParallelForSlabs([this, pPrevField, pVelocityX, pVelocityY, pVelocityZ, dt0](int slabIdx, int firstX, int endX)
+	{
+		m_pKernels->AdVect(m_GridSize, m_pAdVectScratch, pPrevField, pVelocityX, pVelocityY, pVelocityZ, dt0, m_SizeX, firstX, endX, nullptr);
+	});
+	SetFieldFaces(*m_pKernels, m_pAdVectScratch, reflectAxis);
+	m_pKernels->SetBoundsCorners(m_GridSize, m_pAdVectScratch, m_SizeX);
+	ExchangeHalos(m_pAdVectScratch);
+
+	ParallelForSlabs([this, pField, pPrevField, pVelocityX, pVelocityY, pVelocityZ, dt0, pSlabStats](int slabIdx, int firstX, int endX)
+	{
+		m_pKernels->MacCormack(m_GridSize, pField, m_pAdVectScratch, pPrevField, pVelocityX, pVelocityY, pVelocityZ, dt0, m_SizeX, firstX, endX, pSlabStats ? &(*pSlabStats)[slabIdx] : nullptr);
+	});
+}
+
+float FC_FluidSolver::ReadCell(const void* pField, int64 idx) const
+{
+	if (m_pKernels->m_Precision == EC_FieldPrecision::Half)
+	{
+		return static_cast<const FFloat16*>(pField)[idx];
+	}
+	return static_cast<const float*>(pField)[idx];
+}
+
+void FC_FluidSolver::WriteCell(void* pField, int64 idx, float value)
+{
+	if (m_pKernels->m_Precision == EC_FieldPrecision::Half)
+	{
+		static_cast<FFloat16*>(pField)[idx] = value;
+		return;
+	}
+	static_cast<float*>(pField)[idx] = value;
+}
+
+void FC_FluidSolver::CopyField(const void* pField, TArray<float>& outField) const
+{
+	if (!IsInitialized())
+	{
+		outField.Reset();
+		return;
+	}
+
+	//A TArray holds at most 2^31 cells, an out-of-core domain has to be read a few slices at a time, see CopyDensitySlices
+	const int64 numCells = GetNumCells();
+	check(numCells <= MAX_int32);
+	outField.SetNumUninitialized(static_cast<int>(numCells), false);
+
+	//Converted slab by slab, for float cells this is a plain copy
+	const int64 sliceSize{ GetSliceSize() };
+	ParallelFor(m_NumSlabs, [this, pField, &outField, sliceSize](int slabIdx)
+	{
+		int firstX{}, endX{};
+		GetSlabRange(slabIdx, firstX, endX);
+		m_pKernels->ReadCells(pField, outField.GetData(), firstX * sliceSize, endX * sliceSize);
+	});
+}
+
+void FC_FluidSolver::CompressDensity()
+{
+	if (!m_CompressedDensity.IsInitialized())
+	{
+		return;
+	}
+
+	FLUID_SCOPE(Compression);
+	m_CompressedDensity.Compress(TArrayView64<const float>{ static_cast<const float*>(m_pDensity), GetNumCells() });
+
+	//Until the next step only the blocks hold the density
+	m_Arena.DiscardField(m_pDensity);
+	m_Arena.DiscardField(m_pPrevDensity);
+	m_bIsDensityCompressed = true;
+}
+
+void FC_FluidSolver::DecompressDensity()
+{
+	if (!m_bIsDensityCompressed)
+	{
+		return;
+	}
+
+	FLUID_SCOPE(Compression);
+	m_CompressedDensity.Flush();
+	m_CompressedDensity.Decompress(TArrayView64<float>{ static_cast<float*>(m_pDensity), GetNumCells() });
+	m_bIsDensityCompressed = false;
+
+	//Diffusion starts from the discarded previous field, the last density is the closest guess there is
+	const int64 sliceSize{ GetSliceSize() };
+	ParallelFor(m_NumSlabs, [this, sliceSize](int slabIdx)
+	{
+		int firstX{}, endX{};
+		GetSlabRange(slabIdx, firstX, endX);
+		FMemory::Memcpy(static_cast<float*>(m_pPrevDensity) + firstX * sliceSize, static_cast<const float*>(m_pDensity) + firstX * sliceSize, (endX - firstX) * sliceSize * sizeof(float));
+	});
+}
+
+void FC_FluidSolver::GetCellCoords(int64 idx, int& outX, int& outY, int& outZ) const
+{
+	const int64 sliceSize{ GetSliceSize() };
+	const int sliceIdx = static_cast<int>(idx % sliceSize);
+
+	outX = static_cast<int>(idx / sliceSize);
+	outY = sliceIdx / GetRealDepth();
+	outZ = sliceIdx % GetRealDepth();
+}
+
+#pragma endregion
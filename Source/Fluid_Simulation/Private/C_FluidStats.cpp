@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_FluidStats.h"
+
+DEFINE_STAT(STAT_FluidTick);
+DEFINE_STAT(STAT_FluidStep);
+DEFINE_STAT(STAT_FluidDiffuse);
+DEFINE_STAT(STAT_FluidAdvect);
+DEFINE_STAT(STAT_FluidProject);
+DEFINE_STAT(STAT_FluidDivergence);
+DEFINE_STAT(STAT_FluidPressureSolve);
+DEFINE_STAT(STAT_FluidProjectVelocities);
+DEFINE_STAT(STAT_FluidCopyVelocities);
+DEFINE_STAT(STAT_FluidSetBounds);
+DEFINE_STAT(STAT_FluidCompression);
+DEFINE_STAT(STAT_FluidSnapshot);
+DEFINE_STAT(STAT_FluidTracers);
+DEFINE_STAT(STAT_FluidReplication);
+DEFINE_STAT(STAT_FluidVisualization);
+
+DEFINE_STAT(STAT_FluidSubsteps);
+DEFINE_STAT(STAT_FluidIterations);
+DEFINE_STAT(STAT_FluidCellsProcessed);
+DEFINE_STAT(STAT_FluidDivergenceRms);
+DEFINE_STAT(STAT_FluidPressureResidualRms);
+DEFINE_STAT(STAT_FluidMaxVelocity);
+
+#if CPUPROFILERTRACE_ENABLED
+UE_TRACE_CHANNEL_DEFINE(FluidChannel);
+#endif
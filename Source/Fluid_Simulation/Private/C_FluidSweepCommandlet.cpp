@@ -0,0 +1,299 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_FluidSweepCommandlet.h"
+#include "C_FluidSolver.h"
+#include "Async/ParallelFor.h"
+#include "Algo/Find.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include <atomic>
+
+namespace
+{
+	constexpr int s_MaxSubsteps{ 8 };
+
+	struct FSweepRun
+	{
+		//Parameters, the defaults are the grid manager's
+		int m_GridSize{ 32 };
+		float m_GapSize{ 100.f };
+		float m_DiffuseAmount{ 0.01f };
+		float m_Viscosity{ 0.01f };
+		int m_DiffuseIterations{ 4 };
+		int m_PressureIterations{ 4 };
+		int m_Steps{ 100 };
+		float m_Dt{ 1.f / 60.f };
+		float m_SourceRate{}; //Density per second added to every source cell
+		bool m_bPlanar{};
+		bool m_bHalf{};
+		bool m_bMacCormack{};
+		float m_CflTarget{ 1.f }; //Cells a substep may move, the substeps are capped at the grid manager's default of 8
+
+		//Results
+		FC_SolverStats m_Stats{};
+		int m_StepsDone{};
+		float m_MeanStepMs{};
+		bool m_bIsStable{ true };
+	};
+
+	struct FSweepParameter
+	{
+		const TCHAR* m_pName;
+		void(*m_pApply)(FSweepRun& run, float value);
+	};
+
+	const FSweepParameter s_Parameters[]
+	{
+		{ TEXT("GridSize"), [](FSweepRun& run, float value) { run.m_GridSize = FMath::Max(FMath::RoundToInt(value), 1); } },
+		{ TEXT("GapSize"), [](FSweepRun& run, float value) { run.m_GapSize = value; } },
+		{ TEXT("DiffuseAmount"), [](FSweepRun& run, float value) { run.m_DiffuseAmount = value; } },
+		{ TEXT("Viscosity"), [](FSweepRun& run, float value) { run.m_Viscosity = value; } },
+		{ TEXT("DiffuseIterations"), [](FSweepRun& run, float value) { run.m_DiffuseIterations = FMath::Max(FMath::RoundToInt(value), 0); } },
+		{ TEXT("PressureIterations"), [](FSweepRun& run, float value) { run.m_PressureIterations = FMath::Max(FMath::RoundToInt(value), 0); } },
+		{ TEXT("Steps"), [](FSweepRun& run, float value) { run.m_Steps = FMath::Max(FMath::RoundToInt(value), 0); } },
+		{ TEXT("Dt"), [](FSweepRun& run, float value) { run.m_Dt = value; } },
+		{ TEXT("SourceRate"), [](FSweepRun& run, float value) { run.m_SourceRate = value; } },
+		{ TEXT("Planar"), [](FSweepRun& run, float value) { run.m_bPlanar = value != 0.f; } },
+		{ TEXT("Half"), [](FSweepRun& run, float value) { run.m_bHalf = value != 0.f; } },
+		{ TEXT("MacCormack"), [](FSweepRun& run, float value) { run.m_bMacCormack = value != 0.f; } },
+		{ TEXT("CflTarget"), [](FSweepRun& run, float value) { run.m_CflTarget = value; } },
+	};
+
+	//A comma separated list, or start:end:count
+	bool ParseValues(const FString& text, TArray<float>& outValues)
+	{
+		outValues.Reset();
+
+		TArray<FString> range{};
+		if (text.ParseIntoArray(range, TEXT(":")) == 3)
+		{
+			float start{}, end{};
+			int count{};
+			if (!LexTryParseString(start, *range[0].TrimStartAndEnd()) || !LexTryParseString(end, *range[1].TrimStartAndEnd())
+				|| !LexTryParseString(count, *range[2].TrimStartAndEnd()))
+			{
+				return false;
+			}
+
+			for (int valueIdx{}; valueIdx < count; ++valueIdx)
+			{
+				outValues.Add(count > 1 ? FMath::Lerp(start, end, static_cast<float>(valueIdx) / (count - 1)) : start);
+			}
+			return count > 0;
+		}
+
+		TArray<FString> values{};
+		text.ParseIntoArray(values, TEXT(","));
+		for (const FString& value : values)
+		{
+			float parsedValue{};
+			if (!LexTryParseString(parsedValue, *value.TrimStartAndEnd()))
+			{
+				return false;
+			}
+			outValues.Add(parsedValue);
+		}
+		return outValues.Num() > 0;
+	}
+
+	bool ParseSpec(const FString& specPath, TArray<FSweepRun>& outRuns)
+	{
+		TArray<FString> lines{};
+		if (!FFileHelper::LoadFileToStringArray(lines, *specPath))
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to read %s, FluidSweepCommandlet/ParseSpec"), *specPath);
+			return false;
+		}
+
+		//Every line multiplies the runs so far by its values
+		outRuns = { FSweepRun{} };
+		for (const FString& rawLine : lines)
+		{
+			FString line{};
+			if (!rawLine.Split(TEXT("#"), &line, nullptr))
+			{
+				line = rawLine;
+			}
+			line.TrimStartAndEndInline();
+			if (line.IsEmpty())
+			{
+				continue;
+			}
+
+			FString name{}, valueText{};
+			TArray<float> values{};
+			const FSweepParameter* pParameter{};
+			if (line.Split(TEXT("="), &name, &valueText))
+			{
+				name.TrimStartAndEndInline();
+				pParameter = Algo::FindByPredicate(s_Parameters, [&name](const FSweepParameter& parameter) { return name == parameter.m_pName; });
+			}
+			if (!pParameter || !ParseValues(valueText.TrimStartAndEnd(), values))
+			{
+				UE_LOG(LogTemp, Error, TEXT("Can't parse \"%s\" in %s, FluidSweepCommandlet/ParseSpec"), *line, *specPath);
+				return false;
+			}
+
+			TArray<FSweepRun> runs{};
+			runs.Reserve(outRuns.Num() * values.Num());
+			for (const FSweepRun& run : outRuns)
+			{
+				for (const float value : values)
+				{
+					FSweepRun& newRun = runs.Add_GetRef(run);
+					pParameter->m_pApply(newRun, value);
+				}
+			}
+			outRuns = MoveTemp(runs);
+		}
+		return true;
+	}
+
+	void SimulateRun(int runIdx, FSweepRun& run, bool bDumpFields, const FString& outDirectory)
+	{
+		//Runs share nothing, each one is a whole domain on one thread so the sweep scales with the number of runs
+		FC_FluidSolver solver{};
+		solver.m_NumThreads = 1;
+		solver.m_bUseBlockedSweeps = true;
+		solver.m_bPlanar = run.m_bPlanar;
+		solver.m_FieldPrecision = run.m_bHalf ? EC_FieldPrecision::Half : EC_FieldPrecision::Float;
+		solver.m_bUseMacCormack = run.m_bMacCormack;
+		solver.m_DiffuseAmount = run.m_DiffuseAmount;
+		solver.m_Viscosity = run.m_Viscosity;
+		solver.m_DiffuseIterations = run.m_DiffuseIterations;
+		solver.m_PressureIterations = run.m_PressureIterations;
+		solver.Init(run.m_GridSize, run.m_GapSize);
+		if (!solver.IsInitialized())
+		{
+			run.m_bIsStable = false;
+			return;
+		}
+
+		//The bake's cube of density in the middle, refilled at m_SourceRate
+		const int sourceMin = run.m_GridSize / 2 - run.m_GridSize / 8;
+		const int sourceMax = run.m_GridSize / 2 + run.m_GridSize / 8;
+		TArray<int64> sourceCells{};
+		for (int x{ sourceMin }; x <= sourceMax; ++x)
+		{
+			for (int y{ sourceMin }; y <= sourceMax; ++y)
+			{
+				for (int z{ run.m_bPlanar ? 0 : sourceMin }; z <= (run.m_bPlanar ? 0 : sourceMax); ++z)
+				{
+					sourceCells.Add(solver.GetIdx(x, y, z));
+					solver.AddDensity(sourceCells.Last(), 1.f);
+				}
+			}
+		}
+
+		const double startTime = FPlatformTime::Seconds();
+		for (int stepIdx{}; stepIdx < run.m_Steps; ++stepIdx)
+		{
+			for (const int64 idx : sourceCells)
+			{
+				solver.AddDensity(idx, run.m_SourceRate * run.m_Dt);
+			}
+
+			const int numSubsteps = solver.GetSubstepCount(run.m_Dt, run.m_CflTarget, s_MaxSubsteps);
+			for (int substepIdx{}; substepIdx < numSubsteps; ++substepIdx)
+			{
+				solver.Step(run.m_Dt / numSubsteps);
+			}
+			++run.m_StepsDone;
+
+			//A blown up run only burns time from here on
+			const FC_SolverStats& stats = solver.GetStats();
+			if (!FMath::IsFinite(stats.m_TotalDensity) || !FMath::IsFinite(stats.m_MaxVelocity))
+			{
+				run.m_bIsStable = false;
+				break;
+			}
+		}
+
+		run.m_Stats = solver.GetStats();
+		run.m_MeanStepMs = run.m_StepsDone > 0 ? static_cast<float>((FPlatformTime::Seconds() - startTime) * 1000.0 / run.m_StepsDone) : 0.f;
+
+		if (bDumpFields)
+		{
+			TArray<float> density{};
+			solver.CopyDensityField(density);
+			const FString dumpPath = FPaths::Combine(outDirectory, FString::Printf(TEXT("run_%d_density.raw"), runIdx));
+			if (!FFileHelper::SaveArrayToFile(TArrayView<const uint8>{ reinterpret_cast<const uint8*>(density.GetData()), density.Num() * static_cast<int>(sizeof(float)) }, *dumpPath))
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Failed to write %s, FluidSweepCommandlet/SimulateRun"), *dumpPath);
+			}
+		}
+	}
+}
+
+UC_FluidSweepCommandlet::UC_FluidSweepCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UC_FluidSweepCommandlet::Main(const FString& params)
+{
+	FString specPath{};
+	if (!FParse::Value(*params, TEXT("Spec="), specPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Missing -Spec=<file>, FluidSweepCommandlet/Main"));
+		return 1;
+	}
+
+	FString outDirectory{ FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("FluidSweep")) };
+	FParse::Value(*params, TEXT("Out="), outDirectory);
+	const bool bDumpFields = FParse::Param(*params, TEXT("DumpFields"));
+
+	TArray<FSweepRun> runs{};
+	if (!ParseSpec(specPath, runs))
+	{
+		return 1;
+	}
+
+	if (!IFileManager::Get().MakeDirectory(*outDirectory, true))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to create %s, FluidSweepCommandlet/Main"), *outDirectory);
+		return 1;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Sweeping %d runs into %s"), runs.Num(), *outDirectory);
+	const double startTime = FPlatformTime::Seconds();
+
+	//Run lengths differ a lot with the grid size, so the runs get handed out one at a time
+	std::atomic<int> numDone{};
+	ParallelFor(runs.Num(), [&](int runIdx)
+	{
+		SimulateRun(runIdx, runs[runIdx], bDumpFields, outDirectory);
+		UE_LOG(LogTemp, Display, TEXT("Run %d done (%d/%d)%s"), runIdx, ++numDone, runs.Num(), runs[runIdx].m_bIsStable ? TEXT("") : TEXT(", unstable"));
+	}, EParallelForFlags::Unbalanced);
+
+	TArray<FString> lines{};
+	lines.Add(TEXT("run,grid_size,gap_size,diffuse_amount,viscosity,diffuse_iterations,pressure_iterations,steps,dt,source_rate,planar,half,mac_cormack,cfl_target,")
+		TEXT("steps_done,stable,mean_step_ms,total_density,max_velocity,divergence_rms,pressure_residual_rms,active_min_x,active_min_y,active_min_z,active_max_x,active_max_y,active_max_z"));
+	int numUnstable{};
+	for (int runIdx{}; runIdx < runs.Num(); ++runIdx)
+	{
+		const FSweepRun& run = runs[runIdx];
+		const FC_SolverStats& stats = run.m_Stats;
+		numUnstable += run.m_bIsStable ? 0 : 1;
+
+		lines.Add(FString::Printf(TEXT("%d,%d,%g,%g,%g,%d,%d,%d,%g,%g,%d,%d,%d,%g,%d,%d,%.4f,%g,%g,%g,%g,%d,%d,%d,%d,%d,%d"), runIdx,
+			run.m_GridSize, run.m_GapSize, run.m_DiffuseAmount, run.m_Viscosity, run.m_DiffuseIterations, run.m_PressureIterations, run.m_Steps, run.m_Dt,
+			run.m_SourceRate, run.m_bPlanar, run.m_bHalf, run.m_bMacCormack, run.m_CflTarget, run.m_StepsDone, run.m_bIsStable, run.m_MeanStepMs, stats.m_TotalDensity, stats.m_MaxVelocity,
+			stats.m_DivergenceRms, stats.m_PressureResidualRms, stats.m_ActiveMin.X, stats.m_ActiveMin.Y, stats.m_ActiveMin.Z, stats.m_ActiveMax.X, stats.m_ActiveMax.Y, stats.m_ActiveMax.Z));
+	}
+
+	const FString summaryPath = FPaths::Combine(outDirectory, TEXT("summary.csv"));
+	if (!FFileHelper::SaveStringArrayToFile(lines, *summaryPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to write %s, FluidSweepCommandlet/Main"), *summaryPath);
+		return 1;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Swept %d runs in %.1f s, %d unstable, summary in %s"), runs.Num(), FPlatformTime::Seconds() - startTime, numUnstable, *summaryPath);
+	return 0;
+}
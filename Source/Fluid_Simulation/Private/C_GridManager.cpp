@@ -2,7 +2,12 @@
 
 
 #include "C_GridManager.h"
+#include "C_FluidStats.h"
+#include "C_SolverAutotuner.h"
+#include "C_SolverCrossCheck.h"
 #include "C_PointVector.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
 
 // Sets default values
 AC_GridManager::AC_GridManager()
@@ -10,1158 +15,497 @@ AC_GridManager::AC_GridManager()
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
 
+	//Every client simulates the whole domain, so every client gets the packets, BeginPlay turns replication on only if they're sent
+	bAlwaysRelevant = true;
 }
 
 // Called when the game starts or when spawned
 void AC_GridManager::BeginPlay()
 {
 	Super::BeginPlay();
+
+	//Only the server decides, a client that sets it on its own copy only gets a warning
+	if (HasAuthority())
+	{
+		SetReplicates(m_bReplicateFields);
+	}
 	
 	Populate();
+	ApplyQualityLevel();
 }
 
 void AC_GridManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	m_pPointVectors.Empty();
+	m_pPointVectorPool.Empty();
+
+	m_Exporter.Close();
+
+	FScopeLock lock{ &m_SnapshotLock };
+	m_pSnapshot.Reset();
+	m_pSpareSnapshot.Reset();
 }
 
 void AC_GridManager::Populate()
 {
-	if (!GetWorld())
+	//A planar solver ignores everything the autotuner picks but the thread count, so it keeps its own settings
+	const EC_FieldPrecision precision = m_bUseHalfPrecisionFields ? EC_FieldPrecision::Half : EC_FieldPrecision::Float;
+	if (m_bAutotune && !m_bPlanar)
+	{
+		const FC_SolverConfig config = FC_SolverAutotuner::GetConfig(m_GridSize, m_GapSize, m_bPlanar, precision, m_bForceRetune);
+		m_NumThreads = config.m_NumThreads;
+		m_bUseWorkerTeam = config.m_bUseWorkerTeam;
+		m_bUseTaskGraph = config.m_bUseTaskGraph;
+		m_bUseBlockedSweeps = config.m_bUseBlockedSweeps;
+		m_bUseSpectralPressure = config.m_bUseSpectralPressure;
+	}
+
+	//The solver only needs its buffers, the point vectors follow over the next frames
+	m_Solver.m_bUseHugePages = m_bUseHugePages;
+	m_Solver.m_NumThreads = m_NumThreads;
+	m_Solver.m_bUseWorkerTeam = m_bUseWorkerTeam;
+	m_Solver.m_FieldPrecision = precision;
+	m_Solver.m_bPlanar = m_bPlanar;
+	m_Solver.m_bUseMacCormack = m_bUseMacCormack;
+	m_Solver.m_bCompressDensity = m_bCompressDensity;
+	m_Solver.m_DensityCompression.m_BitsPerValue = m_CompressBitsPerValue;
+	m_Solver.m_DensityCompression.m_Tolerance = m_CompressTolerance;
+	m_Solver.Init(m_GridSize, m_GapSize);
+	ReleasePointVectors();
+	PublishSnapshot();
+
+	m_Exporter.Close();
+	if (m_bExportFields && m_Solver.IsInitialized())
+	{
+		m_Exporter.Open(m_ExportName, *GetSnapshot());
+	}
+
+	m_Tracers.Reset(m_bUseTracers ? m_MaxTracers : 0);
+	m_TracersToEmit = 0.f;
+
+	m_ReplicationEncoder.Reset(m_Solver.GetGridSize(), m_Solver.IsPlanar());
+	m_ReplicationDecoder.Reset(m_Solver.GetGridSize(), m_Solver.IsPlanar());
+	m_ReplicationTimer = 0.f;
+}
+
+#pragma region PointVectors
+
+void AC_GridManager::SpawnPointVectors()
+{
+	FLUID_SCOPE(Visualization);
+	if (!m_bSpawnPointVectors || m_pPointVectors.Num() >= m_Solver.GetNumCells())
 	{
-		UE_LOG(LogTemp, Error, TEXT("Incapable of getting World, GridManager/Populate"));
 		return;
 	}
 
-	m_RealGridSize = m_GridSize + 2; //2 Extra in all directions for boundaries
-	const float worldOffset = (m_RealGridSize * m_GapSize) / 2 - m_GapSize / 2; //Distance to offset around center around 0,0,0
-
-	for (int i{}; i < m_RealGridSize; ++i) //X-loop
+	if (!GetWorld())
 	{
-		for (int j{}; j < m_RealGridSize; ++j) //Y-loop
-		{
-			for (int k{}; k < m_RealGridSize; ++k) //Z-loop
-			{
-				const float x = i * m_GapSize - worldOffset;
-				const float y = j * m_GapSize - worldOffset;
-				const float z = k * m_GapSize - worldOffset;
-				const FVector pos{ x,y,z };
-
-				auto pPointVector = GetWorld()->SpawnActor<AActor>(ActorToSpawn, pos, FRotator::ZeroRotator);
-				m_pPointVectors.Add(pPointVector);
-			}
-		}
+		UE_LOG(LogTemp, Error, TEXT("Incapable of getting World, GridManager/SpawnPointVectors"));
+		return;
 	}
-}
-
-#pragma region Density
-
-void AC_GridManager::HandleDensities(float dt)
-{
-	SwapDensities();
-
-	const float a = dt * m_DiffuseAmount * m_GridSize * m_GridSize;
-	LinearSolveDensities(a);
 
-	SwapDensities();
-	
-	AdVectDensities(dt);
-}
-
-void AC_GridManager::LinearSolveDensities(const float a)
-{
-	for (int iter{}; iter < m_Iterations; ++iter)
+	const int lastIdx = static_cast<int>(FMath::Min<int64>(m_pPointVectors.Num() + m_PointVectorsPerFrame, m_Solver.GetNumCells()));
+	for (int idx{ m_pPointVectors.Num() }; idx < lastIdx; ++idx)
 	{
-		for (int x{ 1 }; x <= m_GridSize; ++x)
+		const FVector pos{ GetCellLocation(idx) };
+
+		AC_PointVector* pPointVector{};
+		if (m_pPointVectorPool.Num() > 0)
 		{
-			for (int y{ 1 }; y <= m_GridSize; ++y)
-			{
-				for (int z{ 1 }; z <= m_GridSize; ++z)
-				{
-					const int idx{ GetIdx(x,y,z) };
-					AC_PointVector* pPointVector = Cast<AC_PointVector>(m_pPointVectors[idx]);
-
-					if (!pPointVector)
-					{
-						continue;
-					}
-
-					const float prevDensity = pPointVector->m_PrevDensity;
-					const float totalNeigborDensities = GetNeighborDensities(x, y, z);
-					
-					pPointVector->m_Density = (prevDensity + totalNeigborDensities * a) / (1 + 6 * a);
-					
-					//if (pPointVector->m_Density > 10.f)
-					//{
-					//	UE_LOG(LogTemp, Warning, TEXT("Density: %s"), *FString::Printf(TEXT("%f"), pPointVector->m_Density));
-					//}
-				}
-			}
+			pPointVector = m_pPointVectorPool.Pop(false);
+			pPointVector->SetActorLocation(pos);
+			pPointVector->SetActorHiddenInGame(false);
+			pPointVector->SetActorTickEnabled(true);
 		}
-		SetBoundsDiffuse();
-	}
-}
-
-void AC_GridManager::AdVectDensities(float dt)
-{
-	const float dt0 = dt * m_GridSize;
-	int i{}, j{}, k{}, i1{}, j1{}, k1{};
-	float x{}, y{}, z{}, s{}, t{}, u{}, s1{}, t1{}, u1{};
-
-	for (int idxX{ 1 }; idxX <= m_GridSize; idxX++)
-	{
-		for (int idxY{ 1 }; idxY <= m_GridSize; idxY++)
+		else
 		{
-			for (int idxZ{ 1 }; idxZ <= m_GridSize; idxZ++)
-			{
-				AC_PointVector* pPointVector = Cast<AC_PointVector>(m_pPointVectors[GetIdx(idxX, idxY, idxZ)]);
-
-				x = AdVectIfChecks(idxX - pPointVector->m_Velocity.X * dt0);
-				y = AdVectIfChecks(idxY - pPointVector->m_Velocity.Y * dt0);
-				z = AdVectIfChecks(idxZ - pPointVector->m_Velocity.Z * dt0);
-
-				i = static_cast<int>(x);
-				i1 = i + 1;
-
-				j = static_cast<int>(y);
-				j1 = j + 1;
-
-				k = static_cast<int>(z);
-				k1 = k + 1;
-
-				s1 = x - i;
-				s = 1.f - s1;
-
-				t1 = y - j;
-				t = 1.f - t1;
-
-				u1 = z - k;
-				u = 1.f - u1;
-
-				//if (pPointVector->m_Density >= 1.f)
-				//{
-				//	float test = s + s1;
-				//}
-
-				pPointVector->m_Density = AdvectPrevDensityCalculations(i, j, k, i1, j1, k1, s, t, u, s1, t1, u1);
-			}
+			pPointVector = Cast<AC_PointVector>(GetWorld()->SpawnActor<AActor>(ActorToSpawn, pos, FRotator::ZeroRotator));
 		}
-	}
-
-	SetBoundsDiffuse();
-}
-
-void AC_GridManager::SwapDensities()
-{
-	for (AActor* pActor : m_pPointVectors)
-	{
-		AC_PointVector* pPointVector = Cast<AC_PointVector>(pActor);
 
-		if (pPointVector)
+		if (!pPointVector)
 		{
-			pPointVector->SwapDensities();
+			UE_LOG(LogTemp, Error, TEXT("ActorToSpawn is not a point vector, GridManager/SpawnPointVectors"));
+			m_bSpawnPointVectors = false;
+			return;
 		}
+
+		m_pPointVectors.Add(pPointVector);
 	}
 }
 
-float AC_GridManager::GetNeighborDensities(int x, int y, int z)
+void AC_GridManager::ReleasePointVectors()
 {
-	float totalNeighborDensities{};
-
-	//if (x == m_GridSize)
-	//{
-	//	std::cout << "Hello\n";
-	//}
-
-	//x-1
-	int neighborIdx{ GetIdx(x - 1, y ,z) };
-	AC_PointVector* pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
-	{
-		totalNeighborDensities += pNeighbor->m_Density;
-	}
-
-	//x+1
-	neighborIdx = GetIdx(x + 1, y ,z);
-	pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
-	{
-		totalNeighborDensities += pNeighbor->m_Density;
-	}
-
-	//y-1
-	neighborIdx = GetIdx(x, y - 1, z);
-	pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
+	for (AC_PointVector* pPointVector : m_pPointVectors)
 	{
-		totalNeighborDensities += pNeighbor->m_Density;
+		pPointVector->SetActorHiddenInGame(true);
+		pPointVector->SetActorTickEnabled(false);
+		m_pPointVectorPool.Add(pPointVector);
 	}
-
-	//y+1
-	neighborIdx = GetIdx(x, y + 1, z);
-	pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
-	{
-		totalNeighborDensities += pNeighbor->m_Density;
-	}
-
-	//z-1
-	neighborIdx = GetIdx(x, y, z - 1);
-	pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
-	{
-		totalNeighborDensities += pNeighbor->m_Density;
-	}
-
-	//z+1
-	neighborIdx = GetIdx(x, y, z + 1);
-	pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
-	{
-		totalNeighborDensities += pNeighbor->m_Density;
-	}
-
-	return totalNeighborDensities;
+	m_pPointVectors.Reset();
 }
 
-void AC_GridManager::SetBoundsDiffuse()
+void AC_GridManager::UpdatePointVectors()
 {
-	//Z-edge
-	for (int x{ 1 }; x <= m_GridSize; ++x)
+	FLUID_SCOPE(Visualization);
+	for (int idx{}; idx < m_pPointVectors.Num(); ++idx)
 	{
-		for (int y{ 1 }; y <= m_GridSize; ++y)
-		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x,y,0)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x,y,1)]);
-
-			pPointVectorEdge->m_Density = pPointVectorNeighbor->m_Density;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, m_GridSize + 1)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, m_GridSize)]);
-
-			pPointVectorEdge->m_Density = pPointVectorNeighbor->m_Density;
-		}
+		m_pPointVectors[idx]->m_Velocity = m_Solver.GetVelocity(idx);
+		m_pPointVectors[idx]->m_Density = m_Solver.GetDensity(idx);
 	}
+}
 
-	//Y-edge
-	for (int x{ 1 }; x <= m_GridSize; ++x)
-	{
-		for (int z{ 1 }; z <= m_GridSize; ++z)
-		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, 0, z)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, 1, z)]);
-
-			pPointVectorEdge->m_Density = pPointVectorNeighbor->m_Density;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, m_GridSize + 1, z)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, m_GridSize, z)]);
-
-			pPointVectorEdge->m_Density = pPointVectorNeighbor->m_Density;
-		}
-	}
-
-	//X-edge
-	for (int y{ 1 }; y <= m_GridSize; ++y)
-	{
-		for (int z{ 1 }; z <= m_GridSize; ++z)
-		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, y, z)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, y, z)]);
-
-			pPointVectorEdge->m_Density = pPointVectorNeighbor->m_Density;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize + 1, y, z)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, y, z)]);
-
-			pPointVectorEdge->m_Density = pPointVectorNeighbor->m_Density;
-		}
-	}
-
-	//====================================================================================================
-	//CORNERS
-	//====================================================================================================
-
-	//(0,0,0)
-	AC_PointVector* pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, 0)]);
-
-	AC_PointVector* pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, 0, 0)]);
-	AC_PointVector* pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 1, 0)]);
-	AC_PointVector* pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, 1)]);
-
-	pPointVectorCorner->m_Density = (pCornerNeighborX->m_Density + pCornerNeighborY->m_Density + pCornerNeighborZ->m_Density) / 3.f;
-
-	//(N-1,0,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, 0	, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize			, 0	, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, 1	, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, 0	, 1)]);
-
-	pPointVectorCorner->m_Density = (pCornerNeighborX->m_Density + pCornerNeighborY->m_Density + pCornerNeighborZ->m_Density) / 3.f;
-
-	//(0,N-1,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0	, m_RealGridSize - 1	, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1	, m_RealGridSize - 1	, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0	, m_GridSize	, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0	, m_RealGridSize - 1	, 1)]);
-
-	pPointVectorCorner->m_Density = (pCornerNeighborX->m_Density + pCornerNeighborY->m_Density + pCornerNeighborZ->m_Density) / 3.f;
-
-	//(0,0,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0	, 0	, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1	, 0	, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0	, 1	, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0	, 0	, m_GridSize)]);
-
-	pPointVectorCorner->m_Density = (pCornerNeighborX->m_Density + pCornerNeighborY->m_Density + pCornerNeighborZ->m_Density) / 3.f;
-
-	//(N-1,N-1,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, m_RealGridSize - 1	, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize			, m_RealGridSize - 1	, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, m_GridSize	, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, m_RealGridSize - 1	, 1)]);
-
-	pPointVectorCorner->m_Density = (pCornerNeighborX->m_Density + pCornerNeighborY->m_Density + pCornerNeighborZ->m_Density) / 3.f;
-
-	//(N-1,0,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, 0,	m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize			, 0,	m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, 1,	m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, 0,	m_GridSize)]);
-
-	pPointVectorCorner->m_Density = (pCornerNeighborX->m_Density + pCornerNeighborY->m_Density + pCornerNeighborZ->m_Density) / 3.f;
-
-	//(0,N-1,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0	, m_RealGridSize - 1	, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1	, m_RealGridSize - 1	, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0	, m_GridSize			, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0	, m_RealGridSize - 1	, m_GridSize)]);
-
-	pPointVectorCorner->m_Density = (pCornerNeighborX->m_Density + pCornerNeighborY->m_Density + pCornerNeighborZ->m_Density) / 3.f;
-
-	//(N-1,N-1,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, m_RealGridSize - 1	, m_RealGridSize - 1)]);
+FVector AC_GridManager::GetCellLocation(int idx) const
+{
+	const int realGridSize = m_Solver.GetRealGridSize();
+	const int realDepth = m_Solver.GetRealDepth();
+	const float worldOffset = (realGridSize * m_GapSize) / 2 - m_GapSize / 2; //Distance to offset around center around 0,0,0
 
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize			, m_RealGridSize - 1	, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, m_GridSize			, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1	, m_RealGridSize - 1	, m_GridSize)]);
+	const int i = idx / (realGridSize * realDepth);
+	const int j = (idx / realDepth) % realGridSize;
+	const int k = idx % realDepth;
 
-	pPointVectorCorner->m_Density = (pCornerNeighborX->m_Density + pCornerNeighborY->m_Density + pCornerNeighborZ->m_Density) / 3.f;
+	//A planar grid lies in the z = 0 plane, which is where its one cell sits in grid coordinates too
+	const float z = m_Solver.IsPlanar() ? 0.f : k * m_GapSize - worldOffset;
+	return FVector{ i * m_GapSize - worldOffset, j * m_GapSize - worldOffset, z };
 }
 
-float AC_GridManager::AdvectPrevDensityCalculations(int i, int j, int k, int i1, int j1, int k1, float s, float t, float u, float s1, float t1, float u1)
-{
-	const float prevDensity1 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i, j, k)])->m_PrevDensity;
-	const float prevDensity2 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i, j, k1)])->m_PrevDensity;
-	const float prevDensity3 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i, j1, k)])->m_PrevDensity;
-	const float prevDensity4 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i, j1, k1)])->m_PrevDensity;
-
-	const float prevDensity5 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i1, j, k)])->m_PrevDensity;
-	const float prevDensity6 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i1, j, k1)])->m_PrevDensity;
-	const float prevDensity7 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i1, j1, k)])->m_PrevDensity;
-	const float prevDensity8 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i1, j1, k1)])->m_PrevDensity;
-
-	const float calc1 = s *	(t * (u * prevDensity1
-								+ u1 * prevDensity2)
-							+ t1 * (u * prevDensity3
-								+ u1 * prevDensity4));
-	const float calc2 = s1 * (t * (u * prevDensity5
-								+ u1 * prevDensity6)
-							+ t1 * (u * prevDensity7
-								+ u1 * prevDensity8));
-
-	return calc1 + calc2;
-}
 #pragma endregion
 
-#pragma region Velocity
+#pragma region Sampling
 
-void AC_GridManager::HandleVelocities(float dt)
+FC_FieldSnapshotPtr AC_GridManager::GetSnapshot() const
 {
-	SwapVelocities();
-
-	const float a = dt * m_Viscosity * m_GridSize * m_GridSize;
-	LinearSolveVelocities(a);
-
-	Project();
-	
-	SwapVelocities();
-	
-	AdVectVelocities(dt);
-	
-	Project();
+	FScopeLock lock{ &m_SnapshotLock };
+	return m_pSnapshot;
 }
 
-void AC_GridManager::LinearSolveVelocities(float a)
+void AC_GridManager::LogStepGraph() const
 {
-	for (int iter{}; iter < m_Iterations; ++iter)
-	{
-		for (int x{ 1 }; x <= m_GridSize; ++x)
-		{
-			for (int y{ 1 }; y <= m_GridSize; ++y)
-			{
-				for (int z{ 1 }; z <= m_GridSize; ++z)
-				{
-					const int idx{ GetIdx(x,y,z) };
-					AC_PointVector* pPointVector = Cast<AC_PointVector>(m_pPointVectors[idx]);
-
-					if (!pPointVector)
-					{
-						continue;
-					}
-
-					const FVector prevVelocity = pPointVector->m_PrevVelocity;
-					const FVector totalNeigborVelocities = GetNeighborVelocities(x, y, z);
-
-					pPointVector->m_Velocity = (prevVelocity + totalNeigborVelocities * a) / (1 + 6 * a);
-				}
-			}
-		}
-		SetBoundsVelocity();
-	}
+	UE_LOG(LogTemp, Display, TEXT("Fluid step graph: %s"), *DescribeStepGraph());
 }
 
-void AC_GridManager::AdVectVelocities(float dt)
+void AC_GridManager::RunCrossCheck() const
 {
-	const float dt0 = dt * m_GridSize;
-	int i{}, j{}, k{}, i1{}, j1{}, k1{};
-	float x{}, y{}, z{}, s{}, t{}, u{}, s1{}, t1{}, u1{};
+	FC_CrossCheckSettings settings{};
+	settings.m_GridSize = m_GridSize;
+	settings.m_GapSize = m_GapSize;
+	settings.m_DiffuseAmount = m_DiffuseAmount;
+	settings.m_Viscosity = m_Viscosity;
+	settings.m_Iterations = m_Iterations;
+	settings.m_bPlanar = m_bPlanar;
+	settings.m_bUseMacCormack = m_bUseMacCormack;
+	settings.m_FieldPrecision = m_bUseHalfPrecisionFields ? EC_FieldPrecision::Half : EC_FieldPrecision::Float;
+	settings.m_NumSteps = m_CrossCheckSteps;
+	settings.m_Tolerance = m_CrossCheckTolerance;
+
+	settings.m_Config.m_NumThreads = m_NumThreads;
+	settings.m_Config.m_bUseWorkerTeam = m_bUseWorkerTeam;
+	settings.m_Config.m_bUseTaskGraph = m_bUseTaskGraph;
+	settings.m_Config.m_bUseBlockedSweeps = m_bUseBlockedSweeps;
+	settings.m_Config.m_bUseSpectralPressure = m_bUseSpectralPressure;
+
+	const FC_CrossCheckReport report = FC_SolverCrossCheck::Run(settings);
+	UE_LOG(LogTemp, Display, TEXT("Fluid %s"), *report.ToString());
+}
 
-	for (int idxX{ 1 }; idxX <= m_GridSize; idxX++)
+void AC_GridManager::SampleFields(const TArray<FVector>& positions, TArray<FVector>& outVelocities, TArray<float>& outDensities) const
+{
+	const FC_FieldSnapshotPtr pSnapshot = GetSnapshot();
+	if (!pSnapshot)
 	{
-		for (int idxY{ 1 }; idxY <= m_GridSize; idxY++)
-		{
-			for (int idxZ{ 1 }; idxZ <= m_GridSize; idxZ++)
-			{
-				AC_PointVector* pPointVector = Cast<AC_PointVector>(m_pPointVectors[GetIdx(idxX, idxY, idxZ)]);
-
-				x = AdVectIfChecks(idxX - pPointVector->m_Velocity.X * dt0);
-				y = AdVectIfChecks(idxY - pPointVector->m_Velocity.Y * dt0);
-				z = AdVectIfChecks(idxZ - pPointVector->m_Velocity.Z * dt0);
-
-				i = static_cast<int>(x);
-				i1 = i + 1;
-
-				j = static_cast<int>(y);
-				j1 = j + 1;
-
-				k = static_cast<int>(z);
-				k1 = k + 1;
-
-				s1 = x - i;
-				s = 1.f - s1;
-
-				t1 = y - j;
-				t = 1.f - t1;
-
-				u1 = z - k;
-				u = 1.f - u1;
-
-				pPointVector->m_Velocity = AdvectPrevVelocityCalculations(i, j, k, i1, j1, k1, s, t, u, s1, t1, u1);
-			}
-		}
+		return;
 	}
 
-	SetBoundsDiffuse();
+	//Blueprint can't pass null, so an empty array means that output isn't wanted
+	const bool wantsVelocity = outVelocities.Num() > 0 || outDensities.Num() == 0;
+	const bool wantsDensity = outDensities.Num() > 0 || outVelocities.Num() == 0;
+	outVelocities.SetNumUninitialized(wantsVelocity ? positions.Num() : 0);
+	outDensities.SetNumUninitialized(wantsDensity ? positions.Num() : 0);
+
+	pSnapshot->Sample(positions, outVelocities, outDensities);
 }
 
-void AC_GridManager::Project()
+void AC_GridManager::PublishSnapshot()
 {
-	const float h = m_GapSize / m_GridSize;
-
-	for (int x{ 1 }; x <= m_GridSize; ++x)
+	FLUID_SCOPE(Snapshot);
+	//Only reuse the spare when nobody else still reads from it
+	if (!m_pSpareSnapshot || !m_pSpareSnapshot.IsUnique())
 	{
-		for (int y{ 1 }; y <= m_GridSize; ++y)
-		{
-			for (int z{ 1 }; z <= m_GridSize; ++z)
-			{
-				SetDivergence(x, y, z, h);
-			}
-		}
+		m_pSpareSnapshot = MakeShared<FC_FieldSnapshot, ESPMode::ThreadSafe>();
 	}
-	SetBoundsDivergence();
-	SetBoundsPressure();
 
-	//m_pPointVectors;
+	const int realGridSize = m_Solver.GetRealGridSize();
+	const float worldOffset = (realGridSize * m_GapSize) / 2 - m_GapSize / 2;
 
-	LinearSolvePressure();
+	FC_FieldSnapshot& snapshot = *m_pSpareSnapshot;
+	snapshot.m_GridSize = m_Solver.GetGridSize();
+	snapshot.m_RealGridSize = realGridSize;
+	snapshot.m_RealDepth = m_Solver.GetRealDepth();
+	snapshot.m_GapSize = m_GapSize;
+	snapshot.m_Origin = FVector{ -worldOffset };
+	snapshot.m_Frame = m_Frame++;
+	//The copies keep the allocation, so a reused snapshot doesn't hit the allocator, and are float whatever the solver stores
+	m_Solver.CopyDensityField(snapshot.m_Density);
+	m_Solver.CopyVelocityFields(snapshot.m_VelocityX, snapshot.m_VelocityY, snapshot.m_VelocityZ);
 
-	SetProjectedVelocities(h);
-
-	for (AActor* pActor : m_pPointVectors)
-	{
-		AC_PointVector* pPointVector = Cast<AC_PointVector>(pActor);
-
-		pPointVector->m_PrevVelocity = pPointVector->m_Velocity;
-	}
+	FScopeLock lock{ &m_SnapshotLock };
+	Swap(m_pSnapshot, m_pSpareSnapshot);
 }
 
-void AC_GridManager::SwapVelocities()
+void AC_GridManager::ExportSnapshot()
 {
-	for (AActor* pActor : m_pPointVectors)
+	FLUID_SCOPE(Snapshot);
+	if (!m_Exporter.IsOpen())
 	{
-		AC_PointVector* pPointVector = Cast<AC_PointVector>(pActor);
-
-		if (pPointVector)
-		{
-			pPointVector->SwapVelocities();
-		}
+		return;
 	}
+
+	//The exporter copies on a background task from the published snapshot, the solver itself is never touched
+	m_Exporter.Publish(GetSnapshot());
+	m_ExportsSkipped = m_Exporter.GetNumSkipped();
 }
 
-FVector AC_GridManager::GetNeighborVelocities(int x, int y, int z)
+void AC_GridManager::ReplicateFields(float dt)
 {
-	FVector totalNeighborVelocities{0.f,0.f,0.f};
-
-	//x-1
-	int neighborIdx{ GetIdx(x - 1, y ,z) };
-	AC_PointVector* pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
+	FLUID_SCOPE(Replication);
+	m_ReplicatedBytesTime += dt;
+	if (m_ReplicatedBytesTime >= 1.f)
 	{
-		totalNeighborVelocities += pNeighbor->m_Velocity;
+		m_ReplicatedBytesPerSecond = m_ReplicatedBytes / m_ReplicatedBytesTime;
+		m_ReplicatedBytes = 0;
+		m_ReplicatedBytesTime = 0.f;
 	}
 
-	//x+1
-	neighborIdx = GetIdx(x + 1, y, z);
-	pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
+	if (IsReplicatedClient())
 	{
-		totalNeighborVelocities += pNeighbor->m_Velocity;
+		m_ReplicationDecoder.Blend(m_Solver, dt, m_ReplicationBlendTime);
+		return;
 	}
 
-	//y-1
-	neighborIdx = GetIdx(x, y - 1, z);
-	pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
+	if (!m_bReplicateFields || !HasAuthority() || GetNetMode() == NM_Standalone || !m_pSnapshot)
 	{
-		totalNeighborVelocities += pNeighbor->m_Velocity;
+		return;
 	}
 
-	//y+1
-	neighborIdx = GetIdx(x, y + 1, z);
-	pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
+	m_ReplicationTimer += dt;
+	const float sendInterval = 1.f / FMath::Max(m_ReplicationSendRate, KINDA_SMALL_NUMBER);
+	if (m_ReplicationTimer < sendInterval)
 	{
-		totalNeighborVelocities += pNeighbor->m_Velocity;
+		return;
 	}
+	m_ReplicationTimer = FMath::Fmod(m_ReplicationTimer, sendInterval);
 
-	//z-1
-	neighborIdx = GetIdx(x, y, z - 1);
-	pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
+	//Players' pawns are the focus, the bricks around them go out first
+	const FC_FieldSnapshotPtr pSnapshot = GetSnapshot();
+	TArray<FVector, TInlineAllocator<16>> focusPoints{};
+	for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it)
 	{
-		totalNeighborVelocities += pNeighbor->m_Velocity;
+		const APlayerController* pController = it->Get();
+		if (pController && pController->GetPawn())
+		{
+			focusPoints.Add(pSnapshot->WorldToGrid(pController->GetPawn()->GetActorLocation()));
+		}
 	}
 
-	//z+1
-	neighborIdx = GetIdx(x, y, z + 1);
-	pNeighbor = Cast<AC_PointVector>(m_pPointVectors[neighborIdx]);
-	if (pNeighbor)
+	FC_ReplicationSettings settings{};
+	settings.m_BytesPerSecond = m_ReplicationBytesPerSecond;
+	settings.m_SendRate = m_ReplicationSendRate;
+	settings.m_KeyframeInterval = m_ReplicationKeyframeInterval;
+	settings.m_MaxDensity = m_ReplicationMaxDensity;
+	settings.m_MaxVelocity = m_ReplicationMaxVelocity;
+
+	TArray<uint8> packet{};
+	m_ReplicationEncoder.Encode(*pSnapshot, settings, focusPoints, GetWorld()->GetTimeSeconds(), packet);
+	if (packet.Num() > 0)
 	{
-		totalNeighborVelocities += pNeighbor->m_Velocity;
+		m_ReplicatedBytes += packet.Num();
+		MulticastFieldPacket(packet);
 	}
+}
 
-	return totalNeighborVelocities;
+bool AC_GridManager::IsReplicatedClient() const
+{
+	return m_bReplicateFields && GetNetMode() == NM_Client;
 }
 
-void AC_GridManager::SetBoundsVelocity()
+void AC_GridManager::MulticastFieldPacket_Implementation(const TArray<uint8>& packet)
 {
-	//Z-edge
-	for (int x{ 1 }; x <= m_GridSize; ++x)
+	//Multicasts run on the server as well
+	if (!IsReplicatedClient() || !m_Solver.IsInitialized())
 	{
-		for (int y{ 1 }; y <= m_GridSize; ++y)
-		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, 0)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, 1)]);
-
-			pPointVectorEdge->m_Velocity.X = pPointVectorNeighbor->m_Velocity.X;
-			pPointVectorEdge->m_Velocity.Y = pPointVectorNeighbor->m_Velocity.Y;
-			pPointVectorEdge->m_Velocity.Z = -pPointVectorNeighbor->m_Velocity.Z;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, m_GridSize + 1)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, m_GridSize)]);
-
-			pPointVectorEdge->m_Velocity.X = pPointVectorNeighbor->m_Velocity.X;
-			pPointVectorEdge->m_Velocity.Y = pPointVectorNeighbor->m_Velocity.Y;
-			pPointVectorEdge->m_Velocity.Z = -pPointVectorNeighbor->m_Velocity.Z;
-		}
+		return;
 	}
 
-	//Y-edge
-	for (int x{ 1 }; x <= m_GridSize; ++x)
+	FLUID_SCOPE(Replication);
+	m_ReplicatedBytes += packet.Num();
+	if (!m_ReplicationDecoder.Decode(packet))
 	{
-		for (int z{ 1 }; z <= m_GridSize; ++z)
-		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, 0, z)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, 1, z)]);
-
-			pPointVectorEdge->m_Velocity.X = pPointVectorNeighbor->m_Velocity.X;
-			pPointVectorEdge->m_Velocity.Y = -pPointVectorNeighbor->m_Velocity.Y;
-			pPointVectorEdge->m_Velocity.Z = pPointVectorNeighbor->m_Velocity.Z;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, m_GridSize + 1, z)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, m_GridSize, z)]);
-
-			pPointVectorEdge->m_Velocity.X = pPointVectorNeighbor->m_Velocity.X;
-			pPointVectorEdge->m_Velocity.Y = -pPointVectorNeighbor->m_Velocity.Y;
-			pPointVectorEdge->m_Velocity.Z = pPointVectorNeighbor->m_Velocity.Z;
-		}
+		UE_LOG(LogTemp, Warning, TEXT("Dropped a field packet of %d bytes, the grid settings have to match the server's, GridManager/MulticastFieldPacket"), packet.Num());
 	}
+}
 
-	//X-edge
-	for (int y{ 1 }; y <= m_GridSize; ++y)
+void AC_GridManager::UpdateTracers(float dt)
+{
+	FLUID_SCOPE(Tracers);
+	if (!m_bUseTracers || !m_pSnapshot)
 	{
-		for (int z{ 1 }; z <= m_GridSize; ++z)
-		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, y, z)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, y, z)]);
-
-			pPointVectorEdge->m_Velocity.X = -pPointVectorNeighbor->m_Velocity.X;
-			pPointVectorEdge->m_Velocity.Y = pPointVectorNeighbor->m_Velocity.Y;
-			pPointVectorEdge->m_Velocity.Z = pPointVectorNeighbor->m_Velocity.Z;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize + 1, y, z)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, y, z)]);
-
-			pPointVectorEdge->m_Velocity.X = -pPointVectorNeighbor->m_Velocity.X;
-			pPointVectorEdge->m_Velocity.Y = pPointVectorNeighbor->m_Velocity.Y;
-			pPointVectorEdge->m_Velocity.Z = pPointVectorNeighbor->m_Velocity.Z;
-		}
+		return;
 	}
 
-	//====================================================================================================
-	//CORNERS
-	//====================================================================================================
-
-	//(0,0,0)
-	AC_PointVector* pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, 0)]);
-
-	AC_PointVector* pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, 0, 0)]);
-	AC_PointVector* pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 1, 0)]);
-	AC_PointVector* pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, 1)]);
-
-	pPointVectorCorner->m_Velocity = (pCornerNeighborX->m_Velocity + pCornerNeighborY->m_Velocity + pCornerNeighborZ->m_Velocity) / 3.f;
-
-	//(N-1,0,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, 0, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 1, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, 1)]);
-
-	pPointVectorCorner->m_Velocity = (pCornerNeighborX->m_Velocity + pCornerNeighborY->m_Velocity + pCornerNeighborZ->m_Velocity) / 3.f;
-
-	//(0,N-1,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, m_RealGridSize - 1, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_GridSize, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, 1)]);
-
-	pPointVectorCorner->m_Velocity = (pCornerNeighborX->m_Velocity + pCornerNeighborY->m_Velocity + pCornerNeighborZ->m_Velocity) / 3.f;
-
-	//(0,0,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, 0, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 1, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, m_GridSize)]);
-
-	pPointVectorCorner->m_Velocity = (pCornerNeighborX->m_Velocity + pCornerNeighborY->m_Velocity + pCornerNeighborZ->m_Velocity) / 3.f;
-
-	//(N-1,N-1,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, m_RealGridSize - 1, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_GridSize, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, 1)]);
-
-	pPointVectorCorner->m_Velocity = (pCornerNeighborX->m_Velocity + pCornerNeighborY->m_Velocity + pCornerNeighborZ->m_Velocity) / 3.f;
-
-	//(N-1,0,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, 0, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 1, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, m_GridSize)]);
-
-	pPointVectorCorner->m_Velocity = (pCornerNeighborX->m_Velocity + pCornerNeighborY->m_Velocity + pCornerNeighborZ->m_Velocity) / 3.f;
-
-	//(0,N-1,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, m_RealGridSize - 1, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_GridSize, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, m_GridSize)]);
-
-	pPointVectorCorner->m_Velocity = (pCornerNeighborX->m_Velocity + pCornerNeighborY->m_Velocity + pCornerNeighborZ->m_Velocity) / 3.f;
-
-	//(N-1,N-1,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, m_RealGridSize - 1)]);
+	//Fractional emission carries over so low rates still emit
+	m_TracersToEmit += m_TracersPerSecond * dt;
+	const int numToEmit = FMath::FloorToInt(m_TracersToEmit);
+	m_TracersToEmit -= numToEmit;
 
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, m_RealGridSize - 1, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_GridSize, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, m_GridSize)]);
-
-	pPointVectorCorner->m_Velocity = (pCornerNeighborX->m_Velocity + pCornerNeighborY->m_Velocity + pCornerNeighborZ->m_Velocity) / 3.f;
+	const float gridCenter = (m_Solver.GetRealGridSize() - 1) * 0.5f;
+	m_Tracers.EmitSphere(numToEmit, FVector{ gridCenter }, m_TracerEmitRadius * m_GridSize, m_TracerLifetime);
+	m_Tracers.Advect(*m_pSnapshot, dt);
 }
 
-FVector AC_GridManager::AdvectPrevVelocityCalculations(int i, int j, int k, int i1, int j1, int k1, float s, float t, float u, float s1, float t1, float u1)
-{
-	const FVector prevDensity1 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i, j, k)])->m_PrevVelocity;
-	const FVector prevDensity2 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i, j, k1)])->m_PrevVelocity;
-	const FVector prevDensity3 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i, j1, k)])->m_PrevVelocity;
-	const FVector prevDensity4 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i, j1, k1)])->m_PrevVelocity;
-
-	const FVector prevDensity5 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i1, j, k)])->m_PrevVelocity;
-	const FVector prevDensity6 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i1, j, k1)])->m_PrevVelocity;
-	const FVector prevDensity7 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i1, j1, k)])->m_PrevVelocity;
-	const FVector prevDensity8 = Cast<AC_PointVector>(m_pPointVectors[GetIdx(i1, j1, k1)])->m_PrevVelocity;
-
-	const FVector calc1 = s * (t * (u * prevDensity1
-									+ u1 * prevDensity2)
-							+ t1 * (u * prevDensity3
-									+ u1 * prevDensity4));
-	const FVector calc2 = s1 * (t * (u * prevDensity5
-									+ u1 * prevDensity6)
-								+ t1 * (u * prevDensity7
-									+ u1 * prevDensity8));
-
-	return calc1 + calc2;
-}
+#pragma endregion
 
-void AC_GridManager::SetDivergence(int x, int y, int z, float h)
+// Called every frame
+void AC_GridManager::Tick(float DeltaTime)
 {
-	//Set divergence in the y value of the previous velocity, keep x empty for pressure later
-	//X
-	float equationVelX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x + 1, y, z)])->m_Velocity.X;
-	equationVelX -= Cast<AC_PointVector>(m_pPointVectors[GetIdx(x - 1, y, z)])->m_Velocity.X;
-
-	//Y
-	float equationVelY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y + 1, z)])->m_Velocity.Y;
-	equationVelY -= Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y - 1, z)])->m_Velocity.Y;
-
-	//Z
-	float equationVelZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, z + 1)])->m_Velocity.Z;
-	equationVelZ -= Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, z - 1)])->m_Velocity.Z;
-
-	const float divergence = (equationVelX + equationVelY + equationVelZ) * -0.5f * h;
-
-	const FVector prevVel{ Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, z)])->m_PrevVelocity };
-
-	FVector newPrevVel{ 0, divergence, prevVel.Z };
-	Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, z)])->m_PrevVelocity = newPrevVel;
-}
+	Super::Tick(DeltaTime);
 
-void AC_GridManager::SetBoundsDivergence()
-{
-	//Z-edge
-	for (int x{ 1 }; x <= m_GridSize; ++x)
+	if (!m_Solver.IsInitialized())
 	{
-		for (int y{ 1 }; y <= m_GridSize; ++y)
-		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, 0)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, 1)]);
-
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, m_GridSize + 1)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, m_GridSize)]);
-
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
-		}
+		return;
 	}
 
-	//Y-edge
-	for (int x{ 1 }; x <= m_GridSize; ++x)
-	{
-		for (int z{ 1 }; z <= m_GridSize; ++z)
-		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, 0, z)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, 1, z)]);
-
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
+	FLUID_SCOPE(Tick);
 
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, m_GridSize + 1, z)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, m_GridSize, z)]);
+	const double startTime = FPlatformTime::Seconds();
 
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
-		}
-	}
+	//Substep size always respects the CFL target, anything past m_MaxSubsteps or the budget gets dropped
+	const int substeps = m_Solver.GetSubstepCount(DeltaTime, m_CflTarget);
+	const float substepDt = DeltaTime / substeps;
+	const int maxSubsteps = FMath::Min(substeps, FMath::Max(m_MaxSubsteps, 1));
 
-	//X-edge
-	for (int y{ 1 }; y <= m_GridSize; ++y)
+	int doneSubsteps{};
+	double elapsedMs{};
+	while (doneSubsteps < maxSubsteps)
 	{
-		for (int z{ 1 }; z <= m_GridSize; ++z)
+		//Always do one substep, after that only start one if it still fits in the budget
+		const double averageMs = doneSubsteps > 0 ? elapsedMs / doneSubsteps : 0.0;
+		if (doneSubsteps > 0 && elapsedMs + averageMs > m_FrameBudgetMs)
 		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, y, z)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, y, z)]);
-
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize + 1, y, z)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, y, z)]);
-
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
+			break;
 		}
-	}
-
-	//====================================================================================================
-	//CORNERS
-	//====================================================================================================
-
-	//(0,0,0)
-	AC_PointVector* pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, 0)]);
-
-	AC_PointVector* pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, 0, 0)]);
-	AC_PointVector* pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 1, 0)]);
-	AC_PointVector* pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, 1)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{	pPointVectorCorner->m_PrevVelocity.X,
-													(pCornerNeighborX->m_PrevVelocity.Y + pCornerNeighborY->m_PrevVelocity.Y + pCornerNeighborZ->m_PrevVelocity.Y) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(N-1,0,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, 0, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 1, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, 1)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ pPointVectorCorner->m_PrevVelocity.X,
-													(pCornerNeighborX->m_PrevVelocity.Y + pCornerNeighborY->m_PrevVelocity.Y + pCornerNeighborZ->m_PrevVelocity.Y) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(0,N-1,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, m_RealGridSize - 1, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_GridSize, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, 1)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ pPointVectorCorner->m_PrevVelocity.X,
-													(pCornerNeighborX->m_PrevVelocity.Y + pCornerNeighborY->m_PrevVelocity.Y + pCornerNeighborZ->m_PrevVelocity.Y) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Z };
 
-	//(0,0,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, 0, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 1, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, m_GridSize)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ pPointVectorCorner->m_PrevVelocity.X,
-													(pCornerNeighborX->m_PrevVelocity.Y + pCornerNeighborY->m_PrevVelocity.Y + pCornerNeighborZ->m_PrevVelocity.Y) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(N-1,N-1,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, m_RealGridSize - 1, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_GridSize, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, 1)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ pPointVectorCorner->m_PrevVelocity.X,
-													(pCornerNeighborX->m_PrevVelocity.Y + pCornerNeighborY->m_PrevVelocity.Y + pCornerNeighborZ->m_PrevVelocity.Y) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(N-1,0,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, 0, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 1, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, m_GridSize)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ pPointVectorCorner->m_PrevVelocity.X,
-													(pCornerNeighborX->m_PrevVelocity.Y + pCornerNeighborY->m_PrevVelocity.Y + pCornerNeighborZ->m_PrevVelocity.Y) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(0,N-1,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, m_RealGridSize - 1, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_GridSize, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, m_GridSize)]);
+		Step(substepDt);
+		++doneSubsteps;
+		elapsedMs = (FPlatformTime::Seconds() - startTime) * 1000.0;
+	}
 
-	pPointVectorCorner->m_PrevVelocity = FVector{ pPointVectorCorner->m_PrevVelocity.X,
-													(pCornerNeighborX->m_PrevVelocity.Y + pCornerNeighborY->m_PrevVelocity.Y + pCornerNeighborZ->m_PrevVelocity.Y) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Z };
+	const bool wasBehind = m_bFellBehind;
+	m_LastSubsteps = doneSubsteps;
+	m_LastStepMs = static_cast<float>(elapsedMs);
+	m_DroppedTime = (substeps - doneSubsteps) * substepDt;
+	m_bFellBehind = doneSubsteps < substeps;
 
-	//(N-1,N-1,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, m_RealGridSize - 1)]);
+	if (m_bFellBehind && !wasBehind)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Fluid fell behind: %d/%d substeps in %.2f ms, dropped %.4f s"), doneSubsteps, substeps, elapsedMs, m_DroppedTime);
+	}
 
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, m_RealGridSize - 1, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_GridSize, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, m_GridSize)]);
+	UpdateGovernor();
+	ReplicateFields(DeltaTime);
+	PublishSnapshot();
+	ExportSnapshot();
+	UpdateTracers(DeltaTime - m_DroppedTime);
 
-	pPointVectorCorner->m_PrevVelocity = FVector{ pPointVectorCorner->m_PrevVelocity.X,
-													(pCornerNeighborX->m_PrevVelocity.Y + pCornerNeighborY->m_PrevVelocity.Y + pCornerNeighborZ->m_PrevVelocity.Y) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Z };
+	SpawnPointVectors();
+	UpdatePointVectors();
 }
 
-void AC_GridManager::SetBoundsPressure()
+void AC_GridManager::Step(float dt)
 {
-	//Z-edge
-	for (int x{ 1 }; x <= m_GridSize; ++x)
-	{
-		for (int y{ 1 }; y <= m_GridSize; ++y)
-		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, 0)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, 1)]);
-
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, m_GridSize + 1)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, m_GridSize)]);
+	m_Solver.m_DiffuseAmount = m_DiffuseAmount;
+	m_Solver.m_Viscosity = m_Viscosity;
+	m_Solver.m_bUseTaskGraph = m_bUseTaskGraph;
+	m_Solver.m_bUseBlockedSweeps = m_bUseBlockedSweeps;
+	m_Solver.m_bUseSpectralPressure = m_bUseSpectralPressure;
+	m_Solver.m_ActiveDensityThreshold = m_ActiveDensityThreshold;
+
+	//The server's state wins anyway, a client only needs a plausible solve between packets
+	if (IsReplicatedClient())
+	{
+		m_Solver.m_DiffuseIterations = FMath::Min(m_DiffuseIterations, m_ClientIterations);
+		m_Solver.m_PressureIterations = FMath::Min(m_PressureIterations, m_ClientIterations);
+	}
+	m_Solver.Step(dt);
+
+	const FC_SolverStats& stats = m_Solver.GetStats();
+	m_TotalDensity = stats.m_TotalDensity;
+	m_MaxVelocity = stats.m_MaxVelocity;
+	m_DivergenceRms = stats.m_DivergenceRms;
+	m_PressureResidualRms = stats.m_PressureResidualRms;
+	m_bHasActiveCells = stats.m_bHasActiveCells;
+	m_ActiveMin = stats.m_ActiveMin;
+	m_ActiveMax = stats.m_ActiveMax;
+}
 
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
-		}
-	}
+void AC_GridManager::UpdateGovernor()
+{
+	//Smooth the cost so a single spike doesn't flip the quality
+	constexpr float smoothing{ 0.1f };
+	m_AverageStepMs = FMath::Lerp(m_AverageStepMs, m_LastStepMs, smoothing);
+	++m_FramesSinceQualityChange;
 
-	//Y-edge
-	for (int x{ 1 }; x <= m_GridSize; ++x)
+	if (!m_bUseGovernor)
 	{
-		for (int z{ 1 }; z <= m_GridSize; ++z)
+		if (m_QualityLevel != EQualityLevel::Full)
 		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, 0, z)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, 1, z)]);
-
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, m_GridSize + 1, z)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, m_GridSize, z)]);
-
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
+			m_QualityLevel = EQualityLevel::Full;
+			ApplyQualityLevel();
 		}
+		return;
 	}
 
-	//X-edge
-	for (int y{ 1 }; y <= m_GridSize; ++y)
+	if (m_FramesSinceQualityChange < m_GovernorHoldFrames)
 	{
-		for (int z{ 1 }; z <= m_GridSize; ++z)
-		{
-			AC_PointVector* pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, y, z)]);
-			AC_PointVector* pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, y, z)]);
-
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
-
-			pPointVectorEdge = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize + 1, y, z)]);
-			pPointVectorNeighbor = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, y, z)]);
-
-			pPointVectorEdge->m_PrevVelocity = pPointVectorNeighbor->m_PrevVelocity;
-		}
+		return;
 	}
 
-	//====================================================================================================
-	//CORNERS
-	//====================================================================================================
-
-	//(0,0,0)
-	AC_PointVector* pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, 0)]);
-
-	AC_PointVector* pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, 0, 0)]);
-	AC_PointVector* pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 1, 0)]);
-	AC_PointVector* pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, 1)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ (pCornerNeighborX->m_PrevVelocity.X + pCornerNeighborY->m_PrevVelocity.X + pCornerNeighborZ->m_PrevVelocity.X) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Y,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(N-1,0,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, 0, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 1, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, 1)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ (pCornerNeighborX->m_PrevVelocity.X + pCornerNeighborY->m_PrevVelocity.X + pCornerNeighborZ->m_PrevVelocity.X) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Y,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(0,N-1,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, m_RealGridSize - 1, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_GridSize, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, 1)]);
+	//Falling behind counts as over budget, the substep loop already capped the measured cost
+	const bool isOverBudget = m_bFellBehind || m_AverageStepMs > m_GovernorTargetMs;
+	const bool hasHeadroom = !m_bFellBehind && m_AverageStepMs < m_GovernorTargetMs * m_GovernorRestoreFraction;
 
-	pPointVectorCorner->m_PrevVelocity = FVector{ (pCornerNeighborX->m_PrevVelocity.X + pCornerNeighborY->m_PrevVelocity.X + pCornerNeighborZ->m_PrevVelocity.X) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Y,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(0,0,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, 0, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 1, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, 0, m_GridSize)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ (pCornerNeighborX->m_PrevVelocity.X + pCornerNeighborY->m_PrevVelocity.X + pCornerNeighborZ->m_PrevVelocity.X) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Y,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(N-1,N-1,0)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, 0)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, m_RealGridSize - 1, 0)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_GridSize, 0)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, 1)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ (pCornerNeighborX->m_PrevVelocity.X + pCornerNeighborY->m_PrevVelocity.X + pCornerNeighborZ->m_PrevVelocity.X) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Y,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(N-1,0,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, 0, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 1, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, 0, m_GridSize)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ (pCornerNeighborX->m_PrevVelocity.X + pCornerNeighborY->m_PrevVelocity.X + pCornerNeighborZ->m_PrevVelocity.X) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Y,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(0,N-1,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(1, m_RealGridSize - 1, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_GridSize, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(0, m_RealGridSize - 1, m_GridSize)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ (pCornerNeighborX->m_PrevVelocity.X + pCornerNeighborY->m_PrevVelocity.X + pCornerNeighborZ->m_PrevVelocity.X) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Y,
-													pPointVectorCorner->m_PrevVelocity.Z };
-
-	//(N-1,N-1,N-1)
-	pPointVectorCorner = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, m_RealGridSize - 1)]);
-
-	pCornerNeighborX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_GridSize, m_RealGridSize - 1, m_RealGridSize - 1)]);
-	pCornerNeighborY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_GridSize, m_RealGridSize - 1)]);
-	pCornerNeighborZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(m_RealGridSize - 1, m_RealGridSize - 1, m_GridSize)]);
-
-	pPointVectorCorner->m_PrevVelocity = FVector{ (pCornerNeighborX->m_PrevVelocity.X + pCornerNeighborY->m_PrevVelocity.X + pCornerNeighborZ->m_PrevVelocity.X) / 3.f,
-													pPointVectorCorner->m_PrevVelocity.Y,
-													pPointVectorCorner->m_PrevVelocity.Z };
-}
-
-void AC_GridManager::LinearSolvePressure()
-{
-	for (int iter{}; iter < m_Iterations; ++iter)
+	int newQualityLevel{ m_QualityLevel };
+	if (isOverBudget && m_QualityLevel < EQualityLevel::Count - 1)
 	{
-		for (int x{ 1 }; x <= m_GridSize; ++x)
-		{
-			for (int y{ 1 }; y <= m_GridSize; ++y)
-			{
-				for (int z{ 1 }; z <= m_GridSize; ++z)
-				{
-					const int idx{ GetIdx(x,y,z) };
-					AC_PointVector* pPointVector = Cast<AC_PointVector>(m_pPointVectors[idx]);
-
-					//if (idx == 176)
-					//{
-					//	std::cout << "Test\n";
-					//}
-
-					if (!pPointVector)
-					{
-						continue;
-					}
-
-					float totalPrevVelFloat = pPointVector->m_PrevVelocity.Y; //Get div
-					//Add neighbor pressures
-					//X
-					totalPrevVelFloat += Cast<AC_PointVector>(m_pPointVectors[GetIdx(x + 1, y, z)])->m_PrevVelocity.X;
-					totalPrevVelFloat += Cast<AC_PointVector>(m_pPointVectors[GetIdx(x - 1, y, z)])->m_PrevVelocity.X;
-
-					//Y
-					totalPrevVelFloat += Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y + 1, z)])->m_PrevVelocity.X;
-					totalPrevVelFloat += Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y - 1, z)])->m_PrevVelocity.X;
-
-					//Z
-					totalPrevVelFloat += Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, z + 1)])->m_PrevVelocity.X;
-					totalPrevVelFloat += Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, z - 1)])->m_PrevVelocity.X;
-
-					pPointVector->m_PrevVelocity.X = totalPrevVelFloat / 6.f;												
-				}
-			}
-		}
-		SetBoundsPressure();
+		++newQualityLevel;
 	}
-}
-
-void AC_GridManager::SetProjectedVelocities(float h)
-{
-	for (int x{ 1 }; x <= m_GridSize; ++x)
+	else if (hasHeadroom && m_QualityLevel > EQualityLevel::Full)
 	{
-		for (int y{ 1 }; y <= m_GridSize; ++y)
-		{
-			for (int z{ 1 }; z <= m_GridSize; ++z)
-			{
-				const int idx{ GetIdx(x,y,z) };
-
-				AC_PointVector* pPointVector = Cast<AC_PointVector>(m_pPointVectors[idx]);
-
-				//X
-				float equationVelX = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x + 1, y, z)])->m_PrevVelocity.X;
-				equationVelX -= Cast<AC_PointVector>(m_pPointVectors[GetIdx(x - 1, y, z)])->m_PrevVelocity.X;
-				equationVelX *= -0.5f;
-				equationVelX /= h;
-
-				//Y
-				float equationVelY = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y + 1, z)])->m_PrevVelocity.X;
-				equationVelY -= Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y - 1, z)])->m_PrevVelocity.X;
-				equationVelY *= -0.5f;
-				equationVelY /= h;
-
-				//Z
-				float equationVelZ = Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, z + 1)])->m_PrevVelocity.X;
-				equationVelZ -= Cast<AC_PointVector>(m_pPointVectors[GetIdx(x, y, z - 1)])->m_PrevVelocity.X;
-				equationVelZ *= -0.5f;
-				equationVelZ /= h;
-
-				pPointVector->m_Velocity.X -= equationVelX;
-				pPointVector->m_Velocity.Y -= equationVelY;
-				pPointVector->m_Velocity.Z -= equationVelZ;
-			}
-		}
+		--newQualityLevel;
 	}
-	SetBoundsVelocity();
-}
-
-#pragma endregion
 
-#pragma region Helpers
+	if (newQualityLevel == m_QualityLevel)
+	{
+		return;
+	}
 
-int AC_GridManager::GetIdx(int x, int y, int z)
-{
-	int xIdx = x * m_RealGridSize * m_RealGridSize;
-	int yIdx = y * m_RealGridSize;
-	int zIdx = z;
+	UE_LOG(LogTemp, Log, TEXT("Fluid governor: quality %d -> %d (average step %.2f ms, target %.2f ms)"), m_QualityLevel, newQualityLevel, m_AverageStepMs, m_GovernorTargetMs);
 
-	return xIdx + yIdx + zIdx;
+	m_QualityLevel = newQualityLevel;
+	++m_QualityChanges;
+	ApplyQualityLevel();
 }
 
-float AC_GridManager::AdVectIfChecks(float value)
+void AC_GridManager::ApplyQualityLevel()
 {
-	if (value < 0.5f) value = 0.5f;
-	if (value > m_GridSize + 0.5f) value = m_GridSize + 0.5f;
-
-	return value;
-}
-#pragma endregion
+	//Every level keeps the reductions of the levels above it
+	m_DiffuseIterations = m_QualityLevel >= EQualityLevel::ReducedDiffusion ? FMath::Max(m_Iterations / 2, 1) : m_Iterations;
+	m_PressureIterations = m_QualityLevel >= EQualityLevel::ReducedPressure ? FMath::Max(m_Iterations / 2, 1) : m_Iterations;
+	m_bSkipDensityDiffusion = m_QualityLevel >= EQualityLevel::NoDensityDiffusion;
 
-// Called every frame
-void AC_GridManager::Tick(float DeltaTime)
-{
-	Super::Tick(DeltaTime);
+	m_Solver.m_DiffuseIterations = m_DiffuseIterations;
+	m_Solver.m_PressureIterations = m_PressureIterations;
+	m_Solver.m_bSkipDensityDiffusion = m_bSkipDensityDiffusion;
 
-	HandleVelocities(DeltaTime);
-	HandleDensities(DeltaTime);
+	m_FramesSinceQualityChange = 0;
 }
 
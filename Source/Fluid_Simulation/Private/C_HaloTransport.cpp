@@ -0,0 +1,343 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_HaloTransport.h"
+
+#include <atomic>
+
+#if PLATFORM_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr int s_MaxRanks{ 64 };
+	constexpr int s_PauseSpins{ 1024 }; //A neighbor that is already sending answers within these
+	constexpr int s_YieldSpins{ 256 };
+	constexpr float s_SleepSeconds{ 50e-6f };
+
+	//Busy waits on a condition with the CPU's pause hint first, FPlatformProcess::Yield stays on the core,
+	//then gives up the time slice and finally sleeps between checks, so with more ranks than cores the waiting ones
+	//don't starve the rank they wait for, a wait that long covers a whole slab of work so the sleeps don't show
+	//Returns false when the condition still doesn't hold after timeoutSeconds, a rank that died never answers
+	template <typename TCondition>
+	bool WaitUntil(TCondition condition, float timeoutSeconds)
+	{
+		const double deadline = FPlatformTime::Seconds() + timeoutSeconds;
+
+		//Saturates once it's sleeping, a rank can wait on a slow neighbor for a long time
+		for (int spinIdx{}; !condition(); spinIdx = FMath::Min(spinIdx + 1, s_PauseSpins + s_YieldSpins))
+		{
+			if (spinIdx < s_PauseSpins)
+			{
+				FPlatformProcess::Yield();
+			}
+			else if (spinIdx < s_PauseSpins + s_YieldSpins)
+			{
+				FPlatformProcess::SleepNoStats(0.f);
+			}
+			else if (FPlatformTime::Seconds() > deadline)
+			{
+				return false;
+			}
+			else
+			{
+				FPlatformProcess::SleepNoStats(s_SleepSeconds);
+			}
+		}
+		return true;
+	}
+}
+
+//Everything in the segment starts zeroed, which is a valid initial state, so no rank has to set it up first
+//That only holds for a fresh segment, which is why rank 0 creates it exclusively
+struct FC_SharedMemoryTransport::FHeader
+{
+	std::atomic<uint32> m_IsAborted;
+	std::atomic<uint32> m_NumAttached;
+	std::atomic<uint32> m_BarrierCount;
+	std::atomic<uint32> m_BarrierGeneration;
+	float m_ReduceValues[s_MaxRanks];
+};
+
+//Sequence is bumped by the sender after writing, Ack by the receiver after reading
+//The sender only overwrites the data once the previous message is acknowledged
+struct FC_SharedMemoryTransport::FMailbox
+{
+	alignas(64) std::atomic<uint64> m_Sequence;
+	alignas(64) std::atomic<uint64> m_Ack;
+};
+
+template <typename TCondition>
+bool FC_SharedMemoryTransport::WaitUnlessAborted(TCondition condition) const
+{
+	const FHeader& header = GetHeader();
+	if (!WaitUntil([&header, &condition]() { return header.m_IsAborted.load(std::memory_order_acquire) != 0 || condition(); }, m_TimeoutSeconds))
+	{
+		//The rank we wait for is gone or stuck, everyone else stops waiting on it too
+		UE_LOG(LogTemp, Error, TEXT("Rank %d got no answer within %.0f s, aborting the job, SharedMemoryTransport/WaitUnlessAborted"), m_Rank, m_TimeoutSeconds);
+		GetHeader().m_IsAborted.store(1, std::memory_order_release);
+	}
+	return !IsAborted();
+}
+
+TUniquePtr<FC_SharedMemoryTransport> FC_SharedMemoryTransport::Create(const FString& jobName, int rank, int numRanks, int sliceFloats, float timeoutSeconds)
+{
+	static_assert(std::atomic<uint64>::is_always_lock_free, "Shared memory atomics have to be lock free to work across processes");
+
+	if (numRanks < 1 || numRanks > s_MaxRanks || rank < 0 || rank >= numRanks || sliceFloats <= 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Invalid rank %d of %d, SharedMemoryTransport/Create"), rank, numRanks);
+		return nullptr;
+	}
+
+#if PLATFORM_LINUX
+	TUniquePtr<FC_SharedMemoryTransport> pTransport{ new FC_SharedMemoryTransport{} };
+	pTransport->m_Name = FString::Printf(TEXT("/FluidHalo_%s"), *jobName);
+	pTransport->m_Rank = rank;
+	pTransport->m_NumRanks = numRanks;
+	pTransport->m_SliceFloats = sliceFloats;
+	pTransport->m_TimeoutSeconds = timeoutSeconds;
+	pTransport->m_Size = Align(sizeof(FHeader), 64) + GetMailboxStride(sliceFloats) * numRanks * 2;
+
+	const FTCHARToUTF8 name{ *pTransport->m_Name };
+	int fileHandle{ -1 };
+	if (rank == 0)
+	{
+		//A segment that already exists isn't zeroed, joining it would mix two jobs
+		fileHandle = shm_open(name.Get(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fileHandle < 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to create %s, it may be left over from an earlier job, SharedMemoryTransport/Create"), *pTransport->m_Name);
+			return nullptr;
+		}
+
+		//Only rank 0 sizes it, the new pages read as zero
+		if (ftruncate(fileHandle, pTransport->m_Size) != 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to size %s, SharedMemoryTransport/Create"), *pTransport->m_Name);
+			close(fileHandle);
+			shm_unlink(name.Get());
+			return nullptr;
+		}
+	}
+	else
+	{
+		//The others may start first, they wait until rank 0 created and sized the segment, mapping it before would fault
+		const SIZE_T size = pTransport->m_Size;
+		const bool bIsCreated = WaitUntil([&fileHandle, &name, size]()
+		{
+			if (fileHandle < 0)
+			{
+				fileHandle = shm_open(name.Get(), O_RDWR, 0600);
+			}
+
+			struct stat status{};
+			return fileHandle >= 0 && fstat(fileHandle, &status) == 0 && static_cast<SIZE_T>(status.st_size) >= size;
+		}, timeoutSeconds);
+
+		if (!bIsCreated)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Rank 0 didn't create %s within %.0f s, SharedMemoryTransport/Create"), *pTransport->m_Name, timeoutSeconds);
+			if (fileHandle >= 0)
+			{
+				close(fileHandle);
+			}
+			return nullptr;
+		}
+	}
+
+	void* pMapped = mmap(nullptr, pTransport->m_Size, PROT_READ | PROT_WRITE, MAP_SHARED, fileHandle, 0);
+	close(fileHandle);
+
+	if (pMapped == MAP_FAILED)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to map %s, SharedMemoryTransport/Create"), *pTransport->m_Name);
+		if (rank == 0)
+		{
+			shm_unlink(name.Get());
+		}
+		return nullptr;
+	}
+
+	pTransport->m_pMemory = static_cast<uint8*>(pMapped);
+
+	//Wait for the whole job before anyone starts sending, the transport is returned even when that fails,
+	//so its destructor still unmaps and unlinks, the caller sees IsAborted
+	FHeader& header = pTransport->GetHeader();
+	header.m_NumAttached.fetch_add(1, std::memory_order_acq_rel);
+	pTransport->WaitUnlessAborted([&header, numRanks]() { return header.m_NumAttached.load(std::memory_order_acquire) >= static_cast<uint32>(numRanks); });
+
+	return pTransport;
+#else
+	UE_LOG(LogTemp, Error, TEXT("Shared memory transport is only supported on Linux, SharedMemoryTransport/Create"));
+	return nullptr;
+#endif
+}
+
+FC_SharedMemoryTransport::~FC_SharedMemoryTransport()
+{
+#if PLATFORM_LINUX
+	if (m_pMemory)
+	{
+		//Nobody may still be reading our mailboxes when the segment goes away, an aborted job has nobody left to wait for
+		if (!IsAborted())
+		{
+			Barrier();
+		}
+		munmap(m_pMemory, m_Size);
+
+		if (m_Rank == 0)
+		{
+			shm_unlink(TCHAR_TO_UTF8(*m_Name));
+		}
+	}
+#endif
+}
+
+void FC_SharedMemoryTransport::ExchangeHalos(TArrayView<const float> sendLow, TArrayView<float> receiveLow, TArrayView<const float> sendHigh, TArrayView<float> receiveHigh)
+{
+	const bool bHasLow = m_Rank > 0;
+	const bool bHasHigh = m_Rank < m_NumRanks - 1;
+
+	//Post both sends first, the neighbors receive them during their own exchange
+	if (bHasLow)
+	{
+		Send(GetMailbox(m_Rank, false), sendLow);
+	}
+	if (bHasHigh)
+	{
+		Send(GetMailbox(m_Rank, true), sendHigh);
+	}
+
+	//The low neighbor sends us its high side and the other way around
+	if (bHasLow)
+	{
+		Receive(GetMailbox(m_Rank - 1, true), m_ReceivedLow, receiveLow);
+	}
+	if (bHasHigh)
+	{
+		Receive(GetMailbox(m_Rank + 1, false), m_ReceivedHigh, receiveHigh);
+	}
+}
+
+float FC_SharedMemoryTransport::AllReduceSum(float value)
+{
+	TArray<float, TInlineAllocator<s_MaxRanks>> values{};
+	values.SetNumUninitialized(m_NumRanks);
+	AllGather(value, values);
+
+	//Same order on every rank, so every rank ends up with the exact same sum
+	float sum{};
+	for (const float rankValue : values)
+	{
+		sum += rankValue;
+	}
+	return sum;
+}
+
+float FC_SharedMemoryTransport::AllReduceMax(float value)
+{
+	TArray<float, TInlineAllocator<s_MaxRanks>> values{};
+	values.SetNumUninitialized(m_NumRanks);
+	AllGather(value, values);
+
+	float maxValue{ values[0] };
+	for (const float rankValue : values)
+	{
+		maxValue = FMath::Max(maxValue, rankValue);
+	}
+	return maxValue;
+}
+
+void FC_SharedMemoryTransport::Barrier()
+{
+	FHeader& header = GetHeader();
+
+	//Sense reversal, the last rank in resets the count and releases the others by bumping the generation
+	const uint32 generation = header.m_BarrierGeneration.load(std::memory_order_acquire);
+	if (header.m_BarrierCount.fetch_add(1, std::memory_order_acq_rel) + 1 == static_cast<uint32>(m_NumRanks))
+	{
+		header.m_BarrierCount.store(0, std::memory_order_relaxed);
+		header.m_BarrierGeneration.fetch_add(1, std::memory_order_release);
+		return;
+	}
+
+	WaitUnlessAborted([&header, generation]() { return header.m_BarrierGeneration.load(std::memory_order_acquire) != generation; });
+}
+
+void FC_SharedMemoryTransport::Abort()
+{
+	GetHeader().m_IsAborted.store(1, std::memory_order_release);
+}
+
+bool FC_SharedMemoryTransport::IsAborted() const
+{
+	return GetHeader().m_IsAborted.load(std::memory_order_acquire) != 0;
+}
+
+SIZE_T FC_SharedMemoryTransport::GetMailboxStride(int sliceFloats)
+{
+	return Align(sizeof(FMailbox) + sliceFloats * sizeof(float), 64);
+}
+
+FC_SharedMemoryTransport::FHeader& FC_SharedMemoryTransport::GetHeader() const
+{
+	return *reinterpret_cast<FHeader*>(m_pMemory);
+}
+
+FC_SharedMemoryTransport::FMailbox& FC_SharedMemoryTransport::GetMailbox(int rank, bool bIsHigh) const
+{
+	const SIZE_T offset = Align(sizeof(FHeader), 64) + GetMailboxStride(m_SliceFloats) * (rank * 2 + (bIsHigh ? 1 : 0));
+	return *reinterpret_cast<FMailbox*>(m_pMemory + offset);
+}
+
+float* FC_SharedMemoryTransport::GetMailboxData(FMailbox& mailbox) const
+{
+	return reinterpret_cast<float*>(reinterpret_cast<uint8*>(&mailbox) + sizeof(FMailbox));
+}
+
+void FC_SharedMemoryTransport::Send(FMailbox& mailbox, TArrayView<const float> data) const
+{
+	check(data.Num() <= m_SliceFloats);
+
+	const uint64 sequence = mailbox.m_Sequence.load(std::memory_order_relaxed);
+	if (!WaitUnlessAborted([&mailbox, sequence]() { return mailbox.m_Ack.load(std::memory_order_acquire) == sequence; }))
+	{
+		return;
+	}
+
+	FMemory::Memcpy(GetMailboxData(mailbox), data.GetData(), data.Num() * sizeof(float));
+	mailbox.m_Sequence.store(sequence + 1, std::memory_order_release);
+}
+
+void FC_SharedMemoryTransport::Receive(FMailbox& mailbox, uint64& receivedCount, TArrayView<float> data) const
+{
+	check(data.Num() <= m_SliceFloats);
+
+	const uint64 expected = receivedCount + 1;
+	if (!WaitUnlessAborted([&mailbox, expected]() { return mailbox.m_Sequence.load(std::memory_order_acquire) >= expected; }))
+	{
+		return;
+	}
+
+	FMemory::Memcpy(data.GetData(), GetMailboxData(mailbox), data.Num() * sizeof(float));
+	mailbox.m_Ack.store(expected, std::memory_order_release);
+	receivedCount = expected;
+}
+
+void FC_SharedMemoryTransport::AllGather(float value, TArrayView<float> outValues)
+{
+	FHeader& header = GetHeader();
+
+	header.m_ReduceValues[m_Rank] = value;
+	Barrier();
+
+	FMemory::Memcpy(outValues.GetData(), header.m_ReduceValues, m_NumRanks * sizeof(float));
+
+	//Nobody may overwrite its slot for the next reduction before everyone read this one
+	Barrier();
+}
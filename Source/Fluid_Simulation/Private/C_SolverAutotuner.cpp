@@ -0,0 +1,176 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_SolverAutotuner.h"
+#include "C_FluidSolver.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	constexpr int s_WarmupSteps{ 2 };
+	constexpr int s_MeasuredSteps{ 5 };
+	constexpr float s_StepDt{ 1.f / 60.f };
+}
+
+void FC_SolverConfig::ApplyTo(FC_FluidSolver& solver) const
+{
+	solver.m_NumThreads = m_NumThreads;
+	solver.m_bUseWorkerTeam = m_bUseWorkerTeam;
+	solver.m_bUseTaskGraph = m_bUseTaskGraph;
+	solver.m_bUseBlockedSweeps = m_bUseBlockedSweeps;
+	solver.m_bUseSpectralPressure = m_bUseSpectralPressure;
+}
+
+FString FC_SolverConfig::ToString() const
+{
+	return FString::Printf(TEXT("%d,%d,%d,%d,%d"), m_NumThreads, m_bUseWorkerTeam, m_bUseTaskGraph, m_bUseBlockedSweeps, m_bUseSpectralPressure);
+}
+
+bool FC_SolverConfig::FromString(const FString& text, FC_SolverConfig& outConfig)
+{
+	TArray<FString> values{};
+	if (text.ParseIntoArray(values, TEXT(",")) != 5)
+	{
+		return false;
+	}
+
+	outConfig.m_NumThreads = FCString::Atoi(*values[0]);
+	outConfig.m_bUseWorkerTeam = FCString::Atoi(*values[1]) != 0;
+	outConfig.m_bUseTaskGraph = FCString::Atoi(*values[2]) != 0;
+	outConfig.m_bUseBlockedSweeps = FCString::Atoi(*values[3]) != 0;
+	outConfig.m_bUseSpectralPressure = FCString::Atoi(*values[4]) != 0;
+	return outConfig.m_NumThreads > 0;
+}
+
+FC_SolverConfig FC_SolverAutotuner::GetConfig(int gridSize, float gapSize, bool bPlanar, EC_FieldPrecision precision, bool bForceRetune)
+{
+	//The scratch solvers below are 3D, timing them says nothing about a planar grid
+	if (bPlanar)
+	{
+		return FC_SolverConfig{};
+	}
+
+	const FString cachePath = GetCachePath();
+	const FString cacheKey = GetCacheKey(gridSize, bPlanar, precision);
+
+	//One "key=config" line per machine, grid size and precision
+	TArray<FString> lines{};
+	FFileHelper::LoadFileToStringArray(lines, *cachePath);
+
+	if (!bForceRetune)
+	{
+		for (const FString& line : lines)
+		{
+			FString key{}, value{};
+			FC_SolverConfig config{};
+			if (line.Split(TEXT("="), &key, &value) && key == cacheKey && FC_SolverConfig::FromString(value, config))
+			{
+				return config;
+			}
+		}
+	}
+
+	//Thread counts from one to all, every execution mode, both sweep layouts and both pressure solvers
+	const int maxThreads = FMath::Clamp(FTaskGraphInterface::Get().GetNumWorkerThreads() + 1, 1, FMath::Max(gridSize, 1));
+	TArray<int> threadCounts{ 1 };
+	for (int numThreads{ 2 }; numThreads < maxThreads; numThreads *= 2)
+	{
+		threadCounts.Add(numThreads);
+	}
+	threadCounts.AddUnique(maxThreads);
+
+	FC_SolverConfig bestConfig{};
+	float bestMs{ TNumericLimits<float>::Max() };
+
+	for (const int numThreads : threadCounts)
+	{
+		for (int mode{}; mode < 3; ++mode)
+		{
+			//The team and the graph only make a difference with more than one thread
+			if (mode > 0 && numThreads == 1)
+			{
+				continue;
+			}
+
+			for (const bool bUseBlockedSweeps : { false, true })
+			{
+				for (const bool bUseSpectralPressure : { false, true })
+				{
+					FC_SolverConfig config{};
+					config.m_NumThreads = numThreads;
+					config.m_bUseWorkerTeam = mode == 1;
+					config.m_bUseTaskGraph = mode == 2;
+					config.m_bUseBlockedSweeps = bUseBlockedSweeps;
+					config.m_bUseSpectralPressure = bUseSpectralPressure;
+
+					const float stepMs = MeasureStepMs(config, gridSize, gapSize, precision);
+					UE_LOG(LogTemp, Log, TEXT("Fluid autotune %s [%s]: %.3f ms"), *cacheKey, *config.ToString(), stepMs);
+
+					if (stepMs < bestMs)
+					{
+						bestMs = stepMs;
+						bestConfig = config;
+					}
+				}
+			}
+		}
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Fluid autotune %s picked [%s] at %.3f ms per step"), *cacheKey, *bestConfig.ToString(), bestMs);
+
+	lines.RemoveAll([&cacheKey](const FString& line) { return line.StartsWith(cacheKey + TEXT("=")); });
+	lines.Add(cacheKey + TEXT("=") + bestConfig.ToString());
+	if (!FFileHelper::SaveStringArrayToFile(lines, *cachePath))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Failed to write %s, SolverAutotuner/GetConfig"), *cachePath);
+	}
+
+	return bestConfig;
+}
+
+FString FC_SolverAutotuner::GetCachePath()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("FluidAutotune.txt"));
+}
+
+FString FC_SolverAutotuner::GetCacheKey(int gridSize, bool bPlanar, EC_FieldPrecision precision)
+{
+	//Anything that can change the answer, the '=' and ',' of the file format are kept out of the CPU name
+	FString cpu = FPlatformMisc::GetCPUBrand().TrimStartAndEnd();
+	cpu.ReplaceCharInline(TEXT('='), TEXT('_'));
+	cpu.ReplaceCharInline(TEXT(','), TEXT('_'));
+
+	//Half cells convert on every load and store, the fastest layout for them isn't the one for float
+	return FString::Printf(TEXT("%s|%d cores|%d workers|%d^%d|%s"), *cpu, FPlatformMisc::NumberOfCoresIncludingHyperthreads(),
+		FTaskGraphInterface::Get().GetNumWorkerThreads(), gridSize, bPlanar ? 2 : 3, precision == EC_FieldPrecision::Half ? TEXT("half") : TEXT("float"));
+}
+
+float FC_SolverAutotuner::MeasureStepMs(const FC_SolverConfig& config, int gridSize, float gapSize, EC_FieldPrecision precision)
+{
+	FC_FluidSolver solver{};
+	config.ApplyTo(solver);
+	solver.m_FieldPrecision = precision;
+	solver.Init(gridSize, gapSize);
+	if (!solver.IsInitialized())
+	{
+		return TNumericLimits<float>::Max();
+	}
+
+	for (int stepIdx{}; stepIdx < s_WarmupSteps; ++stepIdx)
+	{
+		solver.Step(s_StepDt);
+	}
+
+	//Median, one step that gets preempted shouldn't decide
+	TArray<float, TInlineAllocator<s_MeasuredSteps>> stepMs{};
+	for (int stepIdx{}; stepIdx < s_MeasuredSteps; ++stepIdx)
+	{
+		const double startTime = FPlatformTime::Seconds();
+		solver.Step(s_StepDt);
+		stepMs.Add(static_cast<float>((FPlatformTime::Seconds() - startTime) * 1000.0));
+	}
+
+	stepMs.Sort();
+	return stepMs[s_MeasuredSteps / 2];
+}
@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_SolverCrossCheck.h"
+#include "C_FluidSolver.h"
+
+FString FC_CrossCheckReport::ToString() const
+{
+	FString text = FString::Printf(TEXT("Cross-check over %d steps %s"), m_NumSteps, m_bPassed ? TEXT("passed") : TEXT("FAILED"));
+	for (const FC_FieldDifference& difference : m_Fields)
+	{
+		text += FString::Printf(TEXT("\n  %-10s max %g (step %d), rms %g, reference peak %g%s"), *difference.m_Name, difference.m_MaxError, difference.m_WorstStep,
+			difference.m_RmsError, difference.m_PeakReference, difference.m_bPassed ? TEXT("") : TEXT(", over tolerance"));
+	}
+	return text;
+}
+
+FC_CrossCheckReport FC_SolverCrossCheck::Run(const FC_CrossCheckSettings& settings)
+{
+	FC_CrossCheckReport report{};
+
+	FC_FluidSolver reference{};
+	reference.m_NumThreads = 1;
+	reference.m_bUseReferenceKernels = true;
+
+	FC_FluidSolver tested{};
+	settings.m_Config.ApplyTo(tested);
+	tested.m_FieldPrecision = settings.m_FieldPrecision;
+
+	for (FC_FluidSolver* pSolver : { &reference, &tested })
+	{
+		pSolver->m_bPlanar = settings.m_bPlanar;
+		pSolver->m_bUseMacCormack = settings.m_bUseMacCormack;
+		pSolver->m_DiffuseAmount = settings.m_DiffuseAmount;
+		pSolver->m_Viscosity = settings.m_Viscosity;
+		pSolver->m_DiffuseIterations = settings.m_Iterations;
+		pSolver->m_PressureIterations = settings.m_Iterations;
+		pSolver->Init(settings.m_GridSize, settings.m_GapSize);
+		if (!pSolver->IsInitialized())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to init a %d^3 solver, SolverCrossCheck/Run"), settings.m_GridSize);
+			return report;
+		}
+	}
+
+	//Init seeds the same velocity in both, the density gets a cube in the middle like the bake
+	const int gridSize = reference.GetGridSize();
+	const int sourceMin = gridSize / 2 - gridSize / 8;
+	const int sourceMax = gridSize / 2 + gridSize / 8;
+	const int sourceMaxZ = reference.IsPlanar() ? 0 : sourceMax;
+	for (int x{ sourceMin }; x <= sourceMax; ++x)
+	{
+		for (int y{ sourceMin }; y <= sourceMax; ++y)
+		{
+			for (int z{ reference.IsPlanar() ? 0 : sourceMin }; z <= sourceMaxZ; ++z)
+			{
+				reference.AddDensity(reference.GetIdx(x, y, z), 1.f);
+				tested.AddDensity(tested.GetIdx(x, y, z), 1.f);
+			}
+		}
+	}
+
+	const TCHAR* pFieldNames[]{ TEXT("Density"), TEXT("VelocityX"), TEXT("VelocityY"), TEXT("VelocityZ") };
+	constexpr int numFields{ UE_ARRAY_COUNT(pFieldNames) };
+	report.m_Fields.SetNum(numFields);
+	double squares[numFields]{};
+	for (int fieldIdx{}; fieldIdx < numFields; ++fieldIdx)
+	{
+		report.m_Fields[fieldIdx].m_Name = pFieldNames[fieldIdx];
+	}
+
+	TArray<float> referenceFields[numFields]{};
+	TArray<float> testedFields[numFields]{};
+	for (int stepIdx{}; stepIdx < settings.m_NumSteps; ++stepIdx)
+	{
+		reference.Step(settings.m_Dt);
+		tested.Step(settings.m_Dt);
+
+		reference.CopyDensityField(referenceFields[0]);
+		reference.CopyVelocityFields(referenceFields[1], referenceFields[2], referenceFields[3]);
+		tested.CopyDensityField(testedFields[0]);
+		tested.CopyVelocityFields(testedFields[1], testedFields[2], testedFields[3]);
+
+		for (int fieldIdx{}; fieldIdx < numFields; ++fieldIdx)
+		{
+			Compare(referenceFields[fieldIdx], testedFields[fieldIdx], stepIdx, report.m_Fields[fieldIdx], squares[fieldIdx]);
+		}
+	}
+
+	report.m_NumSteps = settings.m_NumSteps;
+	report.m_bPassed = true;
+	const double numValues = static_cast<double>(reference.GetNumCells()) * FMath::Max(settings.m_NumSteps, 1);
+	for (int fieldIdx{}; fieldIdx < numFields; ++fieldIdx)
+	{
+		FC_FieldDifference& difference = report.m_Fields[fieldIdx];
+		difference.m_RmsError = static_cast<float>(FMath::Sqrt(squares[fieldIdx] / numValues));
+
+		//A field that stays near zero, like planar velocity z, is held to the tolerance itself
+		difference.m_bPassed = difference.m_MaxError <= settings.m_Tolerance * FMath::Max(difference.m_PeakReference, 1.f);
+		report.m_bPassed &= difference.m_bPassed;
+	}
+
+	return report;
+}
+
+void FC_SolverCrossCheck::Compare(const TArray<float>& reference, const TArray<float>& tested, int stepIdx, FC_FieldDifference& inOutDifference, double& inOutSquares)
+{
+	check(reference.Num() == tested.Num());
+
+	float maxError{};
+	float peakReference{};
+	bool bHasNaN{};
+	for (int idx{}; idx < reference.Num(); ++idx)
+	{
+		const float error = FMath::Abs(tested[idx] - reference[idx]);
+		if (FMath::IsNaN(error))
+		{
+			bHasNaN = true;
+			continue;
+		}
+
+		maxError = FMath::Max(maxError, error);
+		peakReference = FMath::Max(peakReference, FMath::Abs(reference[idx]));
+		inOutSquares += static_cast<double>(error) * error;
+	}
+
+	//A NaN on either side is never within tolerance
+	if (bHasNaN)
+	{
+		maxError = TNumericLimits<float>::Max();
+	}
+
+	if (maxError > inOutDifference.m_MaxError)
+	{
+		inOutDifference.m_MaxError = maxError;
+		inOutDifference.m_WorstStep = stepIdx;
+	}
+	inOutDifference.m_PeakReference = FMath::Max(inOutDifference.m_PeakReference, peakReference);
+}
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_SolverGraph.h"
+#include "Tasks/Task.h"
+
+int FC_SolverGraph::AddNode(const FString& name, TFunction<void()> function, const TArray<int>& prerequisites)
+{
+	FC_SolverGraphNode& node = m_Nodes.AddDefaulted_GetRef();
+	node.m_Name = name;
+	node.m_Function = MoveTemp(function);
+
+	for (const int prerequisite : prerequisites)
+	{
+		check(prerequisite >= 0 && prerequisite < m_Nodes.Num() - 1);
+		node.m_Prerequisites.Add(prerequisite);
+	}
+
+	return m_Nodes.Num() - 1;
+}
+
+void FC_SolverGraph::Run()
+{
+	const double startTime = FPlatformTime::Seconds();
+
+	//Nodes are in dependency order, so every prerequisite task exists by the time it's needed
+	TArray<UE::Tasks::FTask, TInlineAllocator<32>> tasks{};
+	tasks.Reserve(m_Nodes.Num());
+
+	for (FC_SolverGraphNode& node : m_Nodes)
+	{
+		TArray<UE::Tasks::FTask, TInlineAllocator<4>> prerequisites{};
+		for (const int prerequisite : node.m_Prerequisites)
+		{
+			prerequisites.Add(tasks[prerequisite]);
+		}
+
+		tasks.Add(UE::Tasks::Launch(*node.m_Name, [&node, startTime]()
+		{
+			const double nodeStartTime = FPlatformTime::Seconds();
+			node.m_Function();
+
+			const double endTime = FPlatformTime::Seconds();
+			node.m_LastStartMs = (nodeStartTime - startTime) * 1000.0;
+			node.m_LastMs = (endTime - nodeStartTime) * 1000.0;
+		}, prerequisites));
+	}
+
+	UE::Tasks::Wait(tasks);
+	m_LastRunMs = (FPlatformTime::Seconds() - startTime) * 1000.0;
+}
+
+FString FC_SolverGraph::Describe() const
+{
+	FString description = FString::Printf(TEXT("%d nodes, last run %.3f ms\n"), m_Nodes.Num(), m_LastRunMs);
+
+	for (int nodeIdx{}; nodeIdx < m_Nodes.Num(); ++nodeIdx)
+	{
+		const FC_SolverGraphNode& node = m_Nodes[nodeIdx];
+
+		FString prerequisites{};
+		for (const int prerequisite : node.m_Prerequisites)
+		{
+			prerequisites += prerequisites.IsEmpty() ? TEXT("") : TEXT(", ");
+			prerequisites += m_Nodes[prerequisite].m_Name;
+		}
+
+		description += FString::Printf(TEXT("%2d %-24s start %7.3f ms, took %7.3f ms, after [%s]\n"), nodeIdx, *node.m_Name, node.m_LastStartMs, node.m_LastMs, *prerequisites);
+	}
+
+	return description;
+}
@@ -0,0 +1,233 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_SpectralPoisson.h"
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	//Lines up to this size run without touching the heap
+	constexpr int s_InlineLineSize{ 256 };
+}
+
+void FC_SpectralPoisson::Init(int gridSize)
+{
+	m_GridSize = FMath::Max(gridSize, 1);
+	const int n = m_GridSize;
+
+	m_Factors.Reset();
+	int remaining = n;
+	for (const int radix : { 4, 2, 3, 5 })
+	{
+		while (remaining % radix == 0)
+		{
+			m_Factors.Add(radix);
+			remaining /= radix;
+		}
+	}
+	//Whatever is left gets split into its primes, each one runs as a plain DFT butterfly
+	for (int radix{ 7 }; remaining > 1; radix += 2)
+	{
+		while (remaining % radix == 0)
+		{
+			m_Factors.Add(radix);
+			remaining /= radix;
+		}
+	}
+
+	m_Twiddles.SetNumUninitialized(n);
+	m_ShiftTwiddles.SetNumUninitialized(n);
+	m_Eigenvalues.SetNumUninitialized(n);
+	for (int k{}; k < n; ++k)
+	{
+		const double angle = -2.0 * PI * k / n;
+		m_Twiddles[k] = { static_cast<float>(FMath::Cos(angle)), static_cast<float>(FMath::Sin(angle)) };
+
+		const double shiftAngle = -PI * k / (2.0 * n);
+		m_ShiftTwiddles[k] = { static_cast<float>(FMath::Cos(shiftAngle)), static_cast<float>(FMath::Sin(shiftAngle)) };
+
+		m_Eigenvalues[k] = static_cast<float>(2.0 - 2.0 * FMath::Cos(PI * k / n));
+	}
+}
+
+void FC_SpectralPoisson::Solve(float* pPressure, const float* pDivergence) const
+{
+	check(IsInitialized());
+
+	const int n = m_GridSize;
+	const int realGridSize = n + 2;
+	const int sliceSize = realGridSize * realGridSize;
+
+	ParallelFor(n, [=](int sliceIdx)
+	{
+		const int x = sliceIdx + 1;
+		for (int y{ 1 }; y <= n; ++y)
+		{
+			const int64 lineStart = static_cast<int64>(x) * sliceSize + y * realGridSize + 1;
+			FMemory::Memcpy(pPressure + lineStart, pDivergence + lineStart, n * sizeof(float));
+		}
+	});
+
+	for (int axis{}; axis < 3; ++axis)
+	{
+		TransformAxis(pPressure, axis, false);
+	}
+
+	//Divide by the eigenvalues, the constant mode is the free pressure offset and stays 0
+	ParallelFor(n, [this, pPressure, n, realGridSize, sliceSize](int kx)
+	{
+		for (int ky{}; ky < n; ++ky)
+		{
+			float* pLine = pPressure + static_cast<int64>(kx + 1) * sliceSize + (ky + 1) * realGridSize + 1;
+			const float eigenvalueXY = m_Eigenvalues[kx] + m_Eigenvalues[ky];
+
+			for (int kz{}; kz < n; ++kz)
+			{
+				const float eigenvalue = eigenvalueXY + m_Eigenvalues[kz];
+				pLine[kz] = eigenvalue > 0.f ? pLine[kz] / eigenvalue : 0.f;
+			}
+		}
+	});
+
+	for (int axis{ 2 }; axis >= 0; --axis)
+	{
+		TransformAxis(pPressure, axis, true);
+	}
+}
+
+void FC_SpectralPoisson::Fft(const FComplex* pInput, FComplex* pOutput, int size, int stride, int factorIdx) const
+{
+	if (size == 1)
+	{
+		pOutput[0] = pInput[0];
+		return;
+	}
+
+	//Decimation in time, the radix sub-transforms land next to each other in the output
+	const int radix = m_Factors[factorIdx];
+	const int subSize = size / radix;
+	for (int q{}; q < radix; ++q)
+	{
+		Fft(pInput + q * stride, pOutput + q * subSize, subSize, stride * radix, factorIdx + 1);
+	}
+
+	//Combine with a generic radix-point DFT, out[k + s*subSize] = sum_q sub_q[k] * w_size^(q * (k + s*subSize))
+	const int n = m_GridSize;
+	const int twiddleStep = n / size;
+	TArray<FComplex, TInlineAllocator<16>> subValues{};
+	subValues.SetNumUninitialized(radix);
+
+	for (int k{}; k < subSize; ++k)
+	{
+		for (int q{}; q < radix; ++q)
+		{
+			subValues[q] = pOutput[q * subSize + k];
+		}
+
+		for (int s{}; s < radix; ++s)
+		{
+			const int outIdx = k + s * subSize;
+			FComplex sum{ subValues[0] };
+			for (int q{ 1 }; q < radix; ++q)
+			{
+				const FComplex& twiddle = m_Twiddles[(static_cast<int64>(q) * outIdx * twiddleStep) % n];
+				sum.m_Re += subValues[q].m_Re * twiddle.m_Re - subValues[q].m_Im * twiddle.m_Im;
+				sum.m_Im += subValues[q].m_Re * twiddle.m_Im + subValues[q].m_Im * twiddle.m_Re;
+			}
+			pOutput[outIdx] = sum;
+		}
+	}
+}
+
+void FC_SpectralPoisson::ForwardLine(float* pLine, FComplex* pWork, FComplex* pSpectrum) const
+{
+	//Makhoul's reordering, even samples forward and odd samples backward, then one complex FFT of the same length
+	const int n = m_GridSize;
+	for (int i{}; i < (n + 1) / 2; ++i)
+	{
+		pWork[i] = { pLine[2 * i], 0.f };
+	}
+	for (int i{}; i < n / 2; ++i)
+	{
+		pWork[n - 1 - i] = { pLine[2 * i + 1], 0.f };
+	}
+
+	Fft(pWork, pSpectrum, n, 1, 0);
+
+	for (int k{}; k < n; ++k)
+	{
+		//Real part of the spectrum times e^(-i pi k / 2N)
+		pLine[k] = pSpectrum[k].m_Re * m_ShiftTwiddles[k].m_Re - pSpectrum[k].m_Im * m_ShiftTwiddles[k].m_Im;
+	}
+}
+
+void FC_SpectralPoisson::InverseLine(float* pLine, FComplex* pWork, FComplex* pSpectrum) const
+{
+	//Rebuild the spectrum as e^(i pi k / 2N) * (X[k] - i X[N-k]), conjugated so the forward FFT does the inverse
+	const int n = m_GridSize;
+	for (int k{}; k < n; ++k)
+	{
+		const float mirrored = k > 0 ? pLine[n - k] : 0.f;
+		const float c = m_ShiftTwiddles[k].m_Re;
+		const float s = -m_ShiftTwiddles[k].m_Im;
+
+		pWork[k] = { c * pLine[k] + s * mirrored, -(s * pLine[k] - c * mirrored) };
+	}
+
+	Fft(pWork, pSpectrum, n, 1, 0);
+
+	const float scale = 1.f / n;
+	for (int i{}; i < (n + 1) / 2; ++i)
+	{
+		pLine[2 * i] = pSpectrum[i].m_Re * scale;
+	}
+	for (int i{}; i < n / 2; ++i)
+	{
+		pLine[2 * i + 1] = pSpectrum[n - 1 - i].m_Re * scale;
+	}
+}
+
+void FC_SpectralPoisson::TransformAxis(float* pField, int axis, bool bInverse) const
+{
+	const int n = m_GridSize;
+	const int realGridSize = n + 2;
+	const int strides[3]{ realGridSize * realGridSize, realGridSize, 1 };
+	const int lineStride = strides[axis];
+	//The two axes the lines are spread over, the outer one is split across the task threads
+	const int outerStride = strides[axis == 0 ? 1 : 0];
+	const int innerStride = strides[axis == 2 ? 1 : 2];
+
+	ParallelFor(n, [=](int outerIdx)
+	{
+		TArray<float, TInlineAllocator<s_InlineLineSize>> line{};
+		TArray<FComplex, TInlineAllocator<s_InlineLineSize>> work{};
+		TArray<FComplex, TInlineAllocator<s_InlineLineSize>> spectrum{};
+		line.SetNumUninitialized(n);
+		work.SetNumUninitialized(n);
+		spectrum.SetNumUninitialized(n);
+
+		for (int innerIdx{}; innerIdx < n; ++innerIdx)
+		{
+			float* pStart = pField + static_cast<int64>(outerIdx + 1) * outerStride + static_cast<int64>(innerIdx + 1) * innerStride + lineStride;
+
+			for (int i{}; i < n; ++i)
+			{
+				line[i] = pStart[static_cast<int64>(i) * lineStride];
+			}
+
+			if (bInverse)
+			{
+				InverseLine(line.GetData(), work.GetData(), spectrum.GetData());
+			}
+			else
+			{
+				ForwardLine(line.GetData(), work.GetData(), spectrum.GetData());
+			}
+
+			for (int i{}; i < n; ++i)
+			{
+				pStart[static_cast<int64>(i) * lineStride] = line[i];
+			}
+		}
+	});
+}
@@ -0,0 +1,208 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_TracerParticles.h"
+#include "C_FieldSampler.h"
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	constexpr int s_ChunkSize{ 4096 }; //Particles per parallel task
+	constexpr int s_BatchSize{ 256 }; //Particles sampled at once, sized for the stack
+}
+
+void FC_TracerParticles::Reset(int maxParticles)
+{
+	m_MaxParticles = FMath::Max(maxParticles, 0);
+	SetNum(0);
+
+	for (TArray<float>* pArray : { &m_PositionX, &m_PositionY, &m_PositionZ, &m_Age, &m_Lifetime })
+	{
+		pArray->Reserve(m_MaxParticles);
+	}
+	m_IsDead.Reserve(m_MaxParticles);
+	m_RenderBuffer.Reserve(m_MaxParticles);
+}
+
+int FC_TracerParticles::EmitSphere(int count, const FVector& gridCenter, float gridRadius, float lifetime)
+{
+	const int first = Num();
+	const int emitted = FMath::Clamp(count, 0, m_MaxParticles - first);
+	SetNum(first + emitted);
+
+	for (int idx{ first }; idx < first + emitted; ++idx)
+	{
+		const FVector position = gridCenter + m_Random.GetUnitVector() * gridRadius * FMath::Pow(m_Random.GetFraction(), 1.f / 3.f);
+		m_PositionX[idx] = position.X;
+		m_PositionY[idx] = position.Y;
+		m_PositionZ[idx] = position.Z;
+		m_Age[idx] = 0.f;
+		m_Lifetime[idx] = lifetime;
+	}
+
+	return emitted;
+}
+
+int FC_TracerParticles::EmitAt(TArrayView<const FVector> gridPositions, float lifetime)
+{
+	const int first = Num();
+	const int emitted = FMath::Clamp(gridPositions.Num(), 0, m_MaxParticles - first);
+	SetNum(first + emitted);
+
+	for (int idx{}; idx < emitted; ++idx)
+	{
+		m_PositionX[first + idx] = gridPositions[idx].X;
+		m_PositionY[first + idx] = gridPositions[idx].Y;
+		m_PositionZ[first + idx] = gridPositions[idx].Z;
+		m_Age[first + idx] = 0.f;
+		m_Lifetime[first + idx] = lifetime;
+	}
+
+	return emitted;
+}
+
+void FC_TracerParticles::Advect(const FC_FieldSnapshot& snapshot, float dt)
+{
+	const int numParticles = Num();
+	if (numParticles == 0 || snapshot.m_RealGridSize == 0)
+	{
+		m_RenderBuffer.Reset();
+		return;
+	}
+
+	//Same units as the solver's advection, velocity * dt * gridSize is in cells
+	const float dt0 = dt * snapshot.m_GridSize;
+	const float minCoord = 0.5f;
+	const float maxCoord = snapshot.m_GridSize + 0.5f;
+
+	const float* pVelocityFields[3]{ snapshot.m_VelocityX.GetData(), snapshot.m_VelocityY.GetData(), snapshot.m_VelocityZ.GetData() };
+	const FVector3f origin{ snapshot.m_Origin };
+	const float gapSize = snapshot.m_GapSize;
+
+	m_RenderBuffer.SetNumUninitialized(numParticles, false);
+
+	const int numChunks = FMath::DivideAndRoundUp(numParticles, s_ChunkSize);
+	FThreadSafeCounter numDead{};
+
+	ParallelFor(numChunks, [&](int chunkIdx)
+	{
+		const int chunkFirst = chunkIdx * s_ChunkSize;
+		const int chunkEnd = FMath::Min(chunkFirst + s_ChunkSize, numParticles);
+		int chunkDead{};
+
+		float midX[s_BatchSize], midY[s_BatchSize], midZ[s_BatchSize];
+		float velocityX[s_BatchSize], velocityY[s_BatchSize], velocityZ[s_BatchSize];
+		float* pVelocities[3]{ velocityX, velocityY, velocityZ };
+
+		for (int first{ chunkFirst }; first < chunkEnd; first += s_BatchSize)
+		{
+			const int count = FMath::Min(s_BatchSize, chunkEnd - first);
+			float* pX = &m_PositionX[first];
+			float* pY = &m_PositionY[first];
+			float* pZ = &m_PositionZ[first];
+
+			//First stage, velocity at the current position gives the midpoint
+			//The solver backtraces to p - v * dt0, so its fields move along +v and so do the tracers
+			FC_FieldSampler::SampleGrid(pVelocityFields, pVelocities, 3, snapshot.m_RealGridSize, snapshot.m_RealDepth, pX, pY, pZ, count);
+			for (int idx{}; idx < count; ++idx)
+			{
+				midX[idx] = pX[idx] + velocityX[idx] * dt0 * 0.5f;
+				midY[idx] = pY[idx] + velocityY[idx] * dt0 * 0.5f;
+				midZ[idx] = pZ[idx] + velocityZ[idx] * dt0 * 0.5f;
+			}
+
+			//Second stage, the midpoint velocity moves the particle for the whole step
+			FC_FieldSampler::SampleGrid(pVelocityFields, pVelocities, 3, snapshot.m_RealGridSize, snapshot.m_RealDepth, midX, midY, midZ, count);
+			for (int idx{}; idx < count; ++idx)
+			{
+				const int particleIdx = first + idx;
+
+				pX[idx] += velocityX[idx] * dt0;
+				pY[idx] += velocityY[idx] * dt0;
+				pZ[idx] += velocityZ[idx] * dt0;
+				m_Age[particleIdx] += dt;
+
+				const bool isOutside = pX[idx] < minCoord || pX[idx] > maxCoord
+					|| pY[idx] < minCoord || pY[idx] > maxCoord
+					|| pZ[idx] < minCoord || pZ[idx] > maxCoord;
+				const bool isDead = isOutside || m_Age[particleIdx] >= m_Lifetime[particleIdx];
+				m_IsDead[particleIdx] = isDead;
+				chunkDead += isDead;
+
+				m_RenderBuffer[particleIdx] = FVector4f{
+					pX[idx] * gapSize + origin.X,
+					pY[idx] * gapSize + origin.Y,
+					pZ[idx] * gapSize + origin.Z,
+					m_Age[particleIdx] / FMath::Max(m_Lifetime[particleIdx], KINDA_SMALL_NUMBER) };
+			}
+		}
+
+		numDead.Add(chunkDead);
+	});
+
+	if (numDead.GetValue() > 0)
+	{
+		Compact();
+	}
+}
+
+bool FC_TracerParticles::CheckFollowsFlow()
+{
+	//Uniform +x velocity on a small grid, dt0 moves the tracer half a cell
+	constexpr int gridSize{ 8 };
+	constexpr int realGridSize{ gridSize + 2 };
+	constexpr int numCells{ realGridSize * realGridSize * realGridSize };
+
+	FC_FieldSnapshot snapshot{};
+	snapshot.m_GridSize = gridSize;
+	snapshot.m_RealGridSize = realGridSize;
+	snapshot.m_RealDepth = realGridSize;
+	snapshot.m_GapSize = 1.f;
+	snapshot.m_Density.Init(0.f, numCells);
+	snapshot.m_VelocityX.Init(1.f, numCells);
+	snapshot.m_VelocityY.Init(0.f, numCells);
+	snapshot.m_VelocityZ.Init(0.f, numCells);
+
+	const FVector start{ gridSize / 2.f };
+	FC_TracerParticles tracers{};
+	tracers.Reset(1);
+	tracers.EmitAt(MakeArrayView(&start, 1), 1.f);
+	tracers.Advect(snapshot, 0.5f / gridSize);
+
+	return tracers.Num() == 1 && tracers.m_PositionX[0] > start.X;
+}
+
+void FC_TracerParticles::SetNum(int num)
+{
+	for (TArray<float>* pArray : { &m_PositionX, &m_PositionY, &m_PositionZ, &m_Age, &m_Lifetime })
+	{
+		pArray->SetNumUninitialized(num, false);
+	}
+	m_IsDead.SetNumZeroed(num, false);
+	m_RenderBuffer.SetNumUninitialized(FMath::Min(m_RenderBuffer.Num(), num), false);
+}
+
+void FC_TracerParticles::Compact()
+{
+	//Order doesn't matter for tracers, so dead ones get filled from the back
+	int num = Num();
+	for (int idx{}; idx < num;)
+	{
+		if (!m_IsDead[idx])
+		{
+			++idx;
+			continue;
+		}
+
+		--num;
+		m_PositionX[idx] = m_PositionX[num];
+		m_PositionY[idx] = m_PositionY[num];
+		m_PositionZ[idx] = m_PositionZ[num];
+		m_Age[idx] = m_Age[num];
+		m_Lifetime[idx] = m_Lifetime[num];
+		m_IsDead[idx] = m_IsDead[num];
+		m_RenderBuffer[idx] = m_RenderBuffer[num];
+	}
+
+	SetNum(num);
+}
@@ -0,0 +1,213 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "C_WorkerTeam.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/Event.h"
+
+#if PLATFORM_CPU_X86_FAMILY
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	//About 50-100 us of spinning before a member gives its core back
+	constexpr int s_IdleSpins{ 20000 };
+
+	FORCEINLINE void SpinPause()
+	{
+#if PLATFORM_CPU_X86_FAMILY
+		_mm_pause();
+#else
+		FPlatformProcess::Yield();
+#endif
+	}
+}
+
+class FC_WorkerTeam::FWorker final : public FRunnable
+{
+public:
+	FWorker(FC_WorkerTeam& team, int memberIdx)
+		: m_Team{ team }
+		, m_MemberIdx{ memberIdx }
+	{
+	}
+
+	virtual ~FWorker() override
+	{
+		delete m_pThread;
+		FPlatformProcess::ReturnSynchEventToPool(m_pWakeEvent);
+	}
+
+	bool Start()
+	{
+		//One member per logical CPU, the mask bits are logical CPUs, member 0 is whatever thread calls Run
+		const int numLogicalCores = FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+		const uint64 affinityMask = numLogicalCores <= 64 ? 1ull << (m_MemberIdx % numLogicalCores) : FPlatformAffinity::GetNoAffinityMask();
+
+		m_pWakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+		m_pThread = FRunnableThread::Create(this, *FString::Printf(TEXT("FluidWorker%d"), m_MemberIdx), 0, TPri_AboveNormal, affinityMask);
+		return m_pThread != nullptr;
+	}
+
+	void Wake() { m_pWakeEvent->Trigger(); }
+
+	void WakeIfSleeping()
+	{
+		if (m_bIsSleeping.load(std::memory_order_seq_cst))
+		{
+			Wake();
+		}
+	}
+	void Join() { m_pThread->WaitForCompletion(); }
+
+	virtual uint32 Run() override
+	{
+		uint32 seenGeneration{};
+
+		while (true)
+		{
+			//Spin first, the solver fires its runs back to back
+			int spinIdx{};
+			while (m_Team.m_RunGeneration.load(std::memory_order_acquire) == seenGeneration && !m_Team.m_bIsStopping.load(std::memory_order_acquire))
+			{
+				if (++spinIdx < s_IdleSpins)
+				{
+					SpinPause();
+					continue;
+				}
+
+				//Run bumps the generation before it looks at the flag, so either it sees us asleep or we see its generation here
+				m_bIsSleeping.store(true, std::memory_order_seq_cst);
+				if (m_Team.m_RunGeneration.load(std::memory_order_seq_cst) == seenGeneration && !m_Team.m_bIsStopping.load(std::memory_order_seq_cst))
+				{
+					m_pWakeEvent->Wait();
+				}
+				m_bIsSleeping.store(false, std::memory_order_relaxed);
+			}
+
+			if (m_Team.m_bIsStopping.load(std::memory_order_acquire))
+			{
+				return 0;
+			}
+
+			m_Team.RunMember(m_MemberIdx, seenGeneration);
+		}
+	}
+
+private:
+	FC_WorkerTeam& m_Team;
+	int m_MemberIdx;
+	FRunnableThread* m_pThread{};
+	FEvent* m_pWakeEvent{};
+	std::atomic<bool> m_bIsSleeping{};
+};
+
+FC_WorkerTeam::~FC_WorkerTeam()
+{
+	Stop();
+}
+
+bool FC_WorkerTeam::Start(int numMembers)
+{
+	Stop();
+
+	if (numMembers <= 1 || !FPlatformProcess::SupportsMultithreading())
+	{
+		return false;
+	}
+
+	m_bIsStopping = false;
+	m_RunGeneration = 0;
+	m_BarrierCount = 0;
+	m_BarrierGeneration = 0;
+	m_NumMembers = numMembers;
+
+	for (int memberIdx{ 1 }; memberIdx < numMembers; ++memberIdx)
+	{
+		TUniquePtr<FWorker>& pWorker = m_pWorkers.Add_GetRef(MakeUnique<FWorker>(*this, memberIdx));
+		if (!pWorker->Start())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Failed to start fluid worker %d, WorkerTeam/Start"), memberIdx);
+			m_pWorkers.Pop();
+			Stop();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void FC_WorkerTeam::Stop()
+{
+	m_bIsStopping = true;
+	for (TUniquePtr<FWorker>& pWorker : m_pWorkers)
+	{
+		pWorker->Wake();
+	}
+	for (TUniquePtr<FWorker>& pWorker : m_pWorkers)
+	{
+		pWorker->Join();
+	}
+
+	m_pWorkers.Reset();
+	m_NumMembers = 1;
+}
+
+void FC_WorkerTeam::Run(TFunctionRef<void(int memberIdx)> function)
+{
+	if (!IsRunning())
+	{
+		function(0);
+		return;
+	}
+
+	m_pFunction = &function;
+	m_NumFinished.store(0, std::memory_order_relaxed);
+	m_RunGeneration.fetch_add(1, std::memory_order_seq_cst);
+
+	//Only members that already went to sleep need the event, the rest sees the generation while spinning
+	for (TUniquePtr<FWorker>& pWorker : m_pWorkers)
+	{
+		pWorker->WakeIfSleeping();
+	}
+
+	function(0);
+
+	while (m_NumFinished.load(std::memory_order_acquire) < m_NumMembers - 1)
+	{
+		SpinPause();
+	}
+	m_pFunction = nullptr;
+}
+
+void FC_WorkerTeam::Barrier()
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+
+	//Sense reversal, the last member in resets the count and releases the others
+	const uint32 generation = m_BarrierGeneration.load(std::memory_order_acquire);
+	if (m_BarrierCount.fetch_add(1, std::memory_order_acq_rel) + 1 == m_NumMembers)
+	{
+		m_BarrierCount.store(0, std::memory_order_relaxed);
+		m_BarrierGeneration.fetch_add(1, std::memory_order_release);
+		return;
+	}
+
+	while (m_BarrierGeneration.load(std::memory_order_acquire) == generation)
+	{
+		SpinPause();
+	}
+}
+
+void FC_WorkerTeam::RunMember(int memberIdx, uint32& seenGeneration)
+{
+	seenGeneration = m_RunGeneration.load(std::memory_order_acquire);
+
+	(*m_pFunction)(memberIdx);
+	m_NumFinished.fetch_add(1, std::memory_order_release);
+}
@@ -0,0 +1,87 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+//Lossy block-compressed field, for large domains that have to fit in a memory budget
+//The field is cut into 8^3 blocks, each coded as eight 4^3 zfp-style blocks: a shared exponent, a decorrelating integer
+//transform, then the coefficients bit plane by bit plane from the most significant one until the bit or error budget runs out
+//Cells are read and written through small caches of decompressed blocks, a dirty block gets recompressed when it's evicted
+//The blocks are split into slabs along x with a cache and a lock each, so threads on different slabs never wait on each other
+
+struct FC_CompressionSettings final
+{
+	float m_BitsPerValue{ 8.f }; //Rate cap per value, 4x smaller than float at 8, 0 for no cap
+	float m_Tolerance{}; //Absolute error bound, planes below it aren't stored, 0 for none
+};
+
+class FLUID_SIMULATION_API FC_CompressedField final
+{
+public:
+	static constexpr int BlockSize{ 8 };
+	static constexpr int BlockCells{ BlockSize * BlockSize * BlockSize };
+
+	//Sizes in cells including any boundary layer, the layout is the solver's with z fastest
+	//numCachedBlocks is per slab
+	void Init(int sizeX, int sizeY, int sizeZ, const FC_CompressionSettings& settings, int numCachedBlocks = 64, int numSlabs = 1);
+	void Reset();
+	bool IsInitialized() const { return m_Blocks.Num() > 0; }
+
+	//Whole-field transfers on the task threads, they bypass the caches, so Flush before reading back cached writes
+	//None may run at the same time as the cell access below, the views are 64-bit since a big domain has more than 2^31 cells
+	void Compress(TArrayView64<const float> field);
+	void Decompress(TArrayView64<float> outField) const;
+	void DecompressSlices(int firstX, int endX, TArrayView64<float> outSlices) const; //Only x in [firstX, endX), outSlices starts at firstX
+
+	//Cell access through the working set of the cell's slab, thread safe
+	float GetValue(int x, int y, int z);
+	void SetValue(int x, int y, int z, float value);
+	void AddValue(int x, int y, int z, float amount); //One read and write under the slab's lock
+	void Flush();
+
+	SIZE_T GetCompressedBytes() const;
+	int64 GetNumCells() const { return static_cast<int64>(m_SizeX) * m_SizeY * m_SizeZ; }
+	SIZE_T GetUncompressedBytes() const { return GetNumCells() * sizeof(float); }
+	const FC_CompressionSettings& GetSettings() const { return m_Settings; }
+
+private:
+	struct FCachedBlock
+	{
+		int m_BlockIdx{ INDEX_NONE };
+		uint64 m_LastUse{};
+		bool m_bIsDirty{};
+		float m_Values[BlockCells]{};
+	};
+
+	struct FSlabCache
+	{
+		FCriticalSection m_Lock{};
+		TArray<FCachedBlock> m_Blocks{};
+		uint64 m_UseCounter{};
+	};
+
+	int m_SizeX{};
+	int m_SizeY{};
+	int m_SizeZ{};
+	int m_NumBlocksX{};
+	int m_NumBlocksY{};
+	int m_NumBlocksZ{};
+	FC_CompressionSettings m_Settings{};
+
+	TArray<TArray<uint64>> m_Blocks{}; //Bit stream per block
+	TArray<TUniquePtr<FSlabCache>> m_pSlabCaches{};
+	TArray<int> m_CacheSlots{}; //Slot of every block in its slab's cache, INDEX_NONE when it isn't cached
+
+	int GetBlockIdx(int blockX, int blockY, int blockZ) const { return (blockX * m_NumBlocksY + blockY) * m_NumBlocksZ + blockZ; }
+	FSlabCache& GetSlabCache(int x) const { return *m_pSlabCaches[(x / BlockSize) * m_pSlabCaches.Num() / m_NumBlocksX]; }
+	//Call with the lock of the cell's slab held
+	FCachedBlock& GetCachedBlock(FSlabCache& slabCache, int x, int y, int z, int& outLocalIdx);
+
+	void GatherBlock(TArrayView64<const float> field, int blockIdx, float* pOutValues) const;
+	//Writes the cells of the block with x in [firstX, endX), outField starts at firstX
+	void ScatterBlock(const float* pValues, int blockIdx, TArrayView64<float> outField, int firstX, int endX) const;
+	void EncodeBlock(const float* pValues, int blockIdx);
+	void DecodeBlock(int blockIdx, float* pOutValues) const;
+};
@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//One allocation per domain, carved into every field and scratch buffer the solver needs
+//Fields are laid out first with AddField, Allocate then hands all of them out from a single 64-byte aligned block
+//For domains larger than RAM the block can be a mapped scratch file instead, the OS then pages fields in and out
+
+enum class EC_SliceAdvice : uint8
+{
+	WillNeed,	//Start reading the slices in, the call doesn't wait for it
+	DontNeed	//Done with the slices for now, the OS may write them back and drop them
+};
+
+class FLUID_SIMULATION_API FC_FieldArena final
+{
+public:
+	static constexpr SIZE_T Alignment{ 64 };
+
+	FC_FieldArena() = default;
+	~FC_FieldArena();
+
+	FC_FieldArena(const FC_FieldArena& other) = delete;
+	FC_FieldArena(FC_FieldArena&& other) = delete;
+	FC_FieldArena& operator=(const FC_FieldArena& other) = delete;
+	FC_FieldArena& operator=(FC_FieldArena&& other) = delete;
+
+	//Returns the handle of the field, only valid before Allocate
+	int AddField(int64 numElements, int elementBytes = sizeof(float));
+	//Huge pages are only a request, the arena falls back to normal pages when the OS refuses
+	//With a backing directory the arena maps a scratch file there instead, the file is deleted right away and lives as long as the mapping
+	bool Allocate(bool bUseHugePages, const FString& backingDirectory = FString{});
+	void Free();
+
+	//Zeroes every field slab by slab on the task threads, so each page lands on the node of the thread that sweeps that slab
+	//Fields are split along their slowest axis, sliceElements is the number of elements in one slice of that axis
+	void FirstTouch(int numSlabs, int64 sliceElements, TFunctionRef<void(int slabIdx, int& firstSlice, int& endSlice)> getSlabSlices);
+	//Zeroes one slab of every field from the calling thread, for callers that bring their own threads
+	void TouchSlices(int firstSlice, int endSlice, int64 sliceElements);
+	//Paging hint for the same slices of every field, only does something when file backed
+	void AdviseSlices(int firstSlice, int endSlice, int64 sliceElements, EC_SliceAdvice advice) const;
+	//Hands the pages of a field back to the OS until it's written again, its cells are undefined after this
+	//Only does something when mapped, a field from the heap keeps its memory
+	void DiscardField(const void* pFieldData) const;
+
+	void* GetFieldData(int handle) const { return m_pMemory + m_Offsets[handle]; }
+	float* GetField(int handle) const { return static_cast<float*>(GetFieldData(handle)); }
+	int GetNumFields() const { return m_Offsets.Num(); }
+	SIZE_T GetAllocatedBytes() const { return m_AllocatedBytes; }
+	bool IsAllocated() const { return m_pMemory != nullptr; }
+	bool UsesHugePages() const { return m_bUsesHugePages; }
+	bool IsFileBacked() const { return m_bIsFileBacked; }
+
+private:
+	TArray<SIZE_T> m_Offsets{};
+	TArray<int64> m_Sizes{}; //In elements, a big domain has more than 2^31 cells
+	TArray<int> m_ElementBytes{};
+	SIZE_T m_Size{};
+
+	uint8* m_pMemory{};
+	SIZE_T m_AllocatedBytes{};
+	bool m_bIsMapped{};
+	bool m_bUsesHugePages{};
+	bool m_bIsFileBacked{};
+
+	bool AllocateFileBacked(SIZE_T size, const FString& backingDirectory);
+};
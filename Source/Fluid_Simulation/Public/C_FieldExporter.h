@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "C_FieldSampler.h"
+#include "Tasks/Task.h"
+
+//Publishes snapshots into a POSIX shared memory ring (/dev/shm/Fluid_<name>) that external tools map read-only
+//The copy into the ring runs on a background task, a snapshot is skipped while the previous one is still being written
+//Only available on Linux, Open fails elsewhere
+
+//Layout for readers, all offsets from the start of the segment:
+//FC_ExportHeader, then m_NumSlots slots of m_SlotStride bytes, each an FC_ExportSlotHeader followed at m_DataOffset
+//by density, velocity x, y and z, each m_NumCells floats indexed like the solver (z fastest, m_RealDepth is 1 for a planar grid)
+//A reader takes m_LatestSlot, reads an even m_Sequence, reads the data and retries when m_Sequence changed meanwhile
+
+struct FC_ExportHeader
+{
+	static constexpr uint32 Magic{ 0x444C4646 }; //"FFLD"
+	static constexpr uint32 Version{ 2 };
+
+	uint32 m_Magic;
+	uint32 m_Version;
+	int32 m_GridSize;
+	int32 m_RealGridSize;
+	int32 m_NumCells;
+	int32 m_NumFields;
+	int32 m_NumSlots;
+	int32 m_DataOffset; //From the start of a slot
+	uint64 m_SlotStride;
+	float m_GapSize;
+	float m_Origin[3];
+	volatile int32 m_LatestSlot; //-1 until the first publish
+	int32 m_RealDepth; //Cells along z, m_RealGridSize unless planar
+};
+
+struct FC_ExportSlotHeader
+{
+	volatile uint64 m_Sequence; //Odd while being written
+	volatile uint64 m_Frame;
+};
+
+class FLUID_SIMULATION_API FC_FieldExporter final
+{
+public:
+	static constexpr int NumSlots{ 3 };
+	static constexpr int NumFields{ 4 };
+
+	FC_FieldExporter() = default;
+	~FC_FieldExporter();
+
+	FC_FieldExporter(const FC_FieldExporter& other) = delete;
+	FC_FieldExporter& operator=(const FC_FieldExporter& other) = delete;
+
+	bool Open(const FString& name, const FC_FieldSnapshot& layout);
+	void Close();
+	bool IsOpen() const { return m_pMemory != nullptr; }
+
+	//Never waits, returns false when the snapshot got skipped because the last export is still running
+	bool Publish(const FC_FieldSnapshotPtr& pSnapshot);
+
+	int GetNumSkipped() const { return m_NumSkipped; }
+
+private:
+	FString m_Name{};
+	uint8* m_pMemory{};
+	SIZE_T m_Size{};
+	int m_NextSlot{};
+	int m_NumSkipped{};
+
+	UE::Tasks::FTask m_ExportTask{};
+
+	FC_ExportHeader& GetHeader() const { return *reinterpret_cast<FC_ExportHeader*>(m_pMemory); }
+	FC_ExportSlotHeader& GetSlot(int slotIdx) const;
+
+	void WriteSlot(int slotIdx, const FC_FieldSnapshot& snapshot) const;
+};
@@ -0,0 +1,117 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FC_FieldSnapshot;
+class FC_FluidSolver;
+
+//Server-authoritative field replication on a byte budget
+//The interior is cut into 4^3 bricks (4^2 on a planar grid), density and velocity are quantized to 8 bits per value
+//A packet carries the bricks that changed the most since they were last sent, weighted by age and by how close they are to a focus point
+//Every brick is delta coded against the version the server last sent, unchanged values cost nothing thanks to zero runs
+//Packets may get lost, so a client drops a delta whose base version it doesn't hold, and every brick is resent whole
+//(as a keyframe) once m_KeyframeInterval has passed, which is also how late joiners catch up
+
+struct FC_ReplicationSettings final
+{
+	float m_BytesPerSecond{ 4096.f };
+	float m_SendRate{ 10.f }; //Packets per second
+	float m_KeyframeInterval{ 5.f }; //Seconds until a brick is due to be resent whole, the budget may stretch it
+	float m_MaxDensity{ 1.f }; //Quantization ranges, anything past them is clamped
+	float m_MaxVelocity{ 10.f };
+};
+
+struct FLUID_SIMULATION_API FC_ReplicationBricks final
+{
+	static constexpr int BrickSize{ 4 };
+
+	int m_GridSize{};
+	bool m_bIsPlanar{};
+	int m_NumBricksX{};
+	int m_NumBricksY{};
+	int m_NumBricksZ{};
+	int m_NumChannels{}; //Density, velocity x and y, and velocity z on a volume
+
+	void Init(int gridSize, bool bIsPlanar);
+	int Num() const { return m_NumBricksX * m_NumBricksY * m_NumBricksZ; }
+	int GetBrickCells() const { return BrickSize * BrickSize * (m_bIsPlanar ? 1 : BrickSize); }
+	int GetBrickValues() const { return m_NumChannels * GetBrickCells(); }
+	FVector GetBrickCenter(int brickIdx) const; //In grid cells, like FC_FieldSnapshot::WorldToGrid
+
+	//Calls function(localIdx, idx) for every cell of the brick inside the grid, idx is the solver's cell index
+	template <typename TFunction>
+	void ForEachCell(int brickIdx, TFunction&& function) const
+	{
+		const int brickZ = brickIdx % m_NumBricksZ;
+		const int brickY = brickIdx / m_NumBricksZ % m_NumBricksY;
+		const int brickX = brickIdx / (m_NumBricksZ * m_NumBricksY);
+		const int brickSizeZ = m_bIsPlanar ? 1 : BrickSize;
+		const int realGridSize = m_GridSize + 2;
+		const int realDepth = m_bIsPlanar ? 1 : realGridSize;
+
+		for (int localX{}; localX < BrickSize && 1 + brickX * BrickSize + localX <= m_GridSize; ++localX)
+		{
+			const int x = 1 + brickX * BrickSize + localX;
+			for (int localY{}; localY < BrickSize && 1 + brickY * BrickSize + localY <= m_GridSize; ++localY)
+			{
+				const int y = 1 + brickY * BrickSize + localY;
+				for (int localZ{}; localZ < brickSizeZ && (m_bIsPlanar || 1 + brickZ * BrickSize + localZ <= m_GridSize); ++localZ)
+				{
+					const int z = m_bIsPlanar ? 0 : 1 + brickZ * BrickSize + localZ;
+					function((localX * BrickSize + localY) * brickSizeZ + localZ, (x * realGridSize + y) * realDepth + z);
+				}
+			}
+		}
+	}
+};
+
+class FLUID_SIMULATION_API FC_FieldReplicationEncoder final
+{
+public:
+	void Reset(int gridSize, bool bIsPlanar);
+
+	//Packs the bricks that matter most into the bytes m_BytesPerSecond allows since the last packet, call it m_SendRate times a second
+	//A brick larger than that still goes out on its own and the packets after it make up for it
+	//Focus points are in grid cells, time is any clock in seconds that only moves forward
+	void Encode(const FC_FieldSnapshot& snapshot, const FC_ReplicationSettings& settings, TArrayView<const FVector> focusPoints, float time, TArray<uint8>& outPacket);
+
+private:
+	struct FBrickState
+	{
+		uint16 m_Version{}; //0 until the brick is first sent
+		float m_LastSendTime{};
+		float m_Priority{};
+	};
+
+	FC_ReplicationBricks m_Bricks{};
+	TArray<uint8> m_Current{}; //Quantized values of the last snapshot, brick by brick
+	TArray<uint8> m_Sent{}; //What the clients hold if they got every packet
+	TArray<FBrickState> m_BrickStates{};
+	TArray<int> m_Candidates{};
+	TArray<uint8> m_BrickBytes{};
+	float m_ByteCredit{};
+
+	void EncodeBrick(int brickIdx, bool bIsKeyframe, TArray<uint8>& outBytes) const;
+};
+
+class FLUID_SIMULATION_API FC_FieldReplicationDecoder final
+{
+public:
+	void Reset(int gridSize, bool bIsPlanar);
+
+	//Applies every brick whose base it holds, false when the packet is malformed or for another grid
+	bool Decode(TArrayView<const uint8> packet);
+
+	//Moves the cells of recently received bricks toward the server's values, closing 1 - e^-1 of the gap every blendTime
+	void Blend(FC_FluidSolver& solver, float dt, float blendTime);
+
+private:
+	FC_ReplicationBricks m_Bricks{};
+	TArray<uint8> m_Received{};
+	TArray<uint16> m_Versions{};
+	TArray<float> m_BlendTimes{}; //Seconds each brick has been blended since it arrived, negative before the first one
+	float m_MaxDensity{ 1.f };
+	float m_MaxVelocity{ 1.f };
+};
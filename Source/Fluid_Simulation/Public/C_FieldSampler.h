@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Vectorized trilinear sampling of solver fields, four points per SIMD register
+//Grid coordinates are in cells with the boundary layer at 0, same as the solver's advection
+
+class FLUID_SIMULATION_API FC_FieldSampler final
+{
+public:
+	//Samples numFields fields at count points with shared weights, coordinates get clamped to the interior like AdVectIfChecks
+	//A realDepth of 1 is a planar grid, z is ignored and the sampling is bilinear
+	static void SampleGrid(const float* const* ppFields, float* const* ppOutputs, int numFields, int realGridSize, int realDepth,
+		const float* pX, const float* pY, const float* pZ, int count);
+};
+
+//Read-only copy of the fields after a completed step, safe to share with any thread
+struct FLUID_SIMULATION_API FC_FieldSnapshot final
+{
+	int m_GridSize{};
+	int m_RealGridSize{};
+	int m_RealDepth{}; //m_RealGridSize, or 1 for a planar solver
+	float m_GapSize{};
+	FVector m_Origin{}; //World position of cell (0,0,0)
+	uint64 m_Frame{};
+
+	TArray<float> m_Density{};
+	TArray<float> m_VelocityX{};
+	TArray<float> m_VelocityY{};
+	TArray<float> m_VelocityZ{};
+
+	//Either output can be left empty to skip it, otherwise it needs as many entries as there are positions
+	void Sample(TArrayView<const FVector> positions, TArrayView<FVector> outVelocities, TArrayView<float> outDensities) const;
+
+	FVector WorldToGrid(const FVector& position) const { return (position - m_Origin) / m_GapSize; }
+	FVector GridToWorld(const FVector& gridPosition) const { return gridPosition * m_GapSize + m_Origin; }
+};
+
+using FC_FieldSnapshotPtr = TSharedPtr<const FC_FieldSnapshot, ESPMode::ThreadSafe>;
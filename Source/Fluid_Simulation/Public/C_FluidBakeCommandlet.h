@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "C_FluidBakeCommandlet.generated.h"
+
+//Headless run of the solver, optionally split over several local processes along x
+//-run=C_FluidBake -GridSize=128 -Steps=100 -Dt=0.016 -Ranks=4
+//Without -Rank the process is rank 0 and launches the other ranks itself, they find each other through -Job
+//A rank that fails aborts the others, and one that waits longer than -HaloTimeout=300 seconds on another gives up and aborts the job
+//-OutOfCore=<directory> maps the fields from scratch files there for grids larger than RAM, -OutOfCoreSlices sets the window the passes walk in
+//-CompressBits=8 and/or -CompressTolerance=0.001 keep the density compressed between steps and report how well the final one compresses, see FC_CompressedField,
+//the steps still run on dense fields so the peak memory of a rank stays the same
+//-CrossCheck=<threads,team,graph,blocked,spectral> compares that config against the reference kernels for -Steps steps instead of baking,
+//with -Half, -Planar, -MacCormack and -Tolerance=0.001, it returns 1 when a field is over the tolerance or the tracers move against the flow,
+//so scripts can gate on it
+
+UCLASS()
+class FLUID_SIMULATION_API UC_FluidBakeCommandlet final : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UC_FluidBakeCommandlet();
+
+	virtual int32 Main(const FString& params) override;
+};
@@ -0,0 +1,114 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Solver kernels compiled per grid size, so strides and trip counts are constants the compiler can unroll and vectorize
+//Sizes without their own instantiation use the runtime-size fallback, the table is picked once in FC_FluidSolver::Init
+//Sweeps cover the interior x range [firstX, endX), which lets the solver split them into slabs
+//Y and z always span the whole grid, sizeX is the interior x extent of the fields and only differs from gridSize on a decomposed domain
+//Density and velocity cells are float or half depending on the table's precision, the kernels compute in float either way
+//Pressure and divergence are always float, they accumulate over many iterations and need the precision
+
+enum class EC_FieldPrecision : uint8
+{
+	Float,
+	Half	//FFloat16 cells, half the bytes for the bandwidth-bound sweeps
+};
+
+//Statistics a sweep folds in while it writes the cells anyway, one per slab, the kernels add to it
+//Only interior cells count, the active box is in the sweep's own cell coordinates
+struct FC_SweepStats final
+{
+	float m_ActiveThreshold{}; //Input, cells with more density than this are active
+
+	double m_TotalDensity{};
+	double m_DivergenceSquares{};
+	double m_ResidualSquares{}; //Of the pressure equation after the solve, div + the neighbors - 6p, summed by ProjectVelocities
+	FIntVector m_ActiveMin{ MAX_int32 };
+	FIntVector m_ActiveMax{ MIN_int32 };
+
+	void AddActiveCell(int x, int y, int z)
+	{
+		m_ActiveMin = FIntVector{ FMath::Min(m_ActiveMin.X, x), FMath::Min(m_ActiveMin.Y, y), FMath::Min(m_ActiveMin.Z, z) };
+		m_ActiveMax = FIntVector{ FMath::Max(m_ActiveMax.X, x), FMath::Max(m_ActiveMax.Y, y), FMath::Max(m_ActiveMax.Z, z) };
+	}
+
+	bool HasActiveCells() const { return m_ActiveMin.X <= m_ActiveMax.X; }
+
+	void Merge(const FC_SweepStats& other)
+	{
+		m_TotalDensity += other.m_TotalDensity;
+		m_DivergenceSquares += other.m_DivergenceSquares;
+		m_ResidualSquares += other.m_ResidualSquares;
+		m_ActiveMin = FIntVector{ FMath::Min(m_ActiveMin.X, other.m_ActiveMin.X), FMath::Min(m_ActiveMin.Y, other.m_ActiveMin.Y), FMath::Min(m_ActiveMin.Z, other.m_ActiveMin.Z) };
+		m_ActiveMax = FIntVector{ FMath::Max(m_ActiveMax.X, other.m_ActiveMax.X), FMath::Max(m_ActiveMax.Y, other.m_ActiveMax.Y), FMath::Max(m_ActiveMax.Z, other.m_ActiveMax.Z) };
+	}
+};
+
+struct FLUID_SIMULATION_API FC_FluidKernels final
+{
+	using FLinearSolve = void(*)(int gridSize, void* pField, const void* pPrevField, float a, int firstX, int endX);
+	using FPressureSolve = void(*)(int gridSize, float* pPressure, const float* pDivergence, int firstX, int endX);
+	using FLinearSolveBlocked = void(*)(int gridSize, void* pField, const void* pPrevField, float a, int reflectAxis, int sizeX, int numIterations);
+	using FPressureSolveBlocked = void(*)(int gridSize, float* pPressure, const float* pDivergence, int sizeX, int numIterations);
+	using FLinearSolvePlanes = void(*)(int gridSize, void* pField, const void* pPrevField, float a, int reflectAxis, int sizeX, int firstX, int endX);
+	using FPressureSolvePlanes = void(*)(int gridSize, float* pPressure, const float* pDivergence, int sizeX, int firstX, int endX);
+	using FAdVect = void(*)(int gridSize, void* pField, const void* pPrevField, const void* pVelocityX, const void* pVelocityY, const void* pVelocityZ, float dt0, int sizeX, int firstX, int endX, FC_SweepStats* pStats);
+	using FAdVectVelocities = void(*)(int gridSize, void* pVelocityX, void* pVelocityY, void* pVelocityZ, const void* pPrevVelocityX, const void* pPrevVelocityY, const void* pPrevVelocityZ, float dt0, int sizeX, int firstX, int endX);
+	using FMacCormack = void(*)(int gridSize, void* pField, const void* pForwardField, const void* pPrevField, const void* pVelocityX, const void* pVelocityY, const void* pVelocityZ, float dt0, int sizeX, int firstX, int endX, FC_SweepStats* pStats);
+	using FDivergence = void(*)(int gridSize, float* pDivergence, const void* pVelocityX, const void* pVelocityY, const void* pVelocityZ, float h, int firstX, int endX, FC_SweepStats* pStats);
+	using FProjectVelocities = void(*)(int gridSize, void* pVelocityX, void* pVelocityY, void* pVelocityZ, const float* pPressure, const float* pDivergence, float scale, int firstX, int endX, FC_SweepStats* pStats);
+	using FSetBoundsFaces = void(*)(int gridSize, void* pField, int reflectAxis, int sizeX);
+	using FSetBoundsPlanes = void(*)(int gridSize, void* pField, int reflectAxis, int sizeX, int firstX, int endX);
+	using FSetBoundsCorners = void(*)(int gridSize, void* pField, int sizeX);
+	using FCopyVelocities = float(*)(void* pPrevVelocityX, void* pPrevVelocityY, void* pPrevVelocityZ, const void* pVelocityX, const void* pVelocityY, const void* pVelocityZ, int64 firstIdx, int64 endIdx);
+	using FReadCells = void(*)(const void* pCells, float* pOut, int64 firstIdx, int64 endIdx);
+
+	int m_SpecializedGridSize{}; //0 for the runtime-size fallback
+	EC_FieldPrecision m_Precision{};
+	int m_CellBytes{ sizeof(float) };
+
+	FLinearSolve LinearSolve{};
+	FPressureSolve PressureSolve{};
+	//All iterations in one pass over the grid, the same result as iterating the sweep and SetBoundsFaces
+	//Corners are left to the caller, the sweeps never read them
+	FLinearSolveBlocked LinearSolveBlocked{};
+	FPressureSolveBlocked PressureSolveBlocked{};
+	//One iteration over the planes [firstX, endX) with the face bounds of every plane set right after it, for callers that split the wavefront themselves
+	FLinearSolvePlanes LinearSolvePlanes{};
+	FPressureSolvePlanes PressureSolvePlanes{};
+	FAdVect AdVect{}; //With stats the advected field counts as density, total and active box
+	FAdVectVelocities AdVectVelocities{};
+	//Second pass of MacCormack advection, pForwardField is what AdVect wrote from pPrevField with the same velocity, bounds set
+	//The corrected value is clamped to the cells the backtrace blends, stats like AdVect
+	FMacCormack MacCormack{};
+	FDivergence Divergence{}; //With stats it sums the squared divergence
+	FProjectVelocities ProjectVelocities{}; //With stats it sums the squared residual of the pressure it projects with, the divergence is only read then
+	FSetBoundsFaces SetBoundsFaces{}; //reflectAxis negates the faces normal to that axis, -1 for none
+	FSetBoundsPlanes SetBoundsPlanes{}; //The faces SetBoundsFaces writes from the planes [firstX, endX), so slabs can set their own
+	FSetBoundsCorners SetBoundsCorners{};
+	FCopyVelocities CopyVelocities{}; //Returns the largest squared velocity it copied
+	FReadCells ReadCells{}; //Converts a flat index range to float, for everything outside the solver that wants plain floats
+
+	static const FC_FluidKernels& Get(int gridSize, EC_FieldPrecision precision = EC_FieldPrecision::Float);
+	//The runtime-size float table, the plain scalar loops the specialized and half tables get checked against
+	static const FC_FluidKernels& GetReference() { return Get(0, EC_FieldPrecision::Float); }
+};
+
+//2D kernels for planar solvers, 5-point stencils on (gridSize+2)^2 fields indexed x * (gridSize + 2) + y
+//Always float and runtime size, planar grids are cheap enough that the compile-time sizes wouldn't pay off
+
+struct FLUID_SIMULATION_API FC_PlanarKernels final
+{
+	static void LinearSolve(int gridSize, float* pField, const float* pPrevField, float a, int firstX, int endX);
+	static void PressureSolve(int gridSize, float* pPressure, const float* pDivergence, int firstX, int endX);
+	static void AdVect(int gridSize, float* pField, const float* pPrevField, const float* pVelocityX, const float* pVelocityY, float dt0, int firstX, int endX, FC_SweepStats* pStats);
+	static void AdVectVelocities(int gridSize, float* pVelocityX, float* pVelocityY, const float* pPrevVelocityX, const float* pPrevVelocityY, float dt0, int firstX, int endX);
+	static void MacCormack(int gridSize, float* pField, const float* pForwardField, const float* pPrevField, const float* pVelocityX, const float* pVelocityY, float dt0, int firstX, int endX, FC_SweepStats* pStats);
+	static void Divergence(int gridSize, float* pDivergence, const float* pVelocityX, const float* pVelocityY, float h, int firstX, int endX, FC_SweepStats* pStats);
+	static void ProjectVelocities(int gridSize, float* pVelocityX, float* pVelocityY, const float* pPressure, const float* pDivergence, float scale, int firstX, int endX, FC_SweepStats* pStats);
+	//Edges and corners in one go, reflectAxis negates the edges normal to that axis, -1 for none
+	static void SetBounds(int gridSize, float* pField, int reflectAxis);
+};
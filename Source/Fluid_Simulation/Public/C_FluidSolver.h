@@ -0,0 +1,211 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "C_FieldArena.h"
+#include "C_CompressedField.h"
+#include "C_SpectralPoisson.h"
+#include "C_SolverGraph.h"
+#include "C_WorkerTeam.h"
+#include "C_FluidKernels.h"
+
+class IC_HaloTransport;
+
+//Reduced after every step from partials the sweeps fold in while they write the cells, so none of it costs a pass of its own
+struct FC_SolverStats final
+{
+	float m_TotalDensity{}; //Interior cells after the density advection
+	float m_MaxVelocity{};
+	float m_DivergenceRms{}; //Over the interior before the last projection of the step, what that projection had to remove
+	float m_PressureResidualRms{}; //Of the pressure that projection used, how far the solve was from converged, always 0 without STATS
+	bool m_bHasActiveCells{};
+	FIntVector m_ActiveMin{}; //Global cells with more density than m_ActiveDensityThreshold, both corners inclusive
+	FIntVector m_ActiveMax{};
+};
+
+//Grid solver on flat field buffers, no actors or UObjects involved
+//Fields are (m_GridSize+2)^3 with the outer layer as boundary, indexed by GetIdx (z is the fastest axis)
+//A decomposed solver only holds the x slab [firstGlobalX, firstGlobalX + sizeX) of the global grid,
+//its outer x slices are ghost layers the transport refills from the neighboring ranks after every bounds pass
+//Density and velocity are stored in m_FieldPrecision, read them through the getters below, pressure is always float
+//A planar solver has no z axis, its fields are (m_GridSize+2)^2 with GetRealDepth() 1 and every z 0, velocity z stays 0
+
+class FLUID_SIMULATION_API FC_FluidSolver final
+{
+public:
+	FC_FluidSolver() = default;
+	FC_FluidSolver(const FC_FluidSolver& other) = delete;
+	FC_FluidSolver& operator=(const FC_FluidSolver& other) = delete;
+
+	void Init(int gridSize, float gapSize);
+	//firstGlobalX is the global x of our first interior slice (1 on the first rank), the transport is not owned
+	void InitDecomposed(int gridSize, float gapSize, int firstGlobalX, int sizeX, IC_HaloTransport* pTransport);
+	void Step(float dt);
+
+	bool IsInitialized() const { return m_RealGridSize > 0; }
+	int GetGridSize() const { return m_GridSize; }
+	int GetRealGridSize() const { return m_RealGridSize; }
+	int64 GetNumCells() const { return static_cast<int64>(m_SizeX + 2) * GetSliceSize(); }
+	int GetRealDepth() const { return m_bIsPlanar ? 1 : m_RealGridSize; } //Cells along z
+	int GetSliceSize() const { return m_RealGridSize * GetRealDepth(); } //Cells in one x slice
+	bool IsPlanar() const { return m_bIsPlanar; }
+	int GetSizeX() const { return m_SizeX; }
+	int GetFirstGlobalX() const { return m_FirstGlobalX; }
+	float GetGapSize() const { return m_GapSize; }
+	float GetMaxVelocity() const { return m_MaxVelocity; } //Global over all ranks when decomposed
+	//Substeps dt needs so no cell moves more than cflTarget cells in one at the current max velocity, between 1 and maxSubsteps
+	//The same on every rank when decomposed, so their exchanges stay paired
+	int GetSubstepCount(float dt, float cflTarget, int maxSubsteps = MAX_int32) const;
+	const FC_SolverStats& GetStats() const { return m_Stats; } //Of the last step, global over all ranks when decomposed
+
+	int64 GetIdx(int x, int y, int z) const; //A big domain has more than 2^31 cells
+
+	float GetDensity(int64 idx) const;
+	FVector GetVelocity(int64 idx) const;
+	//Converts the whole field to float, the array keeps its allocation when it's already big enough
+	void CopyDensityField(TArray<float>& outField) const;
+	//Only the x slices [firstX, endX), local ones with the boundary at 0, for domains past the 2^31 cells a whole-field TArray holds
+	void CopyDensitySlices(int firstX, int endX, TArray<float>& outSlices) const;
+	void CopyVelocityFields(TArray<float>& outFieldX, TArray<float>& outFieldY, TArray<float>& outFieldZ) const;
+	EC_FieldPrecision GetFieldPrecision() const { return m_pKernels ? m_pKernels->m_Precision : m_FieldPrecision; }
+	const FC_FieldArena& GetArena() const { return m_Arena; }
+	const FC_FluidKernels& GetKernels() const { return *m_pKernels; }
+	const FC_SolverGraph& GetStepGraph() const { return m_StepGraph; }
+
+	//Slabs split the grid along x, boundary slices belong to the first and last slab
+	int GetNumSlabs() const { return m_NumSlabs; }
+	void GetSlabRange(int slabIdx, int& firstX, int& endX) const;
+
+	void AddDensity(int64 idx, float amount);
+	void AddVelocity(int64 idx, const FVector& amount);
+
+	//Settings, read every step
+	float m_DiffuseAmount{ 0.01f };
+	float m_Viscosity{ 0.01f };
+	int m_DiffuseIterations{ 4 };
+	int m_PressureIterations{ 4 };
+	bool m_bSkipDensityDiffusion{};
+	bool m_bUseTaskGraph{}; //Runs the step as m_StepGraph so independent stages overlap, not on a decomposed domain
+	bool m_bUseBlockedSweeps{}; //Runs all Gauss-Seidel iterations in one cache-resident wavefront pass, same result
+	bool m_bUseSpectralPressure{}; //Exact pressure in one pass instead of m_PressureIterations sweeps, not on a decomposed domain
+	float m_ActiveDensityThreshold{ 0.001f }; //Cells over it count towards the active box of the stats
+
+	//Read on Init
+	bool m_bUseHugePages{};
+	int m_NumThreads{}; //Threads that sweep the slabs, 0 for one per task thread
+	bool m_bUseWorkerTeam{}; //Pinned threads that own one slab each for the whole step, wins over the task graph, steps with spectral pressure skip it
+	EC_FieldPrecision m_FieldPrecision{}; //Storage of density and velocity, a decomposed solver always uses float
+	FString m_BackingDirectory{}; //Maps the fields from a scratch file there for domains larger than RAM, empty to keep them in memory
+	int m_OutOfCoreSlices{ 8 }; //With a backing directory every pass, sweeps and bounds included, walks the grid in windows of this many slices
+	bool m_bPlanar{}; //2D solve with 5-point stencils, always float and not decomposed, team, graph, blocked and spectral settings are ignored
+	bool m_bUseMacCormack{}; //Second-order advection with a limiter, keeps detail a plain backtrace smears out for one more sweep and field
+	//Keeps the density block-compressed between steps and hands its dense pages back to the OS, lossy, only with float fields on a 3D grid
+	//GetDensity, AddDensity and CopyDensityField read and write the compressed blocks then, from any thread
+	//It does not lower peak memory: every step decompresses into both dense density fields and the sweeps run on those,
+	//velocity, pressure and divergence are never compressed, it only shrinks what stays resident between steps
+	bool m_bCompressDensity{};
+	FC_CompressionSettings m_DensityCompression{};
+	bool m_bUseReferenceKernels{}; //Runs FC_FluidKernels::GetReference() whatever the grid size and field precision, see FC_SolverCrossCheck
+
+private:
+	int m_GridSize{};
+	int m_RealGridSize{};
+	int m_SizeX{}; //Interior x slices we hold, m_GridSize unless decomposed
+	int m_FirstGlobalX{ 1 };
+	bool m_bIsPlanar{};
+	float m_GapSize{};
+	float m_MaxVelocity{}; //Reduced during the last Project() of a step
+	int m_NumSlabs{ 1 };
+	const FC_FluidKernels* m_pKernels{}; //Picked for m_GridSize and the field precision on Init
+	const FC_FluidKernels* m_pPressureKernels{}; //Float version of m_pKernels, for pressure and divergence
+	IC_HaloTransport* m_pTransport{};
+
+	//Every field below points into the arena
+	FC_FieldArena m_Arena{};
+	FC_SpectralPoisson m_SpectralPoisson{}; //Plans for m_GridSize, built on Init
+
+	//Cells in the precision of m_pKernels
+	void* m_pDensity{};
+	void* m_pPrevDensity{};
+
+	void* m_pVelocityX{};
+	void* m_pVelocityY{};
+	void* m_pVelocityZ{};
+
+	void* m_pPrevVelocityX{};
+	void* m_pPrevVelocityY{};
+	void* m_pPrevVelocityZ{};
+
+	//Pressure is kept across Project() calls, every solve starts from the last solution
+	float* m_pPressure{};
+	float* m_pDivergence{};
+
+	void* m_pAdVectScratch{}; //Forward pass of MacCormack advection, only allocated with m_bUseMacCormack
+
+	mutable FC_CompressedField m_CompressedDensity{}; //Holds the density between steps with m_bCompressDensity, one cache per slab
+	bool m_bIsDensityCompressed{}; //Set from the end of a step until the start of the next one
+
+	TArray<float> m_SlabPartials{}; //One reduction partial per slab
+	TArray<FC_SweepStats> m_SlabDensityStats{}; //Partials of the last density advection, one per slab
+	TArray<FC_SweepStats> m_SlabDivergenceStats{}; //Partials of the last divergence pass, one per slab
+	FC_SolverStats m_Stats{};
+
+	FC_WorkerTeam m_Team{}; //Member i owns slab i
+	FC_SolverGraph m_StepGraph{}; //Same stages as HandleVelocities and HandleDensities, built on Init
+	float m_StepDt{};
+
+	void HandleDensities(float dt);
+	void LinearSolveDensities(float a);
+	void AdVectDensities(float dt);
+	void SwapDensities();
+	void SetBoundsDiffuse();
+
+	void HandleVelocities(float dt);
+	void LinearSolveVelocities(float a);
+	void LinearSolveVelocity(int axis, float a); //One component with its own bounds, no halo exchange
+	void AdVectVelocities(float dt);
+	void AdVectVelocityFields(float dt);
+	void Project();
+	void CopyVelocities();
+	void CopyVelocitiesSlab(int slabIdx);
+	void ReduceMaxVelocity();
+	void ResetSlabStats(TArray<FC_SweepStats>& slabStats) const;
+	FC_SweepStats* GetResidualStats(int slabIdx); //The slab's divergence partial, nullptr without STATS so the projection skips the residual
+	void ReduceStats();
+	void SwapVelocities();
+	void SetBoundsVelocity();
+	void SetDivergence(float h);
+	void SetBoundsDivergence();
+	void SetBoundsPressure();
+	void LinearSolvePressure(); //A little different from the other linear solvers
+	void SetProjectedVelocities(float h);
+
+	void StepPlanar(float dt);
+	void ProjectPlanar();
+
+	void StepOnTeam(int memberIdx, float dt);
+	void ProjectOnTeam(int memberIdx, int firstX, int endX);
+	void SweepOnTeam(int memberIdx, int firstX, int endX, int numIterations, TFunctionRef<void(int sweepFirstX, int sweepEndX)> sweepPlanes);
+	void AdVectMacCormackOnTeam(int memberIdx, int firstX, int endX, void* pField, const void* pPrevField, int reflectAxis, const void* pVelocityX, const void* pVelocityY, const void* pVelocityZ, float dt0, FC_SweepStats* pStats);
+	void BuildStepGraph();
+	int AddProjectNodes(const TCHAR* pPass, const TArray<int>& prerequisites, int& outProjectedNode);
+	bool CanBlockSweeps(int numIterations) const;
+	bool CanSweepWindows(int numIterations) const; //File backed, takes over from the blocked and the plain sweeps
+	void SweepWindows(int numIterations, TFunctionRef<void(int firstX, int endX)> sweepPlanes) const; //Serial Gauss-Seidel in windows of m_OutOfCoreSlices
+	void SetFieldFaces(const FC_FluidKernels& kernels, void* pField, int reflectAxis) const; //SetBoundsFaces, windowed when file backed
+	void ExchangeHalos(void* pField);
+	void CountSweeps(int numFields, int numIterations) const; //Feeds the stat counters, compiled out with them
+	void ParallelForSlabs(TFunctionRef<void(int slabIdx, int firstX, int endX)> function) const; //Interior x range of every slab
+	void ParallelForWindows(TFunctionRef<void(int slabIdx, int firstX, int endX)> function) const;
+	void LinearSolve(void* pField, const void* pPrevField, float a);
+	void AdVect(void* pField, const void* pPrevField, float dt);
+	//Velocity z is ignored on a planar solver, reflectAxis is the field's for the bounds of the forward pass
+	void AdVectMacCormack(void* pField, const void* pPrevField, int reflectAxis, const void* pVelocityX, const void* pVelocityY, const void* pVelocityZ, float dt0, TArray<FC_SweepStats>* pSlabStats);
+	float ReadCell(const void* pField, int64 idx) const;
+	void WriteCell(void* pField, int64 idx, float value);
+	void CopyField(const void* pField, TArray<float>& outField) const;
+	void CompressDensity();
+	void DecompressDensity();
+	void GetCellCoords(int64 idx, int& outX, int& outY, int& outZ) const;
+};
@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+//Instrumentation of the fluid pipeline, "stat Fluid" in game and the Fluid channel in Insights (-trace=cpu,fluid)
+//Both compile out of shipping builds, STATS is off there and so is the CPU profiler trace
+//FLUID_SCOPE(Name) times the enclosing scope as STAT_Fluid<Name> and as a FluidName trace event
+//FLUID_TRACE_SCOPE(Name) is the trace event alone, for scopes too short or too many to be worth a stat, like single iterations
+
+DECLARE_STATS_GROUP(TEXT("Fluid"), STATGROUP_Fluid, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Tick"), STAT_FluidTick, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Step"), STAT_FluidStep, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Diffuse"), STAT_FluidDiffuse, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Advect"), STAT_FluidAdvect, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Project"), STAT_FluidProject, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Divergence"), STAT_FluidDivergence, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Pressure solve"), STAT_FluidPressureSolve, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Project velocities"), STAT_FluidProjectVelocities, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Copy velocities"), STAT_FluidCopyVelocities, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Set bounds"), STAT_FluidSetBounds, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Density compression"), STAT_FluidCompression, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Snapshot"), STAT_FluidSnapshot, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Tracers"), STAT_FluidTracers, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Replication"), STAT_FluidReplication, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Visualization"), STAT_FluidVisualization, STATGROUP_Fluid, FLUID_SIMULATION_API);
+
+//Per frame
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Substeps"), STAT_FluidSubsteps, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Solver iterations"), STAT_FluidIterations, STATGROUP_Fluid, FLUID_SIMULATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Cells processed"), STAT_FluidCellsProcessed, STATGROUP_Fluid, FLUID_SIMULATION_API); //Interior cells times sweeps
+//Of the last step
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Divergence RMS"), STAT_FluidDivergenceRms, STATGROUP_Fluid, FLUID_SIMULATION_API); //What the projection removes, not how well the pressure solve did
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Pressure residual RMS"), STAT_FluidPressureResidualRms, STATGROUP_Fluid, FLUID_SIMULATION_API); //Of the pressure equation after the solve
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Max velocity"), STAT_FluidMaxVelocity, STATGROUP_Fluid, FLUID_SIMULATION_API);
+
+#if CPUPROFILERTRACE_ENABLED
+UE_TRACE_CHANNEL_EXTERN(FluidChannel, FLUID_SIMULATION_API);
+#define FLUID_TRACE_SCOPE(Name) TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Name, FluidChannel)
+#else
+#define FLUID_TRACE_SCOPE(Name)
+#endif
+
+#define FLUID_SCOPE(Name) SCOPE_CYCLE_COUNTER(STAT_Fluid##Name); FLUID_TRACE_SCOPE(Fluid##Name)
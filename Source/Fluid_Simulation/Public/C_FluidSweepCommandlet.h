@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "C_FluidSweepCommandlet.generated.h"
+
+//Headless parameter sweep, every combination in the spec is an independent run on its own single-threaded solver
+//-run=C_FluidSweep -Spec=<file> [-Out=<directory>] [-DumpFields]
+//The spec has one parameter per line, a comma separated list or start:end:count for evenly spaced values, # starts a comment:
+//	GridSize=32,64
+//	DiffuseAmount=0.001:0.01:4
+//	Viscosity=0,0.01
+//Parameters are GridSize, GapSize, DiffuseAmount, Viscosity, DiffuseIterations, PressureIterations, Steps, Dt, SourceRate, Planar, Half, MacCormack
+//and CflTarget, the ones left out keep the grid manager's defaults
+//Runs fill every task thread, summary.csv in the output directory gets one line per run, -DumpFields also writes the final density of each
+//as run_<index>_density.raw, float32 cells in solver order
+
+UCLASS()
+class FLUID_SIMULATION_API UC_FluidSweepCommandlet final : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UC_FluidSweepCommandlet();
+
+	virtual int32 Main(const FString& params) override;
+};
@@ -4,6 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "C_FluidSolver.h"
+#include "C_FieldSampler.h"
+#include "C_TracerParticles.h"
+#include "C_FieldExporter.h"
+#include "C_FieldReplication.h"
 #include "C_GridManager.generated.h"
 
 class AC_PointVector;
@@ -29,44 +34,248 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly)
 	float m_Viscosity{ 0.01f };
 
+	//Solves a 2D m_GridSize^2 sheet in the z = 0 plane instead of a volume, for fog, ripples and other flat effects
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bPlanar{};
+
+	//Second-order MacCormack advection with a limiter, keeps detail the default backtrace smears out,
+	//so a grid half the size looks about as sharp, for one more sweep per advected field and a scratch field, takes effect on the next play
+	//Like the default it doesn't conserve density exactly, hard edges drift a few percent over many steps
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bUseMacCormack{};
+
+	//Asks the OS for huge pages for the solver's field arena
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bUseHugePages{};
+
+	//Stores density and velocity as half floats, half the memory traffic of the sweeps at roughly 3 significant digits
+	//Pressure stays float, changing this only takes effect on the next play
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bUseHalfPrecisionFields{};
+
+	//Keeps the density block-compressed between steps at up to m_CompressBitsPerValue bits a cell instead of 32, lossy
+	//Density changes slowly, so the error a step adds stays under m_CompressTolerance when that's set, float 3D grids only, takes effect on the next play
+	//It does not reduce peak memory, the solver steps on dense fields and every snapshot copies the whole density out as floats again
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bCompressDensity{};
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_CompressBitsPerValue{ 8.f };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_CompressTolerance{};
+
+	//Point vectors are only a debug view of the solver, they get spawned m_PointVectorsPerFrame at a time
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bSpawnPointVectors{ true };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	int m_PointVectorsPerFrame{ 256 };
+
+	//Tracer particles, advected through the velocity field after every step
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bUseTracers{};
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	int m_MaxTracers{ 1000000 };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_TracersPerSecond{ 50000.f };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_TracerLifetime{ 5.f };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_TracerEmitRadius{ 0.15f }; //Fraction of the grid size around the center
+
+	//Substepping, the step is split so no cell moves more than m_CflTarget cells per substep
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_CflTarget{ 1.f };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	int m_MaxSubsteps{ 8 };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_FrameBudgetMs{ 4.f };
+
+	//Substep report of the last frame
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int m_LastSubsteps{};
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float m_LastStepMs{};
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float m_DroppedTime{}; //Simulation time skipped because the budget ran out
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	bool m_bFellBehind{};
+
+	//Stats of the last step, the solver folds them into its sweeps so they're always up to date
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_ActiveDensityThreshold{ 0.001f };
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float m_TotalDensity{};
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float m_MaxVelocity{};
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float m_DivergenceRms{};
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float m_PressureResidualRms{}; //Stays 0 in builds without stats
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	bool m_bHasActiveCells{};
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	FIntVector m_ActiveMin{}; //Cells with more density than m_ActiveDensityThreshold, inclusive
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	FIntVector m_ActiveMax{};
+
+	//Benchmarks the execution settings below on the first play at this grid size, precision and machine, later plays read the cached pick
+	//Planar grids skip it and keep the settings below as they are
+	//The pick may include the spectral pressure solve, which is exact where the iterative one is approximate
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bAutotune{};
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bForceRetune{};
+
+	//Threads that sweep the grid, 0 for one per task thread
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	int m_NumThreads{};
+
+	//Pinned threads that own a slab each for the whole step, meant for small grids where task dispatch dominates
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bUseWorkerTeam{};
+
+	//Runs the step as a task graph so independent stages overlap, DescribeStepGraph shows the stages and their last timings
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bUseTaskGraph{ true };
+	UFUNCTION(BlueprintCallable)
+	FString DescribeStepGraph() const { return m_Solver.GetStepGraph().Describe(); }
+	UFUNCTION(CallInEditor)
+	void LogStepGraph() const;
+
+	//Steps the settings above next to the plain reference kernels and logs how far every field drifts from it
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	int m_CrossCheckSteps{ 20 };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_CrossCheckTolerance{ 1e-3f };
+	UFUNCTION(CallInEditor)
+	void RunCrossCheck() const;
+
+	//Runs the Gauss-Seidel iterations as one wavefront pass that stays in cache, the result doesn't change
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bUseBlockedSweeps{ true };
+
+	//Solves the pressure exactly with cosine transforms, the governor's pressure tier has no effect then
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bUseSpectralPressure{};
+
+	//Governor, lowers solver quality while the step is over m_GovernorTargetMs, off so scenes keep full quality unless they opt in
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bUseGovernor{};
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_GovernorTargetMs{ 3.f };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_GovernorRestoreFraction{ 0.6f }; //Only restore quality once the cost is under this fraction of the target
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	int m_GovernorHoldFrames{ 30 }; //Frames a decision has to hold before the next one is made
+
+	//Governor report
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int m_QualityLevel{}; //0 is full quality, see EQualityLevel
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float m_AverageStepMs{};
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int m_DiffuseIterations{ 4 };
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int m_PressureIterations{ 4 };
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	bool m_bSkipDensityDiffusion{};
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int m_QualityChanges{};
+
+	//Publishes every completed step to shared memory for external tools, see FC_FieldExporter for the layout
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bExportFields{};
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	FString m_ExportName{ TEXT("Fields") };
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int m_ExportsSkipped{};
+
+	//Server-authoritative replication, see FC_FieldReplicationEncoder, clients keep solving locally and get pulled toward the server
+	//To try it on one machine, start a listen server (<map>?listen) and a client connecting to 127.0.0.1 with the same grid settings
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool m_bReplicateFields{};
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_ReplicationBytesPerSecond{ 4096.f };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_ReplicationSendRate{ 10.f };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_ReplicationKeyframeInterval{ 5.f };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_ReplicationMaxDensity{ 1.f }; //Quantization ranges, keep them close to what the simulation reaches
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_ReplicationMaxVelocity{ 10.f };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float m_ReplicationBlendTime{ 0.25f };
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	int m_ClientIterations{ 2 }; //Cap on the diffusion and pressure iterations of a client's local solve
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float m_ReplicatedBytesPerSecond{}; //Sent on the server, received on a client
+
+	//Fields of the last completed step, safe to call from any thread, hold on to it for as long as it's needed
+	FC_FieldSnapshotPtr GetSnapshot() const;
+
+	//Packed tracer positions for the renderer, xyz world position and w normalized age
+	const TArray<FVector4f>& GetTracerRenderBuffer() const { return m_Tracers.GetRenderBuffer(); }
+	UFUNCTION(BlueprintCallable)
+	int GetNumTracers() const { return m_Tracers.Num(); }
+
+	//Interpolated velocity and density at world positions, an output is skipped when its array is empty
+	UFUNCTION(BlueprintCallable)
+	void SampleFields(const TArray<FVector>& positions, TArray<FVector>& outVelocities, TArray<float>& outDensities) const;
+
 private:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
 	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
-	TArray<AActor*> m_pPointVectors{};
-	int m_RealGridSize{};
+	FC_FluidSolver m_Solver{};
+	FC_TracerParticles m_Tracers{};
+	FC_FieldExporter m_Exporter{};
+	FC_FieldReplicationEncoder m_ReplicationEncoder{};
+	FC_FieldReplicationDecoder m_ReplicationDecoder{};
+	float m_ReplicationTimer{};
+	int m_ReplicatedBytes{}; //Since m_ReplicatedBytesPerSecond was last updated
+	float m_ReplicatedBytesTime{};
+	float m_TracersToEmit{};
+
+	TArray<AC_PointVector*> m_pPointVectors{}; //Indexed like the solver cells, filled a few per frame
+	TArray<AC_PointVector*> m_pPointVectorPool{}; //Hidden point vectors ready to be reused
+
+	//Published after every step, the spare one gets refilled once no reader holds it anymore
+	TSharedPtr<FC_FieldSnapshot, ESPMode::ThreadSafe> m_pSnapshot{};
+	TSharedPtr<FC_FieldSnapshot, ESPMode::ThreadSafe> m_pSpareSnapshot{};
+	mutable FCriticalSection m_SnapshotLock{};
+	uint64 m_Frame{};
 	const int m_Iterations{ 4 };
 
+	enum EQualityLevel : int
+	{
+		Full,
+		ReducedDiffusion,		//Half the diffusion iterations
+		ReducedPressure,		//Half the pressure iterations as well
+		NoDensityDiffusion,		//Skip the density diffusion solve
+		Count
+	};
+
+	int m_FramesSinceQualityChange{};
+
 	void Populate();
+	void SpawnPointVectors();
+	void ReleasePointVectors();
+	void UpdatePointVectors();
+	FVector GetCellLocation(int idx) const;
+	void PublishSnapshot();
+	void ExportSnapshot();
+	void UpdateTracers(float dt);
+	void ReplicateFields(float dt);
+	bool IsReplicatedClient() const;
+
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastFieldPacket(const TArray<uint8>& packet);
 
-	void HandleDensities(float dt);
-	void LinearSolveDensities(float a);
-	void AdVectDensities(float dt);
-
-	void SwapDensities();
-	float GetNeighborDensities(int x, int y, int z);
-	void SetBoundsDiffuse();
-	float AdvectPrevDensityCalculations(int i, int j, int k, int i1, int j1, int k1, float s, float t, float u, float s1, float t1, float u1);
-
-	void HandleVelocities(float dt);
-	void LinearSolveVelocities(float a);
-	void AdVectVelocities(float dt);
-	void Project();
-
-	void SwapVelocities();
-	FVector GetNeighborVelocities(int x, int y, int z);
-	void SetBoundsVelocity();
-	FVector AdvectPrevVelocityCalculations(int i, int j, int k, int i1, int j1, int k1, float s, float t, float u, float s1, float t1, float u1);
-	void SetDivergence(int x, int y, int z, float h);
-	void SetBoundsDivergence();
-	void SetBoundsPressure();
-	void LinearSolvePressure(); //A little different from the other linear solvers
-	void SetProjectedVelocities(float h);
-
-	int GetIdx(int x, int y, int z);
-	float AdVectIfChecks(float value);
+	void Step(float dt);
+	void UpdateGovernor();
+	void ApplyQualityLevel();
 
 public:	
 	// Called every frame
@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Moves ghost layers between the ranks of a decomposed domain and does the global reductions
+//Ranks own consecutive x slabs, so every rank only talks to rank - 1 (low side) and rank + 1 (high side)
+
+class FLUID_SIMULATION_API IC_HaloTransport
+{
+public:
+	virtual ~IC_HaloTransport() = default;
+
+	virtual int GetRank() const = 0;
+	virtual int GetNumRanks() const = 0;
+
+	//Sends our boundary slices and receives the neighbors' into our ghost slices, blocks until both arrived
+	//Views on a side without a neighbor are empty
+	virtual void ExchangeHalos(TArrayView<const float> sendLow, TArrayView<float> receiveLow, TArrayView<const float> sendHigh, TArrayView<float> receiveHigh) = 0;
+
+	virtual float AllReduceSum(float value) = 0;
+	virtual float AllReduceMax(float value) = 0;
+	virtual void Barrier() = 0;
+
+	//A rank that fails aborts the job, every wait on every rank returns right away from then on with stale data,
+	//so the callers check IsAborted and stop instead of hanging on a rank that is gone
+	virtual void Abort() = 0;
+	virtual bool IsAborted() const = 0;
+};
+
+//Local transport, all ranks map one POSIX shared memory segment with a mailbox per direction
+//Rank 0 creates the segment, the others open it once it exists, a wait that runs past timeoutSeconds aborts the job
+//Only available on Linux, Create returns null elsewhere
+
+class FLUID_SIMULATION_API FC_SharedMemoryTransport final : public IC_HaloTransport
+{
+public:
+	static TUniquePtr<FC_SharedMemoryTransport> Create(const FString& jobName, int rank, int numRanks, int sliceFloats, float timeoutSeconds = 300.f);
+	virtual ~FC_SharedMemoryTransport() override;
+
+	virtual int GetRank() const override { return m_Rank; }
+	virtual int GetNumRanks() const override { return m_NumRanks; }
+
+	virtual void ExchangeHalos(TArrayView<const float> sendLow, TArrayView<float> receiveLow, TArrayView<const float> sendHigh, TArrayView<float> receiveHigh) override;
+
+	virtual float AllReduceSum(float value) override;
+	virtual float AllReduceMax(float value) override;
+	virtual void Barrier() override;
+
+	virtual void Abort() override;
+	virtual bool IsAborted() const override;
+
+private:
+	struct FHeader;
+	struct FMailbox;
+
+	FC_SharedMemoryTransport() = default;
+
+	FString m_Name{};
+	int m_Rank{};
+	int m_NumRanks{};
+	int m_SliceFloats{};
+	float m_TimeoutSeconds{};
+
+	uint8* m_pMemory{};
+	SIZE_T m_Size{};
+	uint64 m_ReceivedLow{};
+	uint64 m_ReceivedHigh{};
+
+	static SIZE_T GetMailboxStride(int sliceFloats);
+	FHeader& GetHeader() const;
+	FMailbox& GetMailbox(int rank, bool bIsHigh) const; //Mailbox rank writes into for its low or high neighbor
+	float* GetMailboxData(FMailbox& mailbox) const;
+
+	//WaitUntil that also gives up when the job is aborted, false when it did
+	template <typename TCondition>
+	bool WaitUnlessAborted(TCondition condition) const;
+
+	void Send(FMailbox& mailbox, TArrayView<const float> data) const;
+	void Receive(FMailbox& mailbox, uint64& receivedCount, TArrayView<float> data) const;
+	void AllGather(float value, TArrayView<float> outValues);
+};
@@ -0,0 +1,40 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "C_FluidKernels.h"
+
+class FC_FluidSolver;
+
+//Execution settings of FC_FluidSolver that only change how fast a step runs, not what the caller asked for
+struct FLUID_SIMULATION_API FC_SolverConfig final
+{
+	int m_NumThreads{};
+	bool m_bUseWorkerTeam{};
+	bool m_bUseTaskGraph{};
+	bool m_bUseBlockedSweeps{};
+	bool m_bUseSpectralPressure{};
+
+	//Applies everything, the thread count and the worker team only take effect on the next Init
+	void ApplyTo(FC_FluidSolver& solver) const;
+
+	FString ToString() const;
+	static bool FromString(const FString& text, FC_SolverConfig& outConfig);
+};
+
+//Benchmarks every candidate config on a scratch solver of the same size and keeps the fastest
+//Results are cached in Saved/FluidAutotune.txt per CPU, grid size and field precision, so only the first session pays for it
+//Planar grids aren't tuned, their solver ignores every setting but the thread count
+
+class FLUID_SIMULATION_API FC_SolverAutotuner final
+{
+public:
+	//Planar grids get the default config back, nothing is measured or cached for them
+	static FC_SolverConfig GetConfig(int gridSize, float gapSize, bool bPlanar, EC_FieldPrecision precision, bool bForceRetune = false);
+
+private:
+	static FString GetCachePath();
+	static FString GetCacheKey(int gridSize, bool bPlanar, EC_FieldPrecision precision);
+	static float MeasureStepMs(const FC_SolverConfig& config, int gridSize, float gapSize, EC_FieldPrecision precision);
+};
@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "C_FluidKernels.h"
+#include "C_SolverAutotuner.h"
+
+//Steps a reference solver and the solver under test side by side from the same start and compares their fields after every step
+//The reference runs the runtime-size float kernels on one thread, in order, with none of the fast paths
+//Threading, blocked sweeps and the kernel tables should stay within float rounding of it, half fields within half rounding
+//The spectral pressure is exact where the reference sweeps are not, expect it to need a much looser tolerance
+
+struct FC_CrossCheckSettings final
+{
+	int m_GridSize{ 32 };
+	float m_GapSize{ 100.f };
+	float m_DiffuseAmount{ 0.01f };
+	float m_Viscosity{ 0.01f };
+	int m_Iterations{ 4 }; //Diffusion and pressure iterations of both solvers
+	bool m_bPlanar{};
+	bool m_bUseMacCormack{}; //Both solvers advect with it, the reference through its own scalar kernels
+
+	//The solver under test
+	FC_SolverConfig m_Config{};
+	EC_FieldPrecision m_FieldPrecision{};
+
+	int m_NumSteps{ 20 };
+	float m_Dt{ 1.f / 60.f };
+	float m_Tolerance{ 1e-3f }; //Largest difference allowed, relative to the peak magnitude of the reference field or 1, whichever is larger
+};
+
+struct FC_FieldDifference final
+{
+	FString m_Name{};
+	float m_MaxError{}; //Over every cell and step
+	float m_RmsError{}; //Over every cell and step
+	float m_PeakReference{}; //Largest magnitude the reference field reached
+	int m_WorstStep{};
+	bool m_bPassed{};
+};
+
+struct FLUID_SIMULATION_API FC_CrossCheckReport final
+{
+	TArray<FC_FieldDifference> m_Fields{};
+	int m_NumSteps{};
+	bool m_bPassed{};
+
+	FString ToString() const;
+};
+
+class FLUID_SIMULATION_API FC_SolverCrossCheck final
+{
+public:
+	static FC_CrossCheckReport Run(const FC_CrossCheckSettings& settings);
+
+private:
+	static void Compare(const TArray<float>& reference, const TArray<float>& tested, int stepIdx, FC_FieldDifference& inOutDifference, double& inOutSquares);
+};
@@ -0,0 +1,38 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Static dependency graph of solver stages, built once and launched on the engine task system every step
+//Every node runs as a named task, so the stages show up by name in Insights, Describe gives the same picture as text
+
+struct FC_SolverGraphNode final
+{
+	FString m_Name{};
+	TFunction<void()> m_Function{};
+	TArray<int> m_Prerequisites{};
+
+	//Timing of the last run, relative to the start of the run
+	double m_LastStartMs{};
+	double m_LastMs{};
+};
+
+class FLUID_SIMULATION_API FC_SolverGraph final
+{
+public:
+	//Prerequisites have to be nodes added before, which keeps the graph acyclic
+	int AddNode(const FString& name, TFunction<void()> function, const TArray<int>& prerequisites);
+	void Reset() { m_Nodes.Reset(); }
+
+	//Launches every node once its prerequisites are done and waits for all of them
+	void Run();
+
+	const TArray<FC_SolverGraphNode>& GetNodes() const { return m_Nodes; }
+	double GetLastRunMs() const { return m_LastRunMs; }
+	FString Describe() const;
+
+private:
+	TArray<FC_SolverGraphNode> m_Nodes{};
+	double m_LastRunMs{};
+};
@@ -0,0 +1,39 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Direct pressure solve for the box domain, the discrete Poisson problem with mirrored walls is diagonal in the cosine basis
+//Transforms are a self-contained mixed-radix FFT behind a DCT-II, plans and eigenvalues are built once per grid size
+//Solves the same equation the Gauss-Seidel pressure solve relaxes: 6p - (sum of the 6 neighbors) = divergence
+
+class FLUID_SIMULATION_API FC_SpectralPoisson final
+{
+public:
+	void Init(int gridSize);
+	bool IsInitialized() const { return m_GridSize > 0; }
+	int GetGridSize() const { return m_GridSize; }
+
+	//Both are full (N+2)^3 solver fields, only the interior of the pressure is written
+	void Solve(float* pPressure, const float* pDivergence) const;
+
+private:
+	struct FComplex
+	{
+		float m_Re;
+		float m_Im;
+	};
+
+	int m_GridSize{};
+	TArray<int> m_Factors{}; //Radices of the FFT, smallest first
+	TArray<FComplex> m_Twiddles{}; //e^(-2 pi i k / N)
+	TArray<FComplex> m_ShiftTwiddles{}; //e^(-i pi k / 2N), turns the reordered FFT into the DCT
+	TArray<float> m_Eigenvalues{}; //2 - 2cos(pi k / N) per axis
+
+	void Fft(const FComplex* pInput, FComplex* pOutput, int size, int stride, int factorIdx) const;
+	void ForwardLine(float* pLine, FComplex* pWork, FComplex* pSpectrum) const; //DCT-II in place
+	void InverseLine(float* pLine, FComplex* pWork, FComplex* pSpectrum) const; //Exact inverse of ForwardLine
+
+	void TransformAxis(float* pField, int axis, bool bInverse) const;
+};
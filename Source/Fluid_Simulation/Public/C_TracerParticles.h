@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FC_FieldSnapshot;
+
+//Massless particles carried by the velocity field, stored as SoA in grid space
+//Advected with RK2 (midpoint) using the vectorized sampler, in parallel chunks
+
+class FLUID_SIMULATION_API FC_TracerParticles final
+{
+public:
+	void Reset(int maxParticles);
+
+	//Bulk emission, returns how many fit under the max
+	int EmitSphere(int count, const FVector& gridCenter, float gridRadius, float lifetime);
+	int EmitAt(TArrayView<const FVector> gridPositions, float lifetime);
+
+	//Advects every particle and kills the expired or escaped ones in one go
+	void Advect(const FC_FieldSnapshot& snapshot, float dt);
+	void KillAll() { SetNum(0); }
+
+	//Packed xyz world position and w normalized age, rebuilt by Advect
+	const TArray<FVector4f>& GetRenderBuffer() const { return m_RenderBuffer; }
+	int Num() const { return m_PositionX.Num(); }
+	int GetMaxParticles() const { return m_MaxParticles; }
+
+	//One tracer in a uniform +x velocity has to end up at a larger x, run with -CrossCheck
+	static bool CheckFollowsFlow();
+
+private:
+	int m_MaxParticles{};
+	FRandomStream m_Random{ 0x7ace };
+
+	TArray<float> m_PositionX{};
+	TArray<float> m_PositionY{};
+	TArray<float> m_PositionZ{};
+	TArray<float> m_Age{};
+	TArray<float> m_Lifetime{};
+	TArray<uint8> m_IsDead{};
+
+	TArray<FVector4f> m_RenderBuffer{};
+
+	void SetNum(int num);
+	void Compact();
+};
@@ -0,0 +1,46 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+//Fixed team of threads pinned to cores, member 0 is the thread calling Run and the others are ours
+//Members spin between runs for a short while before they go to sleep, so back-to-back runs never pay a wake-up,
+//and inside a run they line up with a spinning barrier instead of going back through the task system
+
+class FLUID_SIMULATION_API FC_WorkerTeam final
+{
+public:
+	FC_WorkerTeam() = default;
+	~FC_WorkerTeam();
+
+	FC_WorkerTeam(const FC_WorkerTeam& other) = delete;
+	FC_WorkerTeam& operator=(const FC_WorkerTeam& other) = delete;
+
+	bool Start(int numMembers);
+	void Stop();
+	bool IsRunning() const { return m_NumMembers > 1; }
+	int GetNumMembers() const { return m_NumMembers; }
+
+	//Runs function on every member at once and returns when all of them are done
+	void Run(TFunctionRef<void(int memberIdx)> function);
+	//Only valid inside Run, every member has to reach it the same number of times
+	void Barrier();
+
+private:
+	class FWorker;
+
+	int m_NumMembers{ 1 };
+	TArray<TUniquePtr<FWorker>> m_pWorkers{};
+
+	const TFunctionRef<void(int memberIdx)>* m_pFunction{};
+	std::atomic<uint32> m_RunGeneration{};
+	std::atomic<int> m_NumFinished{};
+	std::atomic<bool> m_bIsStopping{};
+
+	std::atomic<int> m_BarrierCount{};
+	std::atomic<uint32> m_BarrierGeneration{};
+
+	void RunMember(int memberIdx, uint32& seenGeneration);
+};